@@ -1,4 +1,5 @@
 #include <string>
+#include "money.h"
 
 #ifndef ACCOUNT_H_
 #define ACCOUNT_H_
@@ -8,7 +9,7 @@
 */
 struct account {
 	std::string name;
-	double amount;
+	Money amount;
 	std::string state;
 };
 
@@ -4,7 +4,6 @@
 #include "account_frame.h"
 #include <wx/wizard.h>
 #include "wx/busyinfo.h"
-#include <iomanip>
 
 using tcp = asio::ip::tcp;
 
@@ -34,15 +33,19 @@ AccountFrame::AccountFrame(account acc, MainFrame* mf) : wxFrame(nullptr, wxID_A
 	sizer->SetSizeHints(this);
 
 	loadMainFrameData(acc);
+	loadServerData();
 }
 
 void AccountFrame::onTransferButtonClicked(wxCommandEvent& evt)
 {
 	std::string current_name = name_control->GetValue().ToStdString();
-	TransferDialog* dlg = new TransferDialog(current_email, current_name, this, wxID_ANY, "Transfer");
+	TransferDialog* dlg = new TransferDialog(current_email, current_name, suggestions, this, wxID_ANY, "Transfer");
 
 	if (dlg->ShowModal() == wxID_OK) {
 		loadResponseData(dlg);
+
+		// The transfer might have added a new target, let the next dialog ask for them
+		suggestions = "";
 	}
 
     dlg->Destroy();
@@ -152,6 +155,67 @@ void AccountFrame::loadMainFrameData(account acc)
 	state_control->SetValue(acc.state);
 }
 
+void AccountFrame::loadServerData()
+{
+	std::string current_name = name_control->GetValue().ToStdString();
+	std::vector<std::string> responses;
+
+	{
+		wxWindowDisabler disable_all;
+		wxBusyInfo wait("Loading account info ...");
+
+		std::string list_message = LIST_ACCOUNTS_ID;
+		list_message += current_email + ConnectionManager::END;
+
+		std::string suggest_message = SUGGEST_ID;
+		suggest_message += current_email + ConnectionManager::SEPARATOR;
+		suggest_message += current_name + ConnectionManager::END;
+
+		responses = ConnectionManager::sendMessages({ list_message, suggest_message });
+	}
+
+	std::string list_response = responses[0];
+	if (list_response.substr(0, 3) == ConnectionManager::ACCEPTED) {
+		list_response.erase(0, 3);
+		loadAccountListData(list_response);
+	}
+
+	if (responses[1].substr(0, 3) == ConnectionManager::ACCEPTED) {
+		suggestions = responses[1];
+	}
+}
+
+void AccountFrame::loadAccountListData(std::string& response)
+{
+	std::string current_name = name_control->GetValue().ToStdString();
+	std::string email_response = "";
+	std::string count_str = "";
+
+	ConnectionManager::fillField(response, email_response, ConnectionManager::SEPARATOR);
+	ConnectionManager::fillField(response, count_str, ConnectionManager::SEPARATOR);
+
+	int count = std::stoi(count_str);
+	for (int i = 0; i < count; i++) {
+		std::string name = "";
+		std::string amount_str = "";
+		std::string state = "";
+
+		ConnectionManager::fillField(response, name, ConnectionManager::SEPARATOR);
+		ConnectionManager::fillField(response, amount_str, ConnectionManager::SEPARATOR);
+		if (i == (count - 1)) {
+			ConnectionManager::fillField(response, state, ConnectionManager::END);
+		}
+		else {
+			ConnectionManager::fillField(response, state, ConnectionManager::SEPARATOR);
+		}
+
+		if (name == current_name) {
+			balance_control->SetValue(format_amount(Money::parse(amount_str)));
+			state_control->SetValue(state);
+		}
+	}
+}
+
 void AccountFrame::makeBold(wxStaticText* text)
 {
 	wxFont font = text->GetFont();
@@ -185,12 +249,8 @@ wxPanel* AccountFrame::createHistoryPanel()
 	return panel;
 }
 
-std::string AccountFrame::format_amount(double amount)
+std::string AccountFrame::format_amount(Money amount)
 {
-	std::stringstream stream;
-	stream << std::fixed << std::setprecision(2) << amount;
-	std::string result = stream.str();
-
-	return result;
+	return amount.str();
 }
 
@@ -87,6 +87,13 @@ private:
 	// email of current user
 	const std::string current_email;
 
+	// Command IDs
+	const std::string LIST_ACCOUNTS_ID = "10";
+	const std::string SUGGEST_ID = "11";
+
+	// Prefetched server response with previously used targets (empty if not available)
+	std::string suggestions;
+
 	/**
 	 * UI setup for the information section.
 	 * @param[in]	sizer	Parent control sizer
@@ -117,6 +124,20 @@ private:
 	 */
 	void loadMainFrameData(account acc);
 
+	/**
+	 * Refresh the account information and prefetch previously used targets
+	 * for transfers. Both requests are pipelined, so they take a single round
+	 * trip to the server.
+	 */
+	void loadServerData();
+
+	/**
+	 * Update the information in this frame with data from the list of accounts
+	 * sent by server.
+	 * @param[in]	response	Server response with list of accounts (without status)
+	 */
+	void loadAccountListData(std::string& response);
+
 	/**
 	 * Change the text font to bold.
 	 * @param[out]	text	Text to make bold
@@ -138,11 +159,11 @@ private:
 	wxPanel* createHistoryPanel();
 
 	/**
-	 * String representation of given double to 2 decimal places.
-	 * @param[in]	amount	Double value
+	 * String representation of given amount to 2 decimal places.
+	 * @param[in]	amount	The amount
 	 * @returns				2 decimal places representation
 	 */
-	std::string format_amount(double amount);
+	std::string format_amount(Money amount);
 
 	wxDECLARE_EVENT_TABLE();
 };
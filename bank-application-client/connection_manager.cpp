@@ -1,48 +1,90 @@
 #include <SDKDDKVer.h>
 #include "connection_manager.h"
+#include "protocol.h"
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 using tcp = asio::ip::tcp;
 
 const std::string ConnectionManager::ACCEPTED = "SUC";
 const std::string ConnectionManager::REJECTED = "ERR";
+const std::string ConnectionManager::HOST = "127.0.0.1";
+const std::string ConnectionManager::PORT = "13";
+const std::string ConnectionManager::SESSION_ID = "00";
+const std::string ConnectionManager::BUSY = "Server is busy";
+
+bool ConnectionManager::session_mode = true;
+int ConnectionManager::protocol_version = Protocol::VERSION_2;
+
+// Persistent session state, only used from the GUI thread
+static asio::io_context session_context;
+static std::unique_ptr<tcp::socket> session_socket;
+static asio::streambuf session_buffer;
+
+// Read a single response from the session: a line of the text protocol or a frame
+// of the binary one, the latter is decoded to the text format
+static std::string readResponse(int protocol_version, asio::error_code& error, uint32_t& correlation_id)
+{
+    if (protocol_version != Protocol::VERSION_2) {
+        size_t len = asio::read_until(*session_socket, session_buffer, ConnectionManager::END, error);
+        if (error) {
+            return "";
+        }
+
+        auto begin = asio::buffers_begin(session_buffer.data());
+        std::string response(begin, begin + len);
+        session_buffer.consume(len);
+        return response;
+    }
+
+    if (session_buffer.size() < Protocol::LENGTH_SIZE) {
+        asio::read(*session_socket, session_buffer,
+            asio::transfer_at_least(Protocol::LENGTH_SIZE - session_buffer.size()), error);
+        if (error) {
+            return "";
+        }
+    }
+
+    auto begin = asio::buffers_begin(session_buffer.data());
+    std::string prefix(begin, begin + Protocol::LENGTH_SIZE);
+    uint32_t length = Protocol::frameLength(prefix.data());
+    if (length < Protocol::HEADER_SIZE || length > Protocol::MAX_FRAME_SIZE) {
+        throw std::runtime_error("malformed response frame");
+    }
+
+    if (session_buffer.size() < Protocol::LENGTH_SIZE + length) {
+        asio::read(*session_socket, session_buffer,
+            asio::transfer_at_least(Protocol::LENGTH_SIZE + length - session_buffer.size()), error);
+        if (error) {
+            return "";
+        }
+    }
+
+    begin = asio::buffers_begin(session_buffer.data()) + Protocol::LENGTH_SIZE;
+    std::string frame(begin, begin + length);
+    session_buffer.consume(Protocol::LENGTH_SIZE + length);
+    return Protocol::decodeResponse(frame, correlation_id);
+}
 
 std::string ConnectionManager::sendMessage(const std::string& message)
 {
     std::string response = "";
 
  	try {
- 		asio::io_context io_context;
- 
-        std::string host = "127.0.0.1";
-        std::string port = "13";
- 		tcp::resolver resolver(io_context);
- 		tcp::resolver::results_type endpoints = resolver.resolve(host, port);
-
- 		tcp::socket socket(io_context);
- 		asio::connect(socket, endpoints);
-
-        socket.write_some(asio::buffer(message.data(), message.length()));
-
- 		for (;;) {
- 			char buf[128];
- 			asio::error_code error;
- 		 	size_t len = socket.read_some(asio::buffer(buf), error);
- 	
- 		 	if (error == asio::error::eof)
- 		 		break;
- 		 	else if (error)
- 		 		throw asio::system_error(error);
- 	
- 		 	// std::cout.write(buf, len);
-            response.append(buf, len);
- 		}
+        if (session_mode) {
+            response = sendSessionMessage(message);
+        }
+        else {
+            response = sendLegacyMessage(message);
+        }
  	}
  	catch (std::exception& e)
  	{
+        closeSession();
         response = REJECTED;
         response += "an error occurred during issuing a request (";
         response += e.what();
@@ -50,6 +92,7 @@ std::string ConnectionManager::sendMessage(const std::string& message)
  		// std::cout << e.what() << std::endl;
  	}
     catch (...) {
+        closeSession();
         response = REJECTED;
         response += "an unknown error occurred during issuing a request";
     }
@@ -57,6 +100,255 @@ std::string ConnectionManager::sendMessage(const std::string& message)
     return response;
 }
 
+std::string ConnectionManager::sendSessionMessage(const std::string& message)
+{
+    for (;;) {
+        bool fresh = openSession();
+
+        // Server doesn't support persistent sessions
+        if (!session_mode) {
+            return sendLegacyMessage(message);
+        }
+
+        std::string request = message;
+        if (protocol_version == Protocol::VERSION_2) {
+            request = Protocol::encodeRequest(message, 0);
+        }
+
+        asio::error_code error;
+        asio::write(*session_socket, asio::buffer(request.data(), request.length()), error);
+
+        std::string response = "";
+        if (!error) {
+            uint32_t correlation_id = 0;
+            response = readResponse(protocol_version, error, correlation_id);
+        }
+
+        if (!error) {
+            return response;
+        }
+
+        closeSession();
+
+        // A reused session might have been closed by server before the request was read
+        if (fresh || (error != asio::error::eof && error != asio::error::connection_reset)) {
+            throw asio::system_error(error);
+        }
+    }
+}
+
+std::vector<std::string> ConnectionManager::sendMessages(const std::vector<std::string>& messages)
+{
+    std::vector<std::string> responses(messages.size());
+
+    try {
+        if (session_mode) {
+            openSession();
+        }
+
+        // Server doesn't support persistent sessions
+        if (!session_mode) {
+            for (size_t i = 0; i < messages.size(); i++) {
+                responses[i] = sendMessage(messages[i]);
+            }
+            return responses;
+        }
+
+        sendPipelinedMessages(messages, responses);
+    }
+    catch (std::exception& e) {
+        closeSession();
+        for (auto&& response : responses) {
+            if (response.empty()) {
+                response = REJECTED;
+                response += "an error occurred during issuing a request (";
+                response += e.what();
+                response += ")";
+            }
+        }
+    }
+
+    return responses;
+}
+
+void ConnectionManager::sendPipelinedMessages(const std::vector<std::string>& messages,
+    std::vector<std::string>& responses)
+{
+    for (;;) {
+        bool fresh = openSession();
+
+        // Server doesn't support persistent sessions
+        if (!session_mode) {
+            for (size_t i = 0; i < messages.size(); i++) {
+                responses[i] = sendLegacyMessage(messages[i]);
+            }
+            return;
+        }
+
+        // The protocol is known only once the session is open
+        std::string batch = "";
+        for (size_t i = 0; i < messages.size(); i++) {
+            if (protocol_version == Protocol::VERSION_2) {
+                batch += Protocol::encodeRequest(messages[i], static_cast<uint32_t>(i));
+            }
+            else {
+                batch += CORRELATION_MARK + std::to_string(i) + SEPARATOR;
+                batch += messages[i];
+            }
+        }
+
+        asio::error_code error;
+        asio::write(*session_socket, asio::buffer(batch.data(), batch.length()), error);
+
+        size_t received = 0;
+        while (!error && received < messages.size()) {
+            uint32_t correlation_id = 0;
+            std::string response = readResponse(protocol_version, error, correlation_id);
+            if (error) {
+                break;
+            }
+
+            // Strip the correlation id of a text response
+            if (protocol_version != Protocol::VERSION_2) {
+                size_t separator = response.find(SEPARATOR);
+                correlation_id = std::stoul(response.substr(1, separator - 1));
+                response = response.substr(separator + 1);
+            }
+
+            // Store the response in the slot of its request
+            responses.at(correlation_id) = response;
+            received++;
+        }
+
+        if (!error) {
+            return;
+        }
+
+        closeSession();
+
+        // A reused session might have been closed by server before the requests were read
+        if (fresh || received > 0 || (error != asio::error::eof && error != asio::error::connection_reset)) {
+            throw asio::system_error(error);
+        }
+    }
+}
+
+std::string ConnectionManager::sendLegacyMessage(const std::string& message)
+{
+    std::string response = "";
+
+ 	asio::io_context io_context;
+
+ 	tcp::resolver resolver(io_context);
+ 	tcp::resolver::results_type endpoints = resolver.resolve(HOST, PORT);
+
+ 	tcp::socket socket(io_context);
+ 	asio::connect(socket, endpoints);
+
+    asio::write(socket, asio::buffer(message.data(), message.length()));
+
+ 	for (;;) {
+ 		char buf[128];
+ 		asio::error_code error;
+ 	 	size_t len = socket.read_some(asio::buffer(buf), error);
+
+ 	 	if (error == asio::error::eof)
+ 	 		break;
+ 	 	else if (error)
+ 	 		throw asio::system_error(error);
+
+ 	 	// std::cout.write(buf, len);
+        response.append(buf, len);
+ 	}
+
+    return response;
+}
+
+bool ConnectionManager::openSession()
+{
+    if (session_socket != nullptr) {
+        return false;
+    }
+
+    tcp::resolver resolver(session_context);
+    tcp::resolver::results_type endpoints = resolver.resolve(HOST, PORT);
+
+    session_socket = std::make_unique<tcp::socket>(session_context);
+    asio::connect(*session_socket, endpoints);
+
+    asio::error_code error;
+    if (protocol_version == Protocol::VERSION_2) {
+        std::string request(1, static_cast<char>(Protocol::VERSION_2));
+        request += END;
+        asio::write(*session_socket, asio::buffer(request));
+
+        // Servers without the binary protocol reject the handshake as a malformed request
+        asio::read(*session_socket, session_buffer, asio::transfer_at_least(1), error);
+        if (!error && static_cast<unsigned char>(*asio::buffers_begin(session_buffer.data())) == Protocol::VERSION_2) {
+            session_buffer.consume(1);
+            return true;
+        }
+
+        // An overloaded server rejects the connection before reading anything
+        if (!error) {
+            size_t len = asio::read_until(*session_socket, session_buffer, END, error);
+            auto begin = asio::buffers_begin(session_buffer.data());
+            checkBusy(std::string(begin, begin + len));
+        }
+
+        closeSession();
+        protocol_version = 1;
+        return openSession();
+    }
+
+    std::string request = SESSION_ID + END;
+    asio::write(*session_socket, asio::buffer(request));
+
+    // Servers without session support reject the request and close the connection
+    size_t len = asio::read_until(*session_socket, session_buffer, END, error);
+    std::string response = "";
+    if (!error) {
+        auto begin = asio::buffers_begin(session_buffer.data());
+        response.assign(begin, begin + len);
+        session_buffer.consume(len);
+    }
+
+    checkBusy(response);
+    if (response.compare(0, ACCEPTED.size(), ACCEPTED) != 0) {
+        closeSession();
+        session_mode = false;
+    }
+
+    return true;
+}
+
+void ConnectionManager::checkBusy(const std::string& response)
+{
+    if (response.compare(0, REJECTED.size() + BUSY.size(), REJECTED + BUSY) == 0) {
+        closeSession();
+        throw std::runtime_error(response.substr(REJECTED.size(), response.find(END) - REJECTED.size()));
+    }
+}
+
+void ConnectionManager::closeSession()
+{
+    if (session_socket != nullptr) {
+        asio::error_code ignored;
+        session_socket->shutdown(tcp::socket::shutdown_both, ignored);
+        session_socket->close(ignored);
+        session_socket.reset();
+    }
+    session_buffer.consume(session_buffer.size());
+}
+
+void ConnectionManager::setSessionMode(bool enabled)
+{
+    if (!enabled) {
+        closeSession();
+    }
+    session_mode = enabled;
+}
+
 void ConnectionManager::fillField(std::string& response, std::string& field, char separator)
 {
 	int i = 0;
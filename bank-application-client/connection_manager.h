@@ -1,10 +1,24 @@
 #include <string>
+#include <vector>
 
 #ifndef CONNECTION_MANAGER_H_
 #define CONNECTION_MANAGER_H_
 
 /**
 * A "static" class responsible for network communication.
+*
+* By default a persistent session is kept open with the server and all requests
+* are exchanged over it. If the server doesn't support sessions, the manager falls
+* back to connecting once per request.
+*
+* Over a session, several requests can be pipelined: each of them is tagged with
+* a correlation id (`#<id>;`) which the server echoes back in the response, so
+* the responses may arrive in any order.
+*
+* The session prefers the binary protocol (v2, see `Protocol`): requests are still
+* created in the text format, encoded to frames when sent and responses are decoded
+* back to the text format, so the rest of the client is not affected. If the server
+* doesn't acknowledge the binary protocol, the text protocol is used.
 */
 class ConnectionManager
 {
@@ -22,6 +36,15 @@ public:
 	 */
 	static std::string sendMessage(const std::string& message);
 
+	/**
+	 * Send several requests at once and read all the responses. Over a persistent
+	 * session the requests are pipelined, so all of them take a single round trip;
+	 * otherwise they are sent one by one.
+	 * @param[in]	messages	Requests to be sent
+	 * @returns					Server responses, in the order of requests
+	 */
+	static std::vector<std::string> sendMessages(const std::vector<std::string>& messages);
+
 	/**
 	 * Take the beginning of response up until a sepator and move it to field.
 	 * @param[in]	response	Server response
@@ -29,6 +52,80 @@ public:
 	 * @param[in]	separator	Substring separator
 	 */
 	static void fillField(std::string& response, std::string& field, char separator);
+
+	/**
+	 * Enable or disable the persistent session. Disabling it closes the session
+	 * (if open) and every following request uses its own connection.
+	 * @param[in]	enabled		Whether the persistent session should be used
+	 */
+	static void setSessionMode(bool enabled);
+
+private:
+	// Server address
+	static const std::string HOST;
+	static const std::string PORT;
+
+	// Request opening a persistent session
+	static const std::string SESSION_ID;
+
+	// Beginning of the reason of a rejection by an overloaded server
+	static const std::string BUSY;
+
+	// Character starting the correlation id of a request
+	static const char CORRELATION_MARK = '#';
+
+	// Whether requests are sent over the persistent session
+	static bool session_mode;
+
+	// Protocol used by the persistent session (1 text, 2 binary)
+	static int protocol_version;
+
+	/**
+	 * Send a request over the persistent session, opening it first if needed.
+	 * A request sent over a session that the server has meanwhile closed is
+	 * resent once over a new one.
+	 * @param[in]	message		Request to be sent
+	 * @returns					Server response (including the terminal character)
+	 */
+	static std::string sendSessionMessage(const std::string& message);
+
+	/**
+	 * Send tagged requests over the persistent session and match the responses
+	 * to them using the correlation ids. Like `sendSessionMessage`, the requests
+	 * are resent once if the server has meanwhile closed the session.
+	 * @param[in]	messages	Requests to be sent
+	 * @param[out]	responses	Server responses, in the order of requests
+	 */
+	static void sendPipelinedMessages(const std::vector<std::string>& messages, 
+		std::vector<std::string>& responses);
+
+	/**
+	 * Connect, send a single request and read the response until the server
+	 * closes the connection.
+	 * @param[in]	message		Request to be sent
+	 * @returns					Server response
+	 */
+	static std::string sendLegacyMessage(const std::string& message);
+
+	/**
+	 * Make sure the persistent session is open, negotiating the binary protocol
+	 * first. If the server refuses it, the text protocol is used, and if the
+	 * server refuses sessions altogether, session mode is turned off.
+	 * @returns		True if a new connection was established
+	 */
+	static bool openSession();
+
+	/**
+	 * Report an overloaded server as an error, so that it is not mistaken for a server
+	 * not supporting the protocol or persistent sessions.
+	 * @param[in]	response	Server response to the session request
+	 */
+	static void checkBusy(const std::string& response);
+
+	/**
+	 * Close the persistent session, errors are ignored.
+	 */
+	static void closeSession();
 };
 
 #endif
@@ -2,8 +2,6 @@
 #include "wx/busyinfo.h"
 #include "connection_manager.h"
 #include "validator.h"
-#include <sstream>
-#include <iomanip>
 
 void AccountInfoDialog::fillResponseFields(std::string& response)
 {
@@ -13,7 +11,7 @@ void AccountInfoDialog::fillResponseFields(std::string& response)
 
 	std::string balance_str = "";
 	ConnectionManager::fillField(response, balance_str, ConnectionManager::SEPARATOR);
-	balance = std::stod(balance_str);
+	balance = Money::parse(balance_str);
 
 	ConnectionManager::fillField(response, status, ConnectionManager::END);
 }
@@ -23,14 +21,14 @@ wxBEGIN_EVENT_TABLE(TransferDialog, wxDialog)
 	EVT_BUTTON(31, onSubmitButtonClicked)
 wxEND_EVENT_TABLE()
 
-TransferDialog::TransferDialog(const std::string& email, const std::string& name, wxWindow* parent, 
-							   wxWindowID id, const wxString& title, const wxPoint& pos, const wxSize& size, 
-							   long style)
+TransferDialog::TransferDialog(const std::string& email, const std::string& name, const std::string& suggestions,
+							   wxWindow* parent, wxWindowID id, const wxString& title, const wxPoint& pos, 
+							   const wxSize& size, long style)
 : wxDialog( parent, id, title, pos, size, style), AccountInfoDialog(), current_email(email), current_name(name),
   suggested_emails(), suggested_names()
 {
 	// Ask server for previously used targets and setup autocomplete
-	setupSuggestions();
+	setupSuggestions(suggestions);
 
 	wxStaticText* email_label = new wxStaticText(this, wxID_ANY, "User email");
 	email_field = new wxTextCtrl( this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0L, 
@@ -73,7 +71,7 @@ TransferDialog::TransferDialog(const std::string& email, const std::string& name
 
 void TransferDialog::onSubmitButtonClicked(wxCommandEvent& evt)
 {
-	if (!Validator::checkProperDouble(amount_field->GetValue().ToStdString())) {
+	if (!Validator::checkProperAmount(amount_field->GetValue().ToStdString())) {
 		std::string message = "'Amount' isn't a valid nonnegative numeric value";
 		wxMessageDialog* dlg = new wxMessageDialog(this, message, "Error", wxICON_ERROR | wxOK);
 		dlg->ShowModal();
@@ -122,12 +120,17 @@ void TransferDialog::transfer(const std::string& id)
 	}
 }
 
-void TransferDialog::setupSuggestions()
+void TransferDialog::setupSuggestions(const std::string& suggestions)
 {
 	std::string response;
 	std::string message_status;
 
-	{
+	if (!suggestions.empty()) {
+		response = suggestions;
+		message_status = response.substr(0, 3);
+		response = response.erase(0, 3);
+	}
+	else {
 		wxWindowDisabler disable_all;
 		wxBusyInfo wait("Retrieving previously used accounts...");
 
@@ -235,7 +238,7 @@ RecurringPaymentDialog::RecurringPaymentDialog(const std::string& email, const s
 
 void RecurringPaymentDialog::onSubmitButtonClicked(wxCommandEvent& evt)
 {
-	if (!Validator::checkProperDouble(amount_field->GetValue().ToStdString())) {
+	if (!Validator::checkProperAmount(amount_field->GetValue().ToStdString())) {
 		std::string message = "'Amount' isn't a valid nonnegative numeric value";
 		wxMessageDialog* dlg = new wxMessageDialog(this, message, "Error", wxICON_ERROR | wxOK);
 		dlg->ShowModal();
@@ -314,7 +317,7 @@ AddMoneyDialog::AddMoneyDialog(const std::string& email, const std::string& name
 
 void AddMoneyDialog::onSubmitButtonClicked(wxCommandEvent& evt)
 {
-	if (!Validator::checkProperDouble(amount_field->GetValue().ToStdString())) {
+	if (!Validator::checkProperAmount(amount_field->GetValue().ToStdString())) {
 		std::string message = "'Amount' isn't a valid nonnegative numeric value";
 		wxMessageDialog* dlg = new wxMessageDialog(this, message, "Error", wxICON_ERROR | wxOK);
 		dlg->ShowModal();
@@ -458,7 +461,7 @@ void AccountListDialog::fillResponseFields(std::string& response)
 			ConnectionManager::fillField(response, state, ConnectionManager::SEPARATOR);
 		}
 
-		double amount = std::stod(amount_str);
+		Money amount = Money::parse(amount_str);
 		account a{name, amount, state};
 
 		accounts.push_back(a);
@@ -529,6 +532,7 @@ void AddAccountDialog::onSubmitButtonClicked(wxCommandEvent& evt)
 // Map buttons to handlers
 wxBEGIN_EVENT_TABLE(TransactionHistoryDialog, wxDialog)
 	EVT_BUTTON(91, onSubmitButtonClicked)
+	EVT_BUTTON(92, onMoreButtonClicked)
 wxEND_EVENT_TABLE()
 
 TransactionHistoryDialog::TransactionHistoryDialog(const std::string& email, const std::string& name,
@@ -549,6 +553,19 @@ TransactionHistoryDialog::TransactionHistoryDialog(const std::string& email, con
 }
 
 void TransactionHistoryDialog::onSubmitButtonClicked(wxCommandEvent& evt)
+{
+	cursor = "";
+	transactions->fillTransactions(std::vector<transaction>());
+	requestPage();
+	requestBalance();
+}
+
+void TransactionHistoryDialog::onMoreButtonClicked(wxCommandEvent& evt)
+{
+	requestPage();
+}
+
+void TransactionHistoryDialog::requestPage()
 {
 	std::string response;
 	std::string message_status;
@@ -561,7 +578,9 @@ void TransactionHistoryDialog::onSubmitButtonClicked(wxCommandEvent& evt)
 		message += current_email + ConnectionManager::SEPARATOR;
 		message += current_name + ConnectionManager::SEPARATOR;
 		message += since_datepicker->GetValue().FormatISODate() + ConnectionManager::SEPARATOR;
-		message += until_datepicker->GetValue().FormatISODate() + ConnectionManager::END;
+		message += until_datepicker->GetValue().FormatISODate() + ConnectionManager::SEPARATOR;
+		message += std::to_string(PAGE_SIZE) + ConnectionManager::SEPARATOR;
+		message += cursor + ConnectionManager::END;
 
 		response = ConnectionManager::sendMessage(message);
 		message_status = response.substr(0, 3);
@@ -569,14 +588,56 @@ void TransactionHistoryDialog::onSubmitButtonClicked(wxCommandEvent& evt)
 	}
 
 	if (message_status == ConnectionManager::ACCEPTED) {
+		ConnectionManager::fillField(response, cursor, ConnectionManager::SEPARATOR);
 		std::vector<transaction> ts = extractAccounts(response);
-		transactions->fillTransactions(ts);
+		transactions->appendTransactions(ts);
 	}
 	else {
+		cursor = "";
 		std::string message = "An error occurred during retrieval of transaction history:\n" + response;
 		wxMessageDialog* dlg = new wxMessageDialog(this, message, "Error", wxICON_ERROR | wxOK);
 		dlg->ShowModal();
 	}
+
+	more_button->Enable(!cursor.empty());
+}
+
+void TransactionHistoryDialog::requestBalance()
+{
+	std::string response;
+	std::string message_status;
+
+	{
+		wxWindowDisabler disable_all;
+		wxBusyInfo wait("Retrieving balance from server...");
+
+		std::string message = BALANCE_ID;
+		message += current_email + ConnectionManager::SEPARATOR;
+		message += current_name + ConnectionManager::SEPARATOR;
+		message += until_datepicker->GetValue().FormatISODate() + ConnectionManager::END;
+
+		response = ConnectionManager::sendMessage(message);
+		message_status = response.substr(0, 3);
+		response = response.erase(0, 3);
+	}
+
+	// Email, account name and date come back before the balance
+	if (message_status == ConnectionManager::ACCEPTED) {
+		std::string email = "";
+		std::string name = "";
+		std::string date = "";
+		std::string balance_str = "";
+
+		ConnectionManager::fillField(response, email, ConnectionManager::SEPARATOR);
+		ConnectionManager::fillField(response, name, ConnectionManager::SEPARATOR);
+		ConnectionManager::fillField(response, date, ConnectionManager::SEPARATOR);
+		ConnectionManager::fillField(response, balance_str, ConnectionManager::END);
+
+		balance_text->SetLabel("Balance on " + date + ": " + Money::parse(balance_str).str());
+	}
+	else {
+		balance_text->SetLabel("");
+	}
 }
 
 wxPanel* TransactionHistoryDialog::rightPanelSetup()
@@ -638,7 +699,7 @@ std::vector<transaction> TransactionHistoryDialog::extractAccounts(std::string&
 			ConnectionManager::fillField(response, date, ConnectionManager::SEPARATOR);
 		}
 
-		double amount = std::stod(amount_str);
+		Money amount = Money::parse(amount_str);
 		transaction t{date, email_from, email_to, name_from, name_to, amount};
 		ts.push_back(t);
 	}
@@ -655,6 +716,9 @@ wxPanel* TransactionHistoryDialog::leftPanelSetup()
 	wxStaticText* until_label = new wxStaticText(left_panel, wxID_ANY, "Until");
 	until_datepicker = new wxDatePickerCtrl(left_panel, wxID_ANY);
 	submit_button = new wxButton(left_panel, 91, "Send");
+	more_button = new wxButton(left_panel, 92, "More");
+	more_button->Disable();
+	balance_text = new wxStaticText(left_panel, wxID_ANY, "");
 
 	wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
 
@@ -663,6 +727,8 @@ wxPanel* TransactionHistoryDialog::leftPanelSetup()
 	sizer->Add(until_label, 0, wxALL, 5);
 	sizer->Add(until_datepicker, 0, wxALL, 5);
 	sizer->Add(submit_button, 0, wxALL, 5);
+	sizer->Add(more_button, 0, wxALL, 5);
+	sizer->Add(balance_text, 0, wxALL, 5);
 
 	left_panel->SetSizer(sizer);
 
@@ -679,7 +745,11 @@ TransactionsPane::TransactionsPane(wxWindow* parent, wxWindowID id) : wxScrolled
 void TransactionsPane::fillTransactions(const std::vector<transaction>& transactions)
 {
 	sizer->Clear(true);
+	appendTransactions(transactions);
+}
 
+void TransactionsPane::appendTransactions(const std::vector<transaction>& transactions)
+{
 	for (auto&& t : transactions) {
 		wxPanel* panel = createTransactionPanel(t);
 		sizer->Add(panel, 0, wxEXPAND | wxALL, 3);
@@ -696,9 +766,7 @@ wxPanel* TransactionsPane::createTransactionPanel(transaction t)
 	std::string from = t.email_from + ":" + t.name_from;
 	std::string to = t.email_to + ":" + t.name_to;
 
-	std::stringstream stream;
-	stream << std::fixed << std::setprecision(2) << t.amount;
-	std::string amount = stream.str();
+	std::string amount = t.amount.str();
 
 	wxTextCtrl* date_ctrl = new wxTextCtrl(panel, wxID_ANY, t.date, wxDefaultPosition, wxDefaultSize,
 		wxTE_READONLY);
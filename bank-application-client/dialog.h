@@ -16,11 +16,11 @@ public:
 	/**
 	 * Trivial constructor.
 	 */
-	AccountInfoDialog() : name(""), balance(0), status("") {};
+	AccountInfoDialog() : name(""), balance(), status("") {};
 
 	// Data members
 	std::string name;
-	double balance;
+	Money balance;
 	std::string status;
 
 protected:
@@ -158,17 +158,19 @@ class TransferDialog : public wxDialog, public AccountInfoDialog
 public:
 	/**
 	 * Constructor sets up the dialog window.
-	 * @param[in]	email	Transfer source email
-	 * @param[in]	account	Transfer source account name
-	 * @param[in]	parent	Parent window
-	 * @param[in]	id		Window id
-	 * @param[in]	title	Window title
-	 * @param[in]	pos		Window position
-	 * @param[in]	size	Window size
-	 * @param[in]	style	Window style
+	 * @param[in]	email		Transfer source email
+	 * @param[in]	account		Transfer source account name
+	 * @param[in]	suggestions	Prefetched server response with previously used targets
+	 *							(if empty, the dialog requests them itself)
+	 * @param[in]	parent		Parent window
+	 * @param[in]	id			Window id
+	 * @param[in]	title		Window title
+	 * @param[in]	pos			Window position
+	 * @param[in]	size		Window size
+	 * @param[in]	style		Window style
 	 */
-	TransferDialog(const std::string& email, const std::string& name, wxWindow* parent, 
-				   wxWindowID id, const wxString& title,
+	TransferDialog(const std::string& email, const std::string& name, const std::string& suggestions,
+				   wxWindow* parent, wxWindowID id, const wxString& title,
 				   const wxPoint& pos = wxDefaultPosition,
 				   const wxSize& size = wxDefaultSize,
 				   long style = wxDEFAULT_DIALOG_STYLE);
@@ -209,10 +211,11 @@ private:
 	void transfer(const std::string& id);
 
 	/**
-	 * Request previously used targets from server. On success, call
-	 * fillSuggestions method.
+	 * Request previously used targets from server (unless they were prefetched).
+	 * On success, call fillSuggestions method.
+	 * @param[in]	suggestions		Prefetched server response, may be empty
 	 */
-	void setupSuggestions();
+	void setupSuggestions(const std::string& suggestions);
 
 	/**
 	 * Fill members suggested_emails and suggested_names, that are then used
@@ -352,24 +355,51 @@ public:
 	wxDatePickerCtrl* since_datepicker = nullptr;
 	wxDatePickerCtrl* until_datepicker = nullptr;
 	wxButton* submit_button = nullptr;
+	wxButton* more_button = nullptr;
+	wxStaticText* balance_text = nullptr;
 	TransactionsPane* transactions = nullptr;
 	
 	/**
-	 * Send request to server, process response, show the data
+	 * Send request to server, process response, show the first page of data
 	 * @param[in]	evt	Event
 	 */
 	void onSubmitButtonClicked(wxCommandEvent& evt);
 
+	/**
+	 * Request the next page of data and append it to the shown one
+	 * @param[in]	evt	Event
+	 */
+	void onMoreButtonClicked(wxCommandEvent& evt);
+
 	DECLARE_EVENT_TABLE()
 
 private:
 	// Command ID
-	const std::string ACTION_ID = "09";
+	const std::string ACTION_ID = "14";
+
+	// Command ID of the balance at the end of a day
+	const std::string BALANCE_ID = "15";
+
+	// Number of transactions requested at once
+	const int PAGE_SIZE = 100;
 
 	// Current user email and account name
 	std::string current_email;
 	std::string current_name;
 
+	// Position of the next page (empty if there is none)
+	std::string cursor;
+
+	/**
+	 * Request a page of data starting at the cursor and append it to the shown one.
+	 */
+	void requestPage();
+
+	/**
+	 * Request the balance of the account at the end of the last day of the period and show it.
+	 */
+	void requestBalance();
+
 	/**
 	 * Create the left panel of the window, fill with controls, setup
 	 * handlers. 
@@ -412,6 +442,12 @@ public:
 	 */
 	void fillTransactions(const std::vector<transaction>& transactions);
 
+	/**
+	 * Create a row for each transaction below the ones already displayed.
+	 * @param[in]	transaction		The transactions
+	 */
+	void appendTransactions(const std::vector<transaction>& transactions);
+
 private:
 	// sizer responsible for structure of individual accounts in panel
 	wxBoxSizer* sizer = nullptr;
@@ -1,6 +1,4 @@
 #include "main_frame.h"
-#include <iomanip>
-#include <sstream>
 #include "wx/busyinfo.h"
 #include "account_frame.h"
 
@@ -134,7 +132,7 @@ void MainFrame::updateData()
 				ConnectionManager::fillField(response, state, ConnectionManager::SEPARATOR);
 			}
 
-			double amount = std::stod(amount_str);
+			Money amount = Money::parse(amount_str);
 			account a{name, amount, state};
 
 			accounts.push_back(a);
@@ -169,7 +167,7 @@ void AccountsPane::updateAccounts(MainFrame* main_frame)
 	this->FitInside();
 }
 
-wxPanel* AccountsPane::createAccountPanel(const std::string& name, double amount, const std::string& state,
+wxPanel* AccountsPane::createAccountPanel(const std::string& name, Money amount, const std::string& state,
 	MainFrame* main_frame)
 {
 	wxPanel* panel = new wxPanel(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxSIMPLE_BORDER);
@@ -200,11 +198,7 @@ void AccountsPane::addAccountPanelRow(wxPanel* parent, wxBoxSizer* parent_sizer,
 	parent_sizer->Add(row, 0, wxALL, 5);
 }
 
-std::string AccountsPane::format_amount(double amount)
+std::string AccountsPane::format_amount(Money amount)
 {
-	std::stringstream stream;
-	stream << std::fixed << std::setprecision(2) << amount;
-	std::string result = stream.str();
-
-	return result;
+	return amount.str();
 }
@@ -46,7 +46,7 @@ private:
 	 * @param[in]	main_frame	MainFrame with the action handler
 	 * @returns					Account panel
 	 */
-	wxPanel* createAccountPanel(const std::string& name, double amount, const std::string& state, MainFrame* main_frame);
+	wxPanel* createAccountPanel(const std::string& name, Money amount, const std::string& state, MainFrame* main_frame);
 
 	/**
 	 * Create a single row in the account box. A row consists of description of
@@ -59,11 +59,11 @@ private:
 	void addAccountPanelRow(wxPanel* parent, wxBoxSizer* parent_sizer, const std::string& name, const std::string& value);
 
 	/**
-	 * String representation of double with two decimals.
-	 * @param[in]	amount		The number to be formatted
+	 * String representation of an amount with two decimals.
+	 * @param[in]	amount		The amount to be formatted
 	 * @returns					Formated number
 	 */
-	std::string format_amount(double amount);
+	std::string format_amount(Money amount);
 };
 
 /**
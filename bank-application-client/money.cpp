@@ -0,0 +1,104 @@
+#include "money.h"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+
+Money Money::parse(std::string_view text)
+{
+	std::size_t i = 0;
+	bool negative = (i < text.size()) && (text[i] == '-');
+	if (negative) {
+		i++;
+	}
+
+	// Magnitude in hundredths; a negative amount may go one further than a positive one
+	unsigned long long limit = static_cast<unsigned long long>(std::numeric_limits<long long>::max()) +
+		(negative ? 1 : 0);
+	unsigned long long cents = 0;
+	bool digits = false;
+
+	for (; (i < text.size()) && (text[i] >= '0') && (text[i] <= '9'); i++) {
+		unsigned digit = text[i] - '0';
+		if (cents > (limit - digit * SCALE) / 10) {
+			throw std::overflow_error("amount out of range " + std::string(text));
+		}
+		cents = cents * 10 + digit * SCALE;
+		digits = true;
+	}
+
+	if ((i < text.size()) && (text[i] == '.')) {
+		i++;
+		for (unsigned long long unit = SCALE / 10; (i < text.size()) && (text[i] >= '0') && (text[i] <= '9'); i++) {
+			unsigned digit = text[i] - '0';
+			if (unit == 0) {
+				if (digit != 0) {
+					throw std::invalid_argument("amount finer than hundredths " + std::string(text));
+				}
+			}
+			else {
+				if (cents > limit - digit * unit) {
+					throw std::overflow_error("amount out of range " + std::string(text));
+				}
+				cents += digit * unit;
+				unit /= 10;
+			}
+			digits = true;
+		}
+	}
+
+	if (!digits || (i != text.size())) {
+		throw std::invalid_argument("malformed amount " + std::string(text));
+	}
+
+	// Negated in unsigned arithmetic, the smallest amount has no positive counterpart
+	return Money(static_cast<long long>(negative ? 0 - cents : cents));
+}
+
+char* Money::format(char* first, int decimals) const
+{
+	if (decimals < DECIMALS) {
+		decimals = DECIMALS;
+	}
+	else if (decimals > MAX_DECIMALS) {
+		decimals = MAX_DECIMALS;
+	}
+
+	unsigned long long magnitude = static_cast<unsigned long long>(cents_);
+	if (cents_ < 0) {
+		*first++ = '-';
+		magnitude = 0 - magnitude;
+	}
+
+	first = std::to_chars(first, first + 19 + 1, magnitude / SCALE).ptr;
+	*first++ = '.';
+
+	unsigned fraction = static_cast<unsigned>(magnitude % SCALE);
+	*first++ = static_cast<char>('0' + fraction / 10);
+	*first++ = static_cast<char>('0' + fraction % 10);
+	return std::fill_n(first, decimals - DECIMALS, '0');
+}
+
+std::string Money::str(int decimals) const
+{
+	char buffer[FORMAT_CAPACITY];
+	return std::string(buffer, format(buffer, decimals));
+}
+
+Money Money::operator+(Money other) const
+{
+	if ((other.cents_ > 0) ? (cents_ > std::numeric_limits<long long>::max() - other.cents_)
+		: (cents_ < std::numeric_limits<long long>::min() - other.cents_)) {
+		throw std::overflow_error("amount out of range");
+	}
+	return Money(cents_ + other.cents_);
+}
+
+Money Money::operator-(Money other) const
+{
+	if ((other.cents_ < 0) ? (cents_ > std::numeric_limits<long long>::max() + other.cents_)
+		: (cents_ < std::numeric_limits<long long>::min() + other.cents_)) {
+		throw std::overflow_error("amount out of range");
+	}
+	return Money(cents_ - other.cents_);
+}
@@ -0,0 +1,199 @@
+#include "protocol.h"
+#include "connection_manager.h"
+#include <cstdio>
+#include <stdexcept>
+
+std::string Protocol::encodeRequest(const std::string& message, std::uint32_t correlation_id)
+{
+	int opcode = std::stoi(message.substr(0, 2));
+	std::string schema = requestSchema(opcode);
+
+	std::string frame = "";
+	putNumber(frame, 0, LENGTH_SIZE);
+	putNumber(frame, opcode, 1);
+	putNumber(frame, correlation_id, 4);
+	putNumber(frame, 0, 1);
+
+	// Fields are separated by SEPARATOR, the last one is terminated by END
+	std::size_t begin = 2;
+	std::size_t i = 0;
+	bool more = (begin < message.size()) && (message[begin] != ConnectionManager::END);
+	while (more) {
+		std::size_t end = message.find_first_of({ ConnectionManager::SEPARATOR, ConnectionManager::END }, begin);
+		if (end == std::string::npos) {
+			end = message.size();
+		}
+		std::string field = message.substr(begin, end - begin);
+
+		char type = (i < schema.size()) ? schema[i] : 'S';
+		switch (type) {
+		case 'A':
+			putNumber(frame, AMOUNT, 1);
+			putNumber(frame, static_cast<std::uint64_t>(Money::parse(field).cents()), 8);
+			break;
+		case 'D':
+			putNumber(frame, DATE, 1);
+			putNumber(frame, daysFromDate(field), 4);
+			break;
+		case 'I':
+			putNumber(frame, INTEGER, 1);
+			putNumber(frame, std::stoul(field), 4);
+			break;
+		default:
+			if (field.size() > MAX_TEXT_SIZE) {
+				throw std::invalid_argument("text field too long");
+			}
+			putNumber(frame, TEXT, 1);
+			putNumber(frame, field.size(), 2);
+			frame += field;
+		}
+
+		more = (end < message.size()) && (message[end] == ConnectionManager::SEPARATOR);
+		begin = end + 1;
+		i++;
+	}
+
+	std::string length = "";
+	putNumber(length, frame.size() - LENGTH_SIZE, LENGTH_SIZE);
+	frame.replace(0, LENGTH_SIZE, length);
+	return frame;
+}
+
+std::string Protocol::decodeResponse(const std::string& frame, std::uint32_t& correlation_id)
+{
+	if (frame.size() < HEADER_SIZE) {
+		throw std::runtime_error("response frame too short");
+	}
+
+	const char* data = frame.data();
+	correlation_id = static_cast<std::uint32_t>(getNumber(data + 1, 4));
+
+	std::string response = "";
+	response += (getNumber(data + 5, 1) == STATUS_ACCEPTED) ? ConnectionManager::ACCEPTED : ConnectionManager::REJECTED;
+
+	// Same layout as the text protocol: the list count is always followed by a separator
+	bool separate = false;
+	std::size_t i = HEADER_SIZE;
+	while (i < frame.size()) {
+		std::uint8_t type = static_cast<std::uint8_t>(getNumber(data + i, 1));
+		i += 1;
+
+		std::size_t size = (type == TEXT) ? 2 : (type == AMOUNT) ? 8 : 4;
+		if (i + size > frame.size()) {
+			throw std::runtime_error("truncated response field");
+		}
+
+		if (separate) {
+			response += ConnectionManager::SEPARATOR;
+		}
+		separate = true;
+
+		switch (type) {
+		case TEXT: {
+			std::size_t length = static_cast<std::size_t>(getNumber(data + i, size));
+			if (i + size + length > frame.size()) {
+				throw std::runtime_error("truncated response field");
+			}
+			response.append(data + i + size, length);
+			i += length;
+			break;
+		}
+		case AMOUNT:
+			response += Money(static_cast<std::int64_t>(getNumber(data + i, size))).str(AMOUNT_DECIMALS);
+			break;
+		case DATE:
+			response += dateFromDays(static_cast<std::uint32_t>(getNumber(data + i, size)));
+			break;
+		case INTEGER:
+			response += std::to_string(getNumber(data + i, size));
+			response += ConnectionManager::SEPARATOR;
+			separate = false;
+			break;
+		default:
+			throw std::runtime_error("unknown response field type");
+		}
+		i += size;
+	}
+
+	response += ConnectionManager::END;
+	return response;
+}
+
+std::uint32_t Protocol::frameLength(const char* data)
+{
+	return static_cast<std::uint32_t>(getNumber(data, LENGTH_SIZE));
+}
+
+std::string Protocol::requestSchema(int opcode)
+{
+	switch (opcode) {
+	case 3:
+	case 4:
+		return "SSSSA";
+	case 5:
+	case 6:
+		return "SSSSADI";
+	case 7:
+		return "SSA";
+	case 9:
+		return "SSDD";
+	case 14:
+		return "SSDDIS";
+	case 15:
+		return "SSD";
+	default:
+		return "";
+	}
+}
+
+std::uint32_t Protocol::daysFromDate(const std::string& date)
+{
+	int y = 0;
+	unsigned int m = 0;
+	unsigned int d = 0;
+	if (std::sscanf(date.c_str(), "%d-%u-%u", &y, &m, &d) != 3) {
+		throw std::invalid_argument("malformed date " + date);
+	}
+
+	// Days from civil date, the year starts in March so that the leap day is the last one
+	y -= (m <= 2);
+	const int era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned int yoe = static_cast<unsigned int>(y - era * 400);
+	const unsigned int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return static_cast<std::uint32_t>(era * 146097 + static_cast<int>(doe) - 719468);
+}
+
+std::string Protocol::dateFromDays(std::uint32_t days)
+{
+	// Civil date from days, inverse of `daysFromDate`
+	const int z = static_cast<int>(days) + 719468;
+	const int era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned int doe = static_cast<unsigned int>(z - era * 146097);
+	const unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned int mp = (5 * doy + 2) / 153;
+	const unsigned int d = doy - (153 * mp + 2) / 5 + 1;
+	const unsigned int m = mp < 10 ? mp + 3 : mp - 9;
+	const int y = static_cast<int>(yoe) + era * 400 + (m <= 2);
+
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u", y, m, d);
+	return std::string(buffer);
+}
+
+void Protocol::putNumber(std::string& out, std::uint64_t value, std::size_t size)
+{
+	for (std::size_t i = size; i > 0; i--) {
+		out += static_cast<char>((value >> (8 * (i - 1))) & 0xFF);
+	}
+}
+
+std::uint64_t Protocol::getNumber(const char* data, std::size_t size)
+{
+	std::uint64_t value = 0;
+	for (std::size_t i = 0; i < size; i++) {
+		value = (value << 8) | static_cast<unsigned char>(data[i]);
+	}
+	return value;
+}
@@ -0,0 +1,114 @@
+#include <cstdint>
+#include <string>
+#include "money.h"
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+/**
+ * A "static" class translating between the text requests and responses the GUI works with and
+ * the frames of the binary protocol (v2), so the dialogs don't need to know which protocol is in use.
+ *
+ * A frame consists of:
+ *
+ *   u32 length of the rest of the frame
+ *   u8  opcode, u32 correlation id, u8 status (requests always 0)
+ *   fields, each starting with u8 type:
+ *     text (1)		u16 length + bytes
+ *     amount (2)	i64 hundredths
+ *     date (3)		u32 days since 1970-01-01
+ *     integer (4)	u32
+ *
+ * All the numbers are in network byte order.
+ */
+class Protocol
+{
+public:
+	// Handshake byte selecting the binary protocol
+	static const unsigned char VERSION_2 = 2;
+
+	// Sizes of the frame parts
+	static const std::size_t LENGTH_SIZE = 4;
+	static const std::size_t HEADER_SIZE = 6;
+
+	// Frames longer than this are considered malformed
+	static const std::uint32_t MAX_FRAME_SIZE = 1 << 20;
+
+	// Longest text field, its length is written in two bytes
+	static const std::size_t MAX_TEXT_SIZE = 0xFFFF;
+
+	/**
+	 * Encode a text request as a frame.
+	 * @param[in]	message			Request in the text format (including the terminal character)
+	 * @param[in]	correlation_id	Id echoed back in the response
+	 * @returns						The frame including the length prefix
+	 */
+	static std::string encodeRequest(const std::string& message, std::uint32_t correlation_id);
+
+	/**
+	 * Decode a response frame into the text format.
+	 * @param[in]	frame			The frame without the length prefix
+	 * @param[out]	correlation_id	Id of the request the response belongs to
+	 * @returns						Response in the text format (including the terminal character)
+	 */
+	static std::string decodeResponse(const std::string& frame, std::uint32_t& correlation_id);
+
+	/**
+	 * Read the length prefix of a frame.
+	 * @param[in]	data	At least LENGTH_SIZE bytes
+	 * @returns				Length of the rest of the frame
+	 */
+	static std::uint32_t frameLength(const char* data);
+
+private:
+	// Field types
+	static const std::uint8_t TEXT = 1;
+	static const std::uint8_t AMOUNT = 2;
+	static const std::uint8_t DATE = 3;
+	static const std::uint8_t INTEGER = 4;
+
+	// Decimal places of an amount in the text protocol
+	static const int AMOUNT_DECIMALS = 6;
+
+	// Response status
+	static const std::uint8_t STATUS_ACCEPTED = 0;
+
+	/**
+	 * Types of the request fields ('S' text, 'A' amount, 'D' date, 'I' integer).
+	 * @param[in]	opcode	Request opcode
+	 * @returns				One character per field, missing ones are sent as text
+	 */
+	static std::string requestSchema(int opcode);
+
+	/**
+	 * Convert a date to the number of days since 1970-01-01.
+	 * @param[in]	date	String representation of the date (YYYY-MM-DD)
+	 * @returns				Number of days
+	 */
+	static std::uint32_t daysFromDate(const std::string& date);
+
+	/**
+	 * Convert a number of days since 1970-01-01 to a date.
+	 * @param[in]	days	Number of days
+	 * @returns				String representation of the date (YYYY-MM-DD)
+	 */
+	static std::string dateFromDays(std::uint32_t days);
+
+	/**
+	 * Append a number in network byte order.
+	 * @param[out]	out		Output buffer
+	 * @param[in]	value	The number
+	 * @param[in]	size	Number of bytes to write
+	 */
+	static void putNumber(std::string& out, std::uint64_t value, std::size_t size);
+
+	/**
+	 * Read a number in network byte order.
+	 * @param[in]	data	Input buffer
+	 * @param[in]	size	Number of bytes to read
+	 * @returns				The number
+	 */
+	static std::uint64_t getNumber(const char* data, std::size_t size);
+};
+
+#endif
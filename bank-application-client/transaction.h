@@ -1,4 +1,5 @@
 #include <string>
+#include "money.h"
 
 #ifndef TRANSACTION_H_
 #define TRANSACTION_H_
@@ -12,7 +13,7 @@ struct transaction {
 	std::string email_to;
 	std::string name_from;
 	std::string name_to;
-	double amount;
+	Money amount;
 };
 
 #endif
@@ -1,4 +1,5 @@
 #include "validator.h"
+#include "money.h"
 
 wxString Validator::alnumString()
 {
@@ -42,23 +43,23 @@ wxTextValidator Validator::accountName()
     return validator_name;
 }
 
-bool Validator::checkProperDouble(const std::string& str)
+bool Validator::checkProperAmount(const std::string& str)
 {
-	// The stod check should be redundant, but we do it nonetheless
-	bool proper_double = true;
-	double amount = 0;
+	// The server parses amounts the same way, so whatever passes here is accepted there
+	bool proper_amount = true;
+	Money amount{};
 	try {
-		amount = std::stod(str);
+		amount = Money::parse(str);
 	}
 	catch (std::exception&) {
-		proper_double = false;
+		proper_amount = false;
 	}
 
-	if (proper_double) {
-		if (amount < 0) {
-			proper_double = false;
+	if (proper_amount) {
+		if (amount < Money()) {
+			proper_amount = false;
 		}
 	}
 
-	return proper_double;
+	return proper_amount;
 }
@@ -34,11 +34,11 @@ public:
 	static wxTextValidator accountName();
 
 	/**
-	 * Check validity and non-negativity of string representations of double value.
-	 * @param[in]	str		String representation of double
-	 * @returns				True if str represents correct double
+	 * Check validity and non-negativity of string representations of an amount of money.
+	 * @param[in]	str		String representation of the amount
+	 * @returns				True if str represents correct amount (at most hundredths)
 	 */
-	static bool checkProperDouble(const std::string& str);
+	static bool checkProperAmount(const std::string& str);
 };
 
 #endif
@@ -0,0 +1,138 @@
+#include "account_cache.h"
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+void AccountCache::warm(Database& database)
+{
+	std::vector<User> users;
+	database.gatherUsers(&users);
+
+	for (auto&& user : users) {
+		addUser(user);
+	}
+}
+
+bool AccountCache::findUser(std::string_view email, User& user) const
+{
+	const Shard& s = shard(email);
+	std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+	auto found = s.users.find(email);
+	if (found == s.users.end()) {
+		return false;
+	}
+
+	const CachedUser& cached = *found->second;
+	std::vector<Account> accounts;
+	accounts.reserve(cached.accounts.size());
+	for (auto&& account : cached.accounts) {
+		accounts.push_back(*account);
+	}
+	user = User(cached.email, cached.password, accounts);
+	return true;
+}
+
+bool AccountCache::findAccount(std::string_view email, std::string_view name, const Changes& changes,
+	Account& account) const
+{
+	const Shard& s = shard(email);
+	std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+	auto found = s.accounts.find(Key(email, name));
+	if (found == s.accounts.end()) {
+		return false;
+	}
+
+	// The operation's own changes take precedence over the committed state
+	auto changed = changes.find(found->second->id_);
+	account = (changed != changes.end()) ? changed->second : *found->second;
+	return true;
+}
+
+long long AccountCache::findAccountId(std::string_view email, std::string_view name) const
+{
+	const Shard& s = shard(email);
+	std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+	auto found = s.accounts.find(Key(email, name));
+	return (found != s.accounts.end()) ? found->second->id_ : Database::DB_NO_ACCOUNT;
+}
+
+void AccountCache::addUser(const User& user)
+{
+	Shard& s = shard(user.mail_);
+	std::unique_lock<std::shared_mutex> lock(s.mutex);
+
+	auto cached = std::make_unique<CachedUser>();
+	cached->email = user.mail_;
+	cached->password = user.password_;
+	CachedUser& entry = *cached;
+	s.users.emplace(entry.email, std::move(cached));
+
+	for (auto&& account : user.accounts_) {
+		insert(s, entry, account);
+	}
+}
+
+void AccountCache::addAccount(const Account& account)
+{
+	Shard& s = shard(account.mail_);
+	std::unique_lock<std::shared_mutex> lock(s.mutex);
+
+	auto found = s.users.find(account.mail_);
+	if (found != s.users.end()) {
+		insert(s, *found->second, account);
+	}
+}
+
+std::vector<Account> AccountCache::apply(const Changes& changes)
+{
+	std::vector<Account> changed_state;
+
+	for (auto&& change : changes) {
+		const Account& account = change.second;
+		Shard& s = shard(account.mail_);
+		std::unique_lock<std::shared_mutex> lock(s.mutex);
+
+		auto found = s.accounts.find(Key(account.mail_, account.name_));
+		if (found != s.accounts.end()) {
+			// Compared with the state committed before, a state changed back and forth by the operation isn't a change
+			if (found->second->state_ != account.state_) {
+				changed_state.push_back(account);
+			}
+			found->second->balance_ = account.balance_;
+			found->second->state_ = account.state_;
+		}
+	}
+
+	return changed_state;
+}
+
+std::size_t AccountCache::KeyHash::operator()(const Key& key) const
+{
+	std::size_t hash = std::hash<std::string_view>{}(key.first);
+	hash ^= std::hash<std::string_view>{}(key.second) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+AccountCache::Shard& AccountCache::shard(std::string_view email)
+{
+	return shards[std::hash<std::string_view>{}(email) % shards.size()];
+}
+
+const AccountCache::Shard& AccountCache::shard(std::string_view email) const
+{
+	return shards[std::hash<std::string_view>{}(email) % shards.size()];
+}
+
+void AccountCache::insert(Shard& shard, CachedUser& user, const Account& account)
+{
+	// Kept in the order the database lists the accounts of a user in
+	auto position = std::lower_bound(user.accounts.begin(), user.accounts.end(), account.name_,
+		[](const std::unique_ptr<Account>& cached, const std::string& name) { return cached->name_ < name; });
+	auto inserted = user.accounts.insert(position, std::make_unique<Account>(account));
+
+	Account& entry = **inserted;
+	shard.accounts.emplace(Key(entry.mail_, entry.name_), &entry);
+}
@@ -0,0 +1,146 @@
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "database.h"
+#include "dto.h"
+
+#ifndef ACCOUNT_CACHE_H_
+#define ACCOUNT_CACHE_H_
+
+/**
+ * Copy of the users and accounts kept in memory, so that requests find an account (its
+ * identifier, balance and state) and check a password without reading the database. It is
+ * loaded once at startup and written through: every change to an account is written to the
+ * database first and to the cache once it's committed.
+ *
+ * Users are hashed by their email to one of a fixed number of shards, each guarded by its own
+ * reader-writer lock; a user and all their accounts fall into the same shard. Within a shard the
+ * accounts are found by owner email and name.
+ *
+ * The balance and state of an account may only be changed while holding its lock in
+ * `AccountLocks`, the cache itself only keeps each entry consistent.
+ */
+class AccountCache
+{
+public:
+	/**
+	 * Accounts written by an operation not yet committed, by their identifier. The operation
+	 * reads its own changes through them, they are applied to the cache once it is committed
+	 * and dropped if it is rolled back.
+	 */
+	using Changes = std::unordered_map<long long, Account>;
+
+	/**
+	 * @param[in]	shard_count		Number of shards the users are spread over
+	 */
+	AccountCache(std::size_t shard_count = DEFAULT_SHARD_COUNT) : shards(shard_count) {};
+
+	/**
+	 * Load all the users and their accounts from the database.
+	 * @param[in]	database	The database
+	 */
+	void warm(Database& database);
+
+	/**
+	 * Find a user together with their accounts (ordered by name).
+	 * @param[in]	email	Email identifying the user
+	 * @param[out]	user	The user, left as it is if there is no such user
+	 * @returns				Whether the user exists
+	 */
+	bool findUser(std::string_view email, User& user) const;
+
+	/**
+	 * Find an account, as changed by an operation in progress.
+	 * @param[in]	email		Email of the account owner
+	 * @param[in]	name		Name of the account
+	 * @param[in]	changes		Changes of the operation not yet committed
+	 * @param[out]	account		The account, left as it is if there is no such account
+	 * @returns					Whether the account exists
+	 */
+	bool findAccount(std::string_view email, std::string_view name, const Changes& changes, Account& account) const;
+
+	/**
+	 * Find the identifier of an account.
+	 * @param[in]	email	Email of the account owner
+	 * @param[in]	name	Name of the account
+	 * @returns				The identifier, Database::DB_NO_ACCOUNT if there is no such account
+	 */
+	long long findAccountId(std::string_view email, std::string_view name) const;
+
+	/**
+	 * Add a user committed to the database, with their accounts.
+	 * @param[in]	user	The user
+	 */
+	void addUser(const User& user);
+
+	/**
+	 * Add an account committed to the database.
+	 * @param[in]	account		The account, with its identifier
+	 */
+	void addAccount(const Account& account);
+
+	/**
+	 * Apply the balances and states of a committed operation.
+	 * @param[in]	changes		Changes of the operation
+	 * @returns					The accounts whose state the operation changed, as changed
+	 */
+	std::vector<Account> apply(const Changes& changes);
+
+	// Number of shards if not specified otherwise
+	static const std::size_t DEFAULT_SHARD_COUNT = 64;
+
+private:
+	// Owner email and name of an account, referring to the strings of the cached account
+	using Key = std::pair<std::string_view, std::string_view>;
+
+	/**
+	 * Hash of the owner email and name of an account.
+	 */
+	struct KeyHash {
+		std::size_t operator()(const Key& key) const;
+	};
+
+	/**
+	 * A user with their accounts, ordered by name.
+	 */
+	struct CachedUser {
+		std::string email;
+		std::string password;
+		std::vector<std::unique_ptr<Account>> accounts;
+	};
+
+	/**
+	 * Users of a shard with their accounts, the keys refer to the strings of the entries.
+	 */
+	struct Shard {
+		mutable std::shared_mutex mutex;
+		std::unordered_map<std::string_view, std::unique_ptr<CachedUser>> users;
+		std::unordered_map<Key, Account*, KeyHash> accounts;
+	};
+
+	// One lock and part of the users per shard
+	std::vector<Shard> shards;
+
+	/**
+	 * Get the shard of a user.
+	 * @param[in]	email	Email of the user
+	 * @returns				The shard
+	 */
+	Shard& shard(std::string_view email);
+	const Shard& shard(std::string_view email) const;
+
+	/**
+	 * Add an account to a shard, the shard must be locked.
+	 * @param[in]	shard		The shard
+	 * @param[in]	user		Owner of the account
+	 * @param[in]	account		The account
+	 */
+	static void insert(Shard& shard, CachedUser& user, const Account& account);
+};
+
+#endif
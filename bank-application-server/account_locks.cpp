@@ -0,0 +1,60 @@
+#include "account_locks.h"
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+AccountLocks::Guard AccountLocks::lock(std::string_view email, std::string_view name)
+{
+	Guard guard{};
+	guard.first = std::unique_lock<std::mutex>(shards[shard(email, name)]);
+	return guard;
+}
+
+AccountLocks::Guard AccountLocks::lock(std::string_view email_first, std::string_view name_first,
+	std::string_view email_second, std::string_view name_second)
+{
+	std::size_t first = shard(email_first, name_first);
+	std::size_t second = shard(email_second, name_second);
+
+	// A shard is locked only once, even if both accounts fall into it
+	if (first == second) {
+		return lock(email_first, name_first);
+	}
+
+	// Always lock the lower shard first
+	if (first > second) {
+		std::swap(first, second);
+	}
+
+	Guard guard{};
+	guard.first = std::unique_lock<std::mutex>(shards[first]);
+	guard.second = std::unique_lock<std::mutex>(shards[second]);
+	return guard;
+}
+
+std::vector<std::unique_lock<std::mutex>> AccountLocks::lock(const std::vector<Account>& accounts)
+{
+	std::vector<std::size_t> indexes;
+	indexes.reserve(accounts.size());
+	for (auto&& account : accounts) {
+		indexes.push_back(shard(account.first, account.second));
+	}
+
+	// Ascending order, each shard once
+	std::sort(indexes.begin(), indexes.end());
+	indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+	std::vector<std::unique_lock<std::mutex>> locks;
+	locks.reserve(indexes.size());
+	for (auto&& index : indexes) {
+		locks.emplace_back(shards[index]);
+	}
+	return locks;
+}
+
+std::size_t AccountLocks::shard(std::string_view email, std::string_view name) const
+{
+	std::size_t hash = std::hash<std::string_view>{}(email);
+	hash ^= std::hash<std::string_view>{}(name) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	return hash % shards.size();
+}
@@ -0,0 +1,85 @@
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef ACCOUNT_LOCKS_H_
+#define ACCOUNT_LOCKS_H_
+
+/**
+ * Serializes operations on the same account without a global lock. An account (owner email and
+ * account name) is hashed to one of a fixed number of shards, each guarded by its own mutex, so
+ * operations on unrelated accounts run in parallel while operations on the same account (or on
+ * accounts sharing a shard) run one after another.
+ *
+ * Operations touching two accounts lock both shards, always in ascending order of their index,
+ * so two transfers going in opposite directions can never deadlock. The same order is used when
+ * a batch locks all the accounts it touches.
+ *
+ * The locks are plain mutexes taken by the threads running the io_context: a thread waiting for an
+ * account (and then for its operation to be committed) serves nothing else meanwhile, so the server
+ * runs more threads than the machine has cores (see `BankServer::DEFAULT_THREAD_COUNT`).
+ */
+class AccountLocks
+{
+public:
+	/**
+	 * Locks held on behalf of an operation, released when the guard is destroyed.
+	 */
+	struct Guard {
+		std::unique_lock<std::mutex> first;
+		std::unique_lock<std::mutex> second;
+	};
+
+	// Owner email and name of an account
+	using Account = std::pair<std::string_view, std::string_view>;
+
+	/**
+	 * @param[in]	shard_count		Number of shards the accounts are spread over
+	 */
+	AccountLocks(std::size_t shard_count = DEFAULT_SHARD_COUNT) : shards(shard_count) {};
+
+	/**
+	 * Lock a single account.
+	 * @param[in]	email	Email of the account owner
+	 * @param[in]	name	Name of the account
+	 * @returns				Guard holding the lock
+	 */
+	Guard lock(std::string_view email, std::string_view name);
+
+	/**
+	 * Lock two accounts in a deadlock-free order.
+	 * @param[in]	email_first		Email of the owner of the first account
+	 * @param[in]	name_first		Name of the first account
+	 * @param[in]	email_second	Email of the owner of the second account
+	 * @param[in]	name_second		Name of the second account
+	 * @returns						Guard holding the locks
+	 */
+	Guard lock(std::string_view email_first, std::string_view name_first, std::string_view email_second,
+		std::string_view name_second);
+
+	/**
+	 * Lock any number of accounts in a deadlock-free order, each shard only once.
+	 * @param[in]	accounts	The accounts (may repeat)
+	 * @returns					Locks held, released when destroyed
+	 */
+	std::vector<std::unique_lock<std::mutex>> lock(const std::vector<Account>& accounts);
+
+	// Number of shards if not specified otherwise
+	static const std::size_t DEFAULT_SHARD_COUNT = 64;
+
+private:
+	// One mutex per shard
+	std::vector<std::mutex> shards;
+
+	/**
+	 * Get the shard of an account.
+	 * @param[in]	email	Email of the account owner
+	 * @param[in]	name	Name of the account
+	 * @returns				Index of the shard
+	 */
+	std::size_t shard(std::string_view email, std::string_view name) const;
+};
+
+#endif
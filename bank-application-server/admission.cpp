@@ -0,0 +1,52 @@
+#include "admission.h"
+
+const std::string Admission::BUSY = "Server is busy";
+
+bool Admission::admitConnection()
+{
+	if (tryIncrement(connections, limits.max_connections)) {
+		return true;
+	}
+	rejected_connections++;
+	return false;
+}
+
+void Admission::releaseConnection()
+{
+	connections--;
+}
+
+bool Admission::admitRequest()
+{
+	if (tryIncrement(requests, limits.max_requests)) {
+		return true;
+	}
+	rejected_requests++;
+	return false;
+}
+
+void Admission::releaseRequest()
+{
+	requests--;
+}
+
+void Admission::timedOut()
+{
+	timeouts++;
+}
+
+std::string Admission::busyReason() const
+{
+	return BUSY + ", retry after " + std::to_string(limits.retry_after.count()) + " s";
+}
+
+bool Admission::tryIncrement(std::atomic<std::size_t>& counter, std::size_t limit)
+{
+	std::size_t current = counter.load();
+	while (current < limit) {
+		if (counter.compare_exchange_weak(current, current + 1)) {
+			return true;
+		}
+	}
+	return false;
+}
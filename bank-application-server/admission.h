@@ -0,0 +1,106 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#ifndef ADMISSION_H_
+#define ADMISSION_H_
+
+/**
+ * Limits of the work the server accepts at once.
+ */
+struct AdmissionLimits {
+	// Connections open at the same time
+	std::size_t max_connections = 1024;
+
+	// Requests being served or waiting for a worker at the same time
+	std::size_t max_requests = 256;
+
+	// A connection with no request in progress is closed after this long
+	std::chrono::seconds idle_timeout = std::chrono::seconds(60);
+
+	// A connection whose client doesn't read the response for this long is closed
+	std::chrono::seconds write_timeout = std::chrono::seconds(10);
+
+	// Hint for rejected clients
+	std::chrono::seconds retry_after = std::chrono::seconds(1);
+};
+
+/**
+ * Admission control of connections and requests. Work over the limits is rejected right away
+ * (with a hint when to retry) instead of being queued, so the latency of the admitted work stays
+ * bounded under overload. All the methods are thread safe.
+ */
+class Admission
+{
+public:
+	/**
+	 * @param[in]	limits		The limits
+	 */
+	Admission(const AdmissionLimits& limits = AdmissionLimits()) : limits(limits) {};
+
+	/**
+	 * Try to admit a new connection; an admitted connection must be released.
+	 * @returns		True if the connection is admitted
+	 */
+	bool admitConnection();
+
+	/**
+	 * Release an admitted connection.
+	 */
+	void releaseConnection();
+
+	/**
+	 * Try to admit a new request; an admitted request must be released.
+	 * @returns		True if the request is admitted
+	 */
+	bool admitRequest();
+
+	/**
+	 * Release an admitted request.
+	 */
+	void releaseRequest();
+
+	/**
+	 * Record that a connection was closed because it missed a deadline.
+	 */
+	void timedOut();
+
+	/**
+	 * Reason sent to rejected clients, ends with the retry hint.
+	 * @returns		The reason
+	 */
+	std::string busyReason() const;
+
+	/**
+	 * The limits.
+	 * @returns		The limits
+	 */
+	const AdmissionLimits& getLimits() const { return limits; };
+
+	// Beginning of the reason sent to rejected clients
+	static const std::string BUSY;
+
+	// Current load
+	std::atomic<std::size_t> connections{ 0 };
+	std::atomic<std::size_t> requests{ 0 };
+
+	// Counters since the start of the server
+	std::atomic<std::size_t> rejected_connections{ 0 };
+	std::atomic<std::size_t> rejected_requests{ 0 };
+	std::atomic<std::size_t> timeouts{ 0 };
+
+private:
+	// The limits
+	AdmissionLimits limits;
+
+	/**
+	 * Increment a counter unless it has reached the limit.
+	 * @param[out]	counter		The counter
+	 * @param[in]	limit		The limit
+	 * @returns					True if the counter was incremented
+	 */
+	static bool tryIncrement(std::atomic<std::size_t>& counter, std::size_t limit);
+};
+
+#endif
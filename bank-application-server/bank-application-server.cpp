@@ -2,17 +2,148 @@
 // #define CURL_STATICLIB
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include "mail_client.h"
 #include "bank_server.h"
 #include "bank_exception.h"
+#include "benchmark.h"
+#include "database.h"
+#include "importer.h"
+#include "self_test.h"
 
 /**
- * Application entry point.
+ * Print the options of the server.
+ * @param[out]	out		Stream the usage is written to
+ */
+static void printUsage(std::ostream& out)
+{
+	out << "Usage: server [--threads <count>] [--max-connections <count>] [--max-requests <count>]"
+		<< " [--idle-timeout <seconds>] [--write-timeout <seconds>]" << std::endl
+		<< "       server --import <file> [--import <file> ...]" << std::endl
+		<< "       server --archive <months>" << std::endl
+		<< "       server --benchmark | --self-test" << std::endl;
+}
+
+/**
+ * Parse the value of a numeric option, all of it.
+ * @param[in]	value	The value
+ * @returns				The number
+ */
+static int parseNumber(const std::string& value)
+{
+	std::size_t parsed = 0;
+	int number = std::stoi(value, &parsed);
+	if (parsed != value.size()) {
+		throw std::invalid_argument(value);
+	}
+	return number;
+}
+
+/**
+ * Application entry point. The number of threads serving requests can be set
+ * with `--threads <count>`; `--benchmark` compares the protocols and exits, `--self-test` checks the
+ * server against scratch databases and exits with a non-zero status if any check fails.
+ * Admission limits are set with `--max-connections <count>`, `--max-requests <count>`,
+ * `--idle-timeout <seconds>` and `--write-timeout <seconds>`. `--import <file>` (repeated for more
+ * files) loads users, accounts and records into the database instead of serving, see `Importer`.
+ * `--archive <months>` moves the records of the months before the last <months> ones to archive
+ * files instead of serving, see `Database::archive`.
  */
 int main(int argc, char* argv[])
 {
+	unsigned int thread_count = BankServer::DEFAULT_THREAD_COUNT;
+	AdmissionLimits limits{};
+	std::vector<std::string> imports;
+	int keep_months = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--benchmark") {
+			Benchmark benchmark;
+			benchmark.run(std::cout);
+			return 0;
+		}
+		else if (arg == "--self-test") {
+			SelfTest self_test(std::cout);
+			return self_test.run() ? 0 : 1;
+		}
+
+		// A value that isn't a number (or doesn't fit an int) ends the program with the usage
+		try {
+			if (arg == "--threads" && i + 1 < argc) {
+				thread_count = std::max(1, parseNumber(argv[i + 1]));
+			}
+			else if (arg == "--max-connections" && i + 1 < argc) {
+				limits.max_connections = std::max(1, parseNumber(argv[i + 1]));
+			}
+			else if (arg == "--max-requests" && i + 1 < argc) {
+				limits.max_requests = std::max(1, parseNumber(argv[i + 1]));
+			}
+			else if (arg == "--idle-timeout" && i + 1 < argc) {
+				limits.idle_timeout = std::chrono::seconds(std::max(1, parseNumber(argv[i + 1])));
+			}
+			else if (arg == "--write-timeout" && i + 1 < argc) {
+				limits.write_timeout = std::chrono::seconds(std::max(1, parseNumber(argv[i + 1])));
+			}
+			else if (arg == "--import" && i + 1 < argc) {
+				imports.push_back(argv[i + 1]);
+			}
+			else if (arg == "--archive" && i + 1 < argc) {
+				keep_months = std::max(1, parseNumber(argv[i + 1]));
+			}
+		}
+		catch (std::logic_error&) {
+			std::cerr << "Invalid value of " << arg << ": " << argv[i + 1] << std::endl;
+			printUsage(std::cerr);
+			return 1;
+		}
+	}
+
+	if (!imports.empty()) {
+		try {
+			Importer importer(argv[0]);
+			for (auto&& file : imports) {
+				importer.import(file, std::cerr);
+			}
+			importer.finish(std::cout);
+		}
+		catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (keep_months > 0) {
+		try {
+			Database database;
+			database.setup(argv[0]);
+
+			// The current month stays open
+			int first_kept = Partitions::month(BankServer::currentDate()) - keep_months + 1;
+			bool archived = false;
+			for (int month : database.getPartitions().current()) {
+				if (month < first_kept) {
+					database.archive(month);
+					archived = true;
+					std::cout << "Archived " << Partitions::name(month) << std::endl;
+				}
+			}
+			if (archived) {
+				database.compact();
+			}
+		}
+		catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	// Server listening
-	BankServer server;
+	BankServer server(thread_count, limits);
 	server.run(argv[0]);
 
 	return 0;
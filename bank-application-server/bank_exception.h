@@ -25,5 +25,16 @@ private:
 	std::string s_;
 };
 
+/**
+ * Exception raised when a request doesn't follow the protocol.
+ */
+class protocol_exception : public std::exception {
+public:
+	protocol_exception(const std::string& message) : s_("Protocol error: ") { s_ += message; };
+	virtual const char* what() const override { return s_.c_str(); };
+private:
+	std::string s_;
+};
+
 #endif
 
@@ -1,10 +1,15 @@
 #include "bank_server.h"
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <chrono>
-#include <iomanip>
+#include <ctime>
 #include <memory>
+#include <thread>
 #include "bank_exception.h"
 #include "dto.h"
+#include "session.h"
+#include "transaction.h"
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
@@ -12,26 +17,39 @@
 using tcp = asio::ip::tcp;
 using PaymentList = std::vector<std::unique_ptr<RecurringPayment>>;
 
-const double BankServer::BLOCK_LIMIT = -10'000;
+const Money BankServer::BLOCK_LIMIT = Money(-10'000 * Money::SCALE);
+const std::string BankServer::ACCEPTED = "SUC";
+const std::string BankServer::REJECTED = "ERR";
 
-void BankServer::recurringPaymentExecute(std::atomic<bool>& done, const std::string& current_path)
+void BankServer::recurringPaymentExecute(std::atomic<bool>& done)
 {
 	using namespace std::chrono_literals;
 	try {
-		Database database{};
-		database.setup(current_path);
-
+		// The payments are written the way the requests are, through the writer thread in the group
+		// commit mode, so the writer connection is never taken from under a group
 		for (;;) {
 			PaymentList recurring_payments;
 			PaymentList* payments_ptr = &recurring_payments;
 
 			// Fill recurring_payments with recurring payment records in database
-			database.gatherRecurringPayments(recurringPaymentsCallback, payments_ptr);
+			database.gatherRecurringPayments(payments_ptr);
 
 			// Process each recurring payment
 			for (auto&& payment_unique : recurring_payments) {
-				RecurringPayment payment = *payment_unique;
-				BankServer::processRecurringPayment(payment, database);
+				const RecurringPayment& gathered = *payment_unique;
+				auto guard = accounts.lock(gathered.account_source_, gathered.name_source_,
+					gathered.account_target_, gathered.name_target_);
+
+				// A transfer may have used the payment since it was gathered
+				RecurringPayment payment = database.getRecurringPayment(gathered.source_id_);
+				if (payment.correct_) {
+					AccountCache::Changes changes;
+					commitOperation([&](Database& database) {
+						processRecurringPayment(payment, database, cache, changes);
+						return true;
+					});
+					applyChanges(changes);
+				}
 			}
 
 			std::this_thread::sleep_for(24h);
@@ -47,470 +65,661 @@ void BankServer::recurringPaymentExecute(std::atomic<bool>& done, const std::str
 	}
 }
 
-int BankServer::recurringPaymentsCallback(void* data, int argc, char** argv, char** azColName)
+void BankServer::run(const std::string& current_path)
 {
-	PaymentList* payments = (PaymentList*)data;
-	payments->push_back(std::make_unique<RecurringPayment>());
+	setup(current_path);
 
-	for(int i = 0; i < argc; i++){
-		if (std::string(azColName[i]) == "account_source") {
-			payments->back()->account_source_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "account_target") {
-			payments->back()->account_target_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name_source") {
-			payments->back()->name_source_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name_target") {
-			payments->back()->name_target_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "next_payment") {
-			payments->back()->next_payment_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "amount") {
-			payments->back()->amount_ = std::stod(argv[i]);
-		}
-		else if (std::string(azColName[i]) == "interval") {
-			switch (std::stoi(argv[i])) {
-			case Database::DB_INTERVAL_DAY:
-				payments->back()->interval_ = Interval::day;
-				break;
-			case Database::DB_INTERVAL_WEEK:
-				payments->back()->interval_ = Interval::week;
-				break;
-			case Database::DB_INTERVAL_MONTH:
-				payments->back()->interval_ = Interval::month;
-				break;
-			case Database::DB_INTERVAL_YEAR:
-				payments->back()->interval_ = Interval::year;
-				break;
+	// Start a second thread responsible for periodical check of recurring payments
+	std::atomic<bool> done(false);
+	std::thread thread(&BankServer::recurringPaymentExecute, this, std::ref(done));
+
+	asio::io_context io_context(thread_count);
+	tcp::endpoint endpoint = tcp::endpoint(tcp::v4(), PORT);
+	tcp::acceptor acceptor(io_context, endpoint);
+	asio::steady_timer timer(io_context);
+	asio::steady_timer checkpoint_timer(io_context);
+
+	startAccept(acceptor);
+	watchRecurringThread(timer, done, io_context);
+	scheduleCheckpoint(checkpoint_timer);
+
+	// The calling thread is one of the workers as well
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < thread_count; i++) {
+		workers.emplace_back([&io_context]() { io_context.run(); });
+	}
+
+	try {
+		io_context.run();
+		std::cerr << "Secondary thread has exited" << std::endl;
+	}
+	catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	catch (...) {
+		std::cerr << "An error occured" << std::endl;
+	}
+
+	std::cerr << "Waiting for other threads to stop" << std::endl;
+
+	io_context.stop();
+	for (auto&& worker : workers) {
+		worker.join();
+	}
+
+	asio::error_code ignored;
+	acceptor.close(ignored);
+	thread.join();
+
+	std::cerr << "Server has stopped" << std::endl;
+}
+
+void BankServer::setup(const std::string& current_path)
+{
+	// The recurring payments have a reader of their own
+	database.setup(current_path, thread_count + 1);
+	cache.warm(database);
+
+	// A serving thread waits for its operation to be committed, so a group never holds more operations
+	// than there are serving threads (the recurring payments rarely add one); a larger batch would only
+	// make the writer wait out the whole window
+	const DatabaseConfig& config = database.getConfig();
+	if (config.group_commit_batch > 0) {
+		std::size_t batch_size = std::min<std::size_t>(config.group_commit_batch, thread_count);
+		group_commit = std::make_unique<GroupCommit>(database, batch_size,
+			std::chrono::microseconds(config.group_commit_window));
+	}
+}
+
+void BankServer::startAccept(tcp::acceptor& acceptor)
+{
+	// Each connection gets its own strand, requests with correlation id are served by the whole pool
+	acceptor.async_accept(asio::make_strand(acceptor.get_executor()),
+		[this, &acceptor](const asio::error_code& error, tcp::socket socket) {
+			if (!acceptor.is_open()) {
+				return;
 			}
-		}
-		else if (std::string(azColName[i]) == "type") {
-			switch (std::stoi(argv[i])) {
-			case Database::DB_PAYMENT_STANDING_ORDER:
-				payments->back()->type_ = PaymentType::standing_order;
-				break;
-			case Database::DB_PAYMENT_DIRECT_DEBIT:
-				payments->back()->type_ = PaymentType::direct_debit;
-				break;
+
+			if (!error) {
+				if (admission.admitConnection()) {
+					std::make_shared<Session>(std::move(socket), *this, admission, acceptor.get_executor())->start();
+				}
+				else {
+					rejectConnection(std::move(socket));
+				}
 			}
-		}
-	}
 
-	return 0;
+			startAccept(acceptor);
+		});
 }
 
-void BankServer::run(const std::string& current_path)
+void BankServer::rejectConnection(tcp::socket socket)
 {
-	database.setup(current_path);
+	auto rejected = std::make_shared<tcp::socket>(std::move(socket));
+	auto response = std::make_shared<std::string>(REJECTED + admission.busyReason() + END);
+
+	asio::async_write(*rejected, asio::buffer(*response),
+		[rejected, response](const asio::error_code&, std::size_t) {
+			asio::error_code ignored;
+			rejected->shutdown(tcp::socket::shutdown_both, ignored);
+			rejected->close(ignored);
+		});
+}
 
-	// Start a second thread responsible for periodical check of recurring payments
-    std::atomic<bool> done(false);
-	std::thread thread(recurringPaymentExecute, std::ref(done), current_path);
-	
-	asio::io_context io_context;
-	tcp::endpoint endpoint = tcp::endpoint(tcp::v4(), 13);
-	tcp::acceptor acceptor(io_context, endpoint);
+void BankServer::watchRecurringThread(asio::steady_timer& timer, std::atomic<bool>& done, asio::io_context& io_context)
+{
+	using namespace std::chrono_literals;
 
-	try {
-		for (;;)
-		{
-			if (done) {
-				throw std::exception("Secondary thread has exited");
+	timer.expires_after(1s);
+	timer.async_wait(
+		[this, &timer, &done, &io_context](const asio::error_code& error) {
+			if (error) {
+				return;
 			}
 
-			tcp::socket socket(io_context);
-			acceptor.accept(socket);
-			
-			std::string incoming = "";
-			readIncoming(socket, incoming);
+			if (done) {
+				io_context.stop();
+				return;
+			}
 
-			std::string message = "";
-			createResponseMessage(incoming, message);
+			watchRecurringThread(timer, done, io_context);
+		});
+}
 
-			asio::write(socket, asio::buffer(message));
-		}
+void BankServer::scheduleCheckpoint(asio::steady_timer& timer)
+{
+	int interval = database.getConfig().checkpoint_interval;
+	if (interval <= 0) {
+		return;
 	}
-	catch (std::exception& e) {
-		std::cerr << e.what() << std::endl;
-		std::cerr << "Waiting for second thread to stop" << std::endl;
 
-		acceptor.close();
-		thread.join();
+	timer.expires_after(std::chrono::seconds(interval));
+	timer.async_wait(
+		[this, &timer](const asio::error_code& error) {
+			if (error) {
+				return;
+			}
+
+			// A failed checkpoint is only reported, the next one catches up
+			try {
+				database.checkpoint();
+			}
+			catch (db_exception& e) {
+				std::cerr << e.what() << std::endl;
+			}
+
+			scheduleCheckpoint(timer);
+		});
+}
+
+void BankServer::createResponseMessage(std::string_view incoming, ResponseBuilder& message)
+{
+	Request request = parseRequest(incoming);
+
+	TextResponseWriter response(message);
+	serve(request, response);
+
+	message.append(END);
+}
+
+Request BankServer::parseRequest(std::string_view incoming)
+{
+	Request request{};
+
+	auto opcode = std::from_chars(incoming.data(), incoming.data() + std::min<std::size_t>(incoming.size(), 2),
+		request.opcode_);
+	if (opcode.ec != std::errc()) {
+		throw protocol_exception("malformed opcode");
 	}
-	catch (...) {
-		std::cerr << "An error occured, waiting for second thread to stop" << std::endl;
 
-		acceptor.close();
-		thread.join();
+	// Split the fields in a single pass, the last one is terminated by END
+	std::size_t begin = 2;
+	for (std::size_t i = begin; i < incoming.size(); i++) {
+		if ((incoming[i] == SEPARATOR) || (incoming[i] == END)) {
+			request.addField(Field{ FieldType::text, incoming.substr(begin, i - begin), 0 });
+			begin = i + 1;
+
+			if (incoming[i] == END) {
+				break;
+			}
+
+			// The operations of a batch are left to be parsed one at a time
+			if ((request.opcode_ == BATCH) && (request.size() == BATCH_HEADER_FIELDS)) {
+				request.batch_ = incoming.substr(begin, incoming.find(END, begin) - begin);
+				break;
+			}
+		}
 	}
 
-	std::cerr << "Server has stopped" << std::endl;
+	return request;
 }
 
-void BankServer::readIncoming(tcp::socket& socket, std::string& incoming)
+Request BankServer::parseOperation(std::string_view& operations)
 {
-	for (;;) {
-		char buf[128] = {};
-		size_t len = socket.read_some(asio::buffer(buf));
+	Request operation{};
 
-		// Read until terminal character '\n' is reached
-		incoming.append(buf);
-		if (incoming.at(incoming.size()-1) == '\n') {
-			break;
+	// The opcode goes first, it determines the number of fields that follow
+	std::size_t count = 0;
+	for (std::size_t n = 0; n <= count; n++) {
+		if (operations.empty()) {
+			throw protocol_exception("truncated operation");
+		}
+
+		std::size_t end = std::min(operations.find(SEPARATOR), operations.size());
+		std::string_view field = operations.substr(0, end);
+		operations.remove_prefix(std::min(end + 1, operations.size()));
+
+		if (n == 0) {
+			auto opcode = std::from_chars(field.data(), field.data() + field.size(), operation.opcode_);
+			if (opcode.ec != std::errc()) {
+				throw protocol_exception("malformed opcode");
+			}
+			count = operationFields(operation.opcode_);
+		}
+		else {
+			operation.addField(Field{ FieldType::text, field, 0 });
 		}
 	}
+
+	return operation;
 }
 
-void BankServer::createResponseMessage(std::string& incoming, std::string& message)
+std::size_t BankServer::operationFields(int opcode)
 {
-	int id = std::stoi(incoming.substr(0, 2));
-	incoming = incoming.substr(2);
+	switch (opcode) {
+
+	// Transfer TO, transfer FROM
+	case 3:
+	case 4:
+		return 5;
 
-	switch (id) {
+	// Add money
+	case 7:
+		return 3;
+
+	default:
+		throw protocol_exception("opcode " + std::to_string(opcode) + " not allowed in a batch");
+	}
+}
+
+void BankServer::serve(const Request& request, ResponseWriter& response)
+{
+	switch (request.opcode_) {
 
 	// Log in
 	case 1:
-		login(incoming, message);
+		login(request, response);
 		break;
 
 	// Register
 	case 2:
 	{
-		registration(incoming, message);
+		registration(request, response);
 		break;
 	}
 	// Transfer TO
 	case 3:
-		transfer(incoming, message, "TO");
+		transfer(request, response, "TO");
 		break;
 
 	// Transfer FROM
 	case 4:
-		transfer(incoming, message, "FROM");
+		transfer(request, response, "FROM");
 		break;
 
 	// Direct debit
 	case 5:
-		recurringPayment(incoming, message, PaymentType::direct_debit);
+		recurringPayment(request, response, PaymentType::direct_debit);
 		break;
 
 	// Standing order 
 	case 6:
-		recurringPayment(incoming, message, PaymentType::standing_order);
+		recurringPayment(request, response, PaymentType::standing_order);
 		break;
 
 	// Add money 
 	case 7:
-		addMoney(incoming, message);
+		addMoney(request, response);
 		break;
 
 	// Add account
 	case 8:
-		addAccount(incoming, message);
+		addAccount(request, response);
 		break;
 
 	// Get transactions of given account
 	case 9:
-		transactionHistory(incoming, message);
+		transactionHistory(request, response);
 		break;
 
 	// Get user accounts
 	case 10:
-		listAccounts(incoming, message);
+		listAccounts(request, response);
 		break;
 
 	// Get previously selected target users
 	case 11:
-		previousTargets(incoming, message);
+		previousTargets(request, response);
+		break;
+
+	// Get admission counters
+	case 12:
+		statistics(response);
+		break;
+
+	// Get a page of transactions of given account
+	case 14:
+		transactionPage(request, response);
+		break;
+
+	// Get the balance of given account at the end of a day
+	case 15:
+		balanceAsOf(request, response);
+		break;
+
+	// Batch of transfers and deposits
+	case BATCH:
+		batch(request, response);
 		break;
 
 	default:
-		message += REJECTED;
+		response.reject("");
 	}
-	
-	message += END;
 }
 
-void BankServer::registration(std::string& incoming, std::string& message)
+void BankServer::registration(const Request& request, ResponseWriter& response)
 {
-	std::string mail = "";
-	std::string passwd = "";
-	double balance = 0;
+	std::string_view mail = request.text(0);
+	std::string_view passwd = request.text(1);
 
-	fillField(incoming, mail, SEPARATOR);
-	fillField(incoming, passwd, END);
-
-	User user = database.getUser(mail);
-	if (!user.correct_) {
+	User user{};
+	if (!cache.findUser(mail, user)) {
 		std::vector<Account> accounts;
-		user = User(mail, passwd, accounts);
-		database.addUser(user);
-
-		message += ACCEPTED;
-		message += mail + SEPARATOR;
-		messageAccounts(user, message);
+		user = User(std::string(mail), std::string(passwd), accounts);
+		commitOperation([&](Database& database) {
+			database.addUser(user);
+			return true;
+		});
+		cache.addUser(user);
+
+		response.accept();
+		response.addText(mail);
+		messageAccounts(user, response);
 	}
 	else {
-		message += REJECTED;
-		message += "User already exists";
+		response.reject("User already exists");
 	}
 }
 
-void BankServer::login(std::string& incoming, std::string& message)
+void BankServer::login(const Request& request, ResponseWriter& response)
 {
-	std::string mail = "";
-	std::string passwd = "";
+	std::string_view mail = request.text(0);
+	std::string_view passwd = request.text(1);
 
-	fillField(incoming, mail, SEPARATOR);
-	fillField(incoming, passwd, END);
-
-	User user = database.getUser(mail);
-	if (user.correct_) {
+	User user{};
+	if (cache.findUser(mail, user)) {
 		if (user.password_ == passwd) {
-			message += ACCEPTED;
-			message += user.mail_ + SEPARATOR;
-			messageAccounts(user, message);
+			response.accept();
+			response.addText(user.mail_);
+			messageAccounts(user, response);
 		}
 		else {
-			message += REJECTED;
-			message += "Wrong password";
+			response.reject("Wrong password");
 		}
 	}
 	else {
-		message += REJECTED;
-		message += "User does not exist";
+		response.reject("User does not exist");
 	}
 }
 
-void BankServer::addMoney(std::string& incoming, std::string& message)
+void BankServer::addMoney(const Request& request, ResponseWriter& response)
 {
-	std::string email = "";
-	std::string account = "";
-	std::string amount_str = "";
-
-	fillField(incoming, email, SEPARATOR);
-	fillField(incoming, account, SEPARATOR);
-	fillField(incoming, amount_str, END);
-
-	double amount = std::stod(amount_str);
+	// The balance is read and written back, no other operation may change it meanwhile
+	auto guard = accounts.lock(request.text(0), request.text(1));
+
+	// All the changes are committed at once, then they are visible in the cache
+	AccountCache::Changes changes;
+	commitOperation([&](Database& database) {
+		executeAddMoney(request, response, database, changes);
+		return true;
+	});
+	applyChanges(changes);
+}
 
-	// Ensure account exists, retrieve information about it
-	User user = database.getUser(email);
-	Account acc{};
-	bool found = false;
-	for (auto&& a : user.accounts_) {
-		if (a.name_ == account) {
-			found = true;
-			acc = a;
-		}
+bool BankServer::commitOperation(const GroupCommit::Operation& operation)
+{
+	if (group_commit) {
+		return group_commit->submit(operation).get();
 	}
 
-	if (found) {
-		double new_balance = acc.balance_ + amount;
+	Transaction transaction(database);
+	if (!operation(transaction.database())) {
+		transaction.rollback();
+		return false;
+	}
+	transaction.commit();
+	return true;
+}
 
-		// if new balance of an account would change it's state, change the state and inform user
-		if ((new_balance >= BLOCK_LIMIT) && (acc.state_ == State::blocked)) {
-			database.changeValueAccount(user.mail_, acc.name_, "state", std::to_string(Database::DB_USER_OK));
-			acc.state_ = State::ok;
-			emailStateChanged(user.mail_, acc.name_, acc.state_);
-		}
+void BankServer::executeAddMoney(const Request& request, ResponseWriter& response, Database& database,
+	AccountCache::Changes& changes)
+{
+	std::string_view email = request.text(0);
+	std::string_view account = request.text(1);
+	Money amount = request.amount(2);
 
-		database.changeValueAccount(user.mail_, acc.name_, "balance", std::to_string(new_balance));
+	// Ensure account exists, retrieve information about it
+	Account acc{};
+	if (cache.findAccount(email, account, changes, acc)) {
+		int today = currentDate();
+		credit(database, acc, amount, today, changes);
 
-		Record record{"-", user.mail_, "-", acc.name_, amount, currentDate()};
+		Record record{"-", acc.mail_, "-", acc.name_, amount, today, Database::DB_EXTERNAL_ACCOUNT, acc.id_};
 		database.addRecord(record);
 
-		message += ACCEPTED;
-		message += user.mail_ + SEPARATOR;
-		message += acc.name_ + SEPARATOR;
-		message += std::to_string(new_balance) + SEPARATOR;
-		message += getStateString(acc.state_);
+		response.accept();
+		response.addText(acc.mail_);
+		response.addText(acc.name_);
+		response.addAmount(acc.balance_);
+		response.addText(getStateString(acc.state_));
 	}
 	else {
-		message += REJECTED;
-		message += "Account does not exist";
+		response.reject("Account does not exist");
 	}
 }
 
-void BankServer::transfer(std::string& incoming, std::string& message, const std::string& direction)
+void BankServer::transfer(const Request& request, ResponseWriter& response, const std::string& direction)
+{
+	// Both balances are read and written back, no other operation may change them meanwhile
+	auto guard = accounts.lock(request.text(0), request.text(2), request.text(1), request.text(3));
+
+	// All the changes are committed at once, then they are visible in the cache
+	AccountCache::Changes changes;
+	commitOperation([&](Database& database) {
+		executeTransfer(request, response, direction, database, changes);
+		return true;
+	});
+	applyChanges(changes);
+}
+
+void BankServer::executeTransfer(const Request& request, ResponseWriter& response, const std::string& direction,
+	Database& database, AccountCache::Changes& changes)
 {
-	std::string current_email = "";
-	std::string selected_email = "";
-	std::string current_acc = "";
-	std::string selected_acc = "";
-	std::string amount_str = "";
+	std::string_view current_email;
+	std::string_view selected_email;
+	std::string_view current_acc;
+	std::string_view selected_acc;
 
 	// swap current and selected accounts if needed
 	if (direction == "TO") {
-		fillField(incoming, current_email, SEPARATOR);
-		fillField(incoming, selected_email, SEPARATOR);
-		fillField(incoming, current_acc, SEPARATOR);
-		fillField(incoming, selected_acc, SEPARATOR);
+		current_email = request.text(0);
+		selected_email = request.text(1);
+		current_acc = request.text(2);
+		selected_acc = request.text(3);
 	}
 	else {
-		fillField(incoming, selected_email, SEPARATOR);
-		fillField(incoming, current_email, SEPARATOR);
-		fillField(incoming, selected_acc, SEPARATOR);
-		fillField(incoming, current_acc, SEPARATOR);
+		selected_email = request.text(0);
+		current_email = request.text(1);
+		selected_acc = request.text(2);
+		current_acc = request.text(3);
 	}
-	fillField(incoming, amount_str, END);
 
-	double amount = std::stod(amount_str);
+	Money amount = request.amount(4);
 
-	User user_current = database.getUser(current_email);
-	User user_selected = database.getUser(selected_email);
-	
+	// Both accounts as committed (or as changed earlier in the batch), nothing is read from the database
 	Account acc_current{};
 	Account acc_selected{};
-
-	// Get source account from database
-	bool current_exists = false;
-	for (auto&& acc : user_current.accounts_) {
-		if (acc.name_ == current_acc) {
-			current_exists = true;
-			acc_current = acc;
-		}
-	}
-
-	// Get target account from database
-	bool selected_exists = false;
-	for (auto&& acc : user_selected.accounts_) {
-		if (acc.name_ == selected_acc) {
-			selected_exists = true;
-			acc_selected = acc;
-		}
-	}
+	bool current_exists = cache.findAccount(current_email, current_acc, changes, acc_current);
+	bool selected_exists = cache.findAccount(selected_email, selected_acc, changes, acc_selected);
 
 	if (!current_exists || !selected_exists) {
-		message += REJECTED;
-		message += "One of the accounts does not exist";
+		response.reject("One of the accounts does not exist");
 		return;
 	}
 
-	if (user_selected.correct_ && user_current.correct_) {
-		if (acc_current.state_ == State::ok) {
-
-			// In order to transfer from someone he needs to have a direct debit set up
-			if (direction == "FROM") {
-				RecurringPayment rp = database.getRecurringPayment(user_current.mail_, acc_current.name_);
+	if (acc_current.state_ == State::ok) {
+		int today = currentDate();
 
-				if (rp.correct_ && (rp.type_ == PaymentType::direct_debit)) {
-					std::time_t next_payment = timeFromString(rp.next_payment_);
-					std::time_t now = std::time(nullptr);
-					double time_diff = std::difftime(next_payment, now);
+		// In order to transfer from someone he needs to have a direct debit set up
+		if (direction == "FROM") {
+			RecurringPayment rp = database.getRecurringPayment(acc_current.id_);
 
-					if (time_diff <= 0 && rp.amount_ >= amount) {
-						tm* next_payment_new = localtime(&next_payment);
-						addInterval(rp, next_payment_new);
-
-						std::string next_payment_str = stringFromTime(next_payment_new);
-						database.updateRecurringPayment(user_current.mail_, acc_current.name_, next_payment_str);
-					}
-					else {
-						message += REJECTED;
-						message += "The direct debit has already been spent or it is too low";
-						return;
-					}
+			if (rp.correct_ && (rp.type_ == PaymentType::direct_debit)) {
+				if ((rp.next_payment_ <= today) && (rp.amount_ >= amount)) {
+					database.updateRecurringPayment(acc_current.id_, addInterval(rp, rp.next_payment_));
 				}
 				else {
-					message += REJECTED;
-					message += "No direct debit present";
+					response.reject("The direct debit has already been spent or it is too low");
 					return;
 				}
 			}
+			else {
+				response.reject("No direct debit present");
+				return;
+			}
+		}
 
-			double user_current_new_balance = acc_current.balance_ - amount;
-			double user_selected_new_balance = acc_selected.balance_ + amount;
+		debit(database, acc_current, amount, today, changes);
 
-			// if new balance of an account would change it's state, change the state and inform user
-			if ((user_current_new_balance < BLOCK_LIMIT) && (acc_current.state_ == State::ok)) {
-				database.changeValueAccount(user_current.mail_, acc_current.name_, "state", 
-					std::to_string(Database::DB_USER_BLOCKED));
-				acc_current.state_ = State::blocked;
-				emailStateChanged(user_current.mail_, acc_current.name_, acc_current.state_);
-			}
+		// A transfer to the same account gets it back as debited
+		if (acc_selected.id_ == acc_current.id_) {
+			acc_selected = acc_current;
+		}
+		credit(database, acc_selected, amount, today, changes);
 
-			// if new balance of an account would change it's state, change the state and inform user
-			if ((user_selected_new_balance >= BLOCK_LIMIT) && (acc_selected.state_ == State::blocked)) {
-				database.changeValueAccount(user_selected.mail_, acc_selected.name_, "state", 
-					std::to_string(Database::DB_USER_OK));
-				acc_selected.state_ = State::ok;
-				emailStateChanged(user_selected.mail_, acc_selected.name_, acc_selected.state_);
-			}
+		// ...and ends up as credited, which is what the reply shows
+		if (acc_selected.id_ == acc_current.id_) {
+			acc_current = acc_selected;
+		}
 
-			database.changeValueAccount(user_current.mail_, acc_current.name_, "balance", std::to_string(user_current_new_balance));
-			database.changeValueAccount(user_selected.mail_, acc_selected.name_, "balance", std::to_string(user_selected_new_balance));
-
-			Record record{user_current.mail_, user_selected.mail_, acc_current.name_, acc_selected.name_, amount, currentDate()};
-			database.addRecord(record);
-
-			if (direction == "TO") {
-				user_pair pair = {
-					acc_current.mail_, // email_source
-					acc_selected.mail_, // email_target
-					acc_current.name_, // name_source
-					acc_selected.name_ // name_target
-				};
-
-				database.addPrevious(pair);
-				
-				message += ACCEPTED;
-				message += user_current.mail_ + SEPARATOR;
-				message += acc_current.name_ + SEPARATOR;
-				message += std::to_string(user_current_new_balance) + SEPARATOR;
-				message += getStateString(acc_current.state_);
-			}
-			else {
-				user_pair pair = {
-					acc_selected.mail_, // email_source
-					acc_current.mail_, // email_target
-					acc_selected.name_, // name_source
-					acc_current.name_ // name_target
-				};
-				database.addPrevious(pair);
+		Record record{acc_current.mail_, acc_selected.mail_, acc_current.name_, acc_selected.name_, amount, today,
+			acc_current.id_, acc_selected.id_};
+		database.addRecord(record);
+
+		if (direction == "TO") {
+			database.addPrevious(acc_current.id_, acc_selected.id_);
 			
-				message += ACCEPTED;
-				message += user_selected.mail_ + SEPARATOR;
-				message += acc_selected.name_ + SEPARATOR;
-				message += std::to_string(user_selected_new_balance) + SEPARATOR;
-				message += getStateString(acc_selected.state_);
-			}
+			response.accept();
+			response.addText(acc_current.mail_);
+			response.addText(acc_current.name_);
+			response.addAmount(acc_current.balance_);
+			response.addText(getStateString(acc_current.state_));
 		}
 		else {
-			message += REJECTED;
-			message += "Payers account is blocked";
+			database.addPrevious(acc_selected.id_, acc_current.id_);
+
+			response.accept();
+			response.addText(acc_selected.mail_);
+			response.addText(acc_selected.name_);
+			response.addAmount(acc_selected.balance_);
+			response.addText(getStateString(acc_selected.state_));
 		}
 	}
 	else {
-		message += REJECTED;
-		message += "One of the accounts doesn't exist";
+		response.reject("Payers account is blocked");
+	}
+}
+
+void BankServer::debit(Database& database, Account& account, Money amount, int date, AccountCache::Changes& changes)
+{
+	Money new_balance = account.balance_ - amount;
+
+	// if new balance of an account would change it's state, change the state (the user is informed once committed)
+	if ((new_balance < BLOCK_LIMIT) && (account.state_ == State::ok)) {
+		account.state_ = State::blocked;
+	}
+
+	database.addToBalance(account.id_, Money() - amount, account.state_, date);
+	account.balance_ = new_balance;
+	changes[account.id_] = account;
+}
+
+void BankServer::credit(Database& database, Account& account, Money amount, int date, AccountCache::Changes& changes)
+{
+	Money new_balance = account.balance_ + amount;
+
+	// if new balance of an account would change it's state, change the state (the user is informed once committed)
+	if ((new_balance >= BLOCK_LIMIT) && (account.state_ == State::blocked)) {
+		account.state_ = State::ok;
+	}
+
+	database.addToBalance(account.id_, amount, account.state_, date);
+	account.balance_ = new_balance;
+	changes[account.id_] = account;
+}
+
+void BankServer::batch(const Request& request, ResponseWriter& response)
+{
+	int mode = request.integer(0);
+	int count = request.integer(1);
+
+	if ((mode != BATCH_ALL_OR_NOTHING) && (mode != BATCH_BEST_EFFORT)) {
+		response.reject("Unknown batch mode");
+		return;
+	}
+	if ((count < 0) || (count > MAX_BATCH_SIZE)) {
+		response.reject("Batch too large");
+		return;
+	}
+
+	// Decode the whole batch first: a malformed one is rejected before anything is executed, and
+	// all the accounts are known before they are locked
+	std::vector<AccountLocks::Account> touched;
+	touched.reserve(2 * count);
+	std::string_view operations = request.batch_;
+	for (int i = 0; i < count; i++) {
+		Request operation = request.nextOperation(operations);
+		touched.emplace_back(operation.text(0), operation.text(operation.opcode_ == 7 ? 1 : 2));
+		if (operation.opcode_ != 7) {
+			touched.emplace_back(operation.text(1), operation.text(3));
+		}
+	}
+	if (!operations.empty()) {
+		throw protocol_exception("more operations than the batch size");
+	}
+
+	auto guards = accounts.lock(touched);
+
+	std::vector<StatusResponseWriter> outcomes(count);
+	AccountCache::Changes changes;
+	int rejected = 0;
+	bool committed = commitOperation([&](Database& database) {
+		operations = request.batch_;
+		for (int i = 0; i < count; i++) {
+			Request operation = request.nextOperation(operations);
+			executeOperation(operation, outcomes[i], database, changes);
+
+			if (!outcomes[i].accepted && (mode == BATCH_ALL_OR_NOTHING)) {
+				rejected = i;
+				return false;
+			}
+		}
+		return true;
+	});
+
+	if (!committed) {
+		response.reject("Operation " + std::to_string(rejected) + " rejected: " + outcomes[rejected].reason);
+		return;
+	}
+	applyChanges(changes);
+
+	response.accept();
+	response.addCount(count);
+	for (auto&& outcome : outcomes) {
+		response.addText(outcome.accepted ? ACCEPTED : REJECTED + outcome.reason);
 	}
 }
 
-void BankServer::recurringPayment(std::string& incoming, std::string& message, PaymentType pt)
+void BankServer::executeOperation(const Request& operation, ResponseWriter& response, Database& database,
+	AccountCache::Changes& changes)
 {
-	std::string email_source = "";
-	std::string email_target = "";
-	std::string acc_source = "";
-	std::string acc_target = "";
-	std::string amount_str = "";
-	std::string next_payment = "";
-	std::string interval_str = "";
+	switch (operation.opcode_) {
+	case 3:
+		executeTransfer(operation, response, "TO", database, changes);
+		break;
+	case 4:
+		executeTransfer(operation, response, "FROM", database, changes);
+		break;
+	case 7:
+		executeAddMoney(operation, response, database, changes);
+		break;
+	default:
+		response.reject("");
+	}
+}
 
-	fillField(incoming, email_source, SEPARATOR);
-	fillField(incoming, email_target, SEPARATOR);
-	fillField(incoming, acc_source, SEPARATOR);
-	fillField(incoming, acc_target, SEPARATOR);
-	fillField(incoming, amount_str, SEPARATOR);
-	fillField(incoming, next_payment, SEPARATOR);
-	fillField(incoming, interval_str, END);
+void BankServer::recurringPayment(const Request& request, ResponseWriter& response, PaymentType pt)
+{
+	std::string email_source(request.text(0));
+	std::string email_target(request.text(1));
+	std::string acc_source(request.text(2));
+	std::string acc_target(request.text(3));
+	Money amount = request.amount(4);
+	int next_payment = request.day(5);
 
 	Interval interval;
 	bool correct = true;
-	int interval_int = std::stoi(interval_str);
+	int interval_int = request.integer(6);
 	switch (interval_int) {
 	case 0:
 		interval = Interval::day;
@@ -530,65 +739,64 @@ void BankServer::recurringPayment(std::string& incoming, std::string& message, P
 	}
 
 	if (correct) {
-		RecurringPayment existing = database.getRecurringPayment(email_source, acc_source);
+		// The check and both inserts are committed at once
+		commitOperation([&](Database& database) {
+			long long source_id = cache.findAccountId(email_source, acc_source);
+			long long target_id = cache.findAccountId(email_target, acc_target);
+			if ((source_id == Database::DB_NO_ACCOUNT) || (target_id == Database::DB_NO_ACCOUNT)) {
+				response.reject("One of the accounts does not exist");
+				return false;
+			}
 
-		if (!existing.correct_) {
-			RecurringPayment rp{ email_source, email_target, acc_source, acc_target, next_payment, std::stod(amount_str),
-				interval, pt };
+			RecurringPayment existing = database.getRecurringPayment(source_id);
 
-			database.addRecurringPayment(rp);
+			if (!existing.correct_) {
+				RecurringPayment rp{ email_source, email_target, acc_source, acc_target, next_payment, amount,
+					interval, pt };
+				rp.source_id_ = source_id;
+				rp.target_id_ = target_id;
 
-			user_pair pair = {
-				email_source, // email_source
-				email_target, // email_target
-				acc_source, // name_source
-				acc_target // name_target
-			};
-			database.addPrevious(pair);
+				database.addRecurringPayment(rp);
+				database.addPrevious(source_id, target_id);
 
-			message += ACCEPTED;
-		}
-		else {
-			message += REJECTED;
-			message += "Number of recurring payments for user exceeded";
-		}
+				response.accept();
+				return true;
+			}
+			else {
+				response.reject("Number of recurring payments for user exceeded");
+				return false;
+			}
+		});
 	}
 	else {
-		message += REJECTED;
-		message += "Internal error: unknown time interval";
+		response.reject("Internal error: unknown time interval");
 	}
 }
 
-void BankServer::listAccounts(std::string& incoming, std::string& message)
+void BankServer::listAccounts(const Request& request, ResponseWriter& response)
 {
-	std::string mail = "";
-
-	fillField(incoming, mail, END);
+	std::string_view mail = request.text(0);
 
-	User user = database.getUser(mail);
-	if (user.correct_) {
-		message += ACCEPTED;
-		message += user.mail_ + SEPARATOR;
-		messageAccounts(user, message);
+	User user{};
+	if (cache.findUser(mail, user)) {
+		response.accept();
+		response.addText(user.mail_);
+		messageAccounts(user, response);
 	}
 	else {
-		message += REJECTED;
-		message += "User does not exist";
+		response.reject("User does not exist");
 	}
 }
 
-void BankServer::addAccount(std::string& incoming, std::string& message)
+void BankServer::addAccount(const Request& request, ResponseWriter& response)
 {
-	std::string mail = "";
-	std::string name = "";
-
-	double balance = 0;
+	std::string_view mail = request.text(0);
+	std::string_view name = request.text(1);
 
-	fillField(incoming, mail, SEPARATOR);
-	fillField(incoming, name, END);
+	Money balance{};
 
-	User user = database.getUser(mail);
-	if (user.correct_) {
+	User user{};
+	if (cache.findUser(mail, user)) {
 		bool acc_exists = false;
 		for (auto&& acc : user.accounts_) {
 			if (acc.name_ == name) {
@@ -597,136 +805,180 @@ void BankServer::addAccount(std::string& incoming, std::string& message)
 		}
 
 		if (!acc_exists) {
-			Account acc = Account(mail, name, balance, State::ok);
-			database.addAccount(acc);
+			Account acc = Account(std::string(mail), std::string(name), balance, State::ok);
+			commitOperation([&](Database& database) {
+				acc.id_ = database.addAccount(acc);
+				return true;
+			});
+			cache.addAccount(acc);
 			user.accounts_.push_back(acc);
 
-			message += ACCEPTED;
-			message += mail + SEPARATOR;
-			messageAccounts(user, message);
+			response.accept();
+			response.addText(mail);
+			messageAccounts(user, response);
 		}
 		else {
-			message += REJECTED;
-			message += "Account already exists";
+			response.reject("Account already exists");
 		}
 	}
 	else {
-		message += REJECTED;
-		message += "User doesn't exist";
+		response.reject("User doesn't exist");
 	}
 }
 
-void BankServer::transactionHistory(std::string& incoming, std::string& message)
+void BankServer::transactionHistory(const Request& request, ResponseWriter& response)
 {
-	std::string mail = "";
-	std::string name = "";
-	std::string date_from = "";
-	std::string date_to = "";
-
-	fillField(incoming, mail, SEPARATOR);
-	fillField(incoming, name, SEPARATOR);
-	fillField(incoming, date_from, SEPARATOR);
-	fillField(incoming, date_to, END);
+	std::string_view mail = request.text(0);
+	std::string_view name = request.text(1);
+	int date_from = request.day(2);
+	int date_to = request.day(3);
 
+	// Only the records in range are read, an account that doesn't exist has none
+	long long id = cache.findAccountId(mail, name);
 	RecordList records;
-	RecordList* records_ptr = &records;
-	database.gatherRecords(mail, name, records_ptr);
-
-	std::string result = "";
-	int count = 0;
-	for (auto&& record_unique : records) {
-		Record record = *record_unique;
+	database.gatherRecords(id, date_from, date_to, &records);
 
-		std::time_t date_from_t = timeFromString(date_from);
-		std::time_t date_to_t = timeFromString(date_to);
-		std::time_t record_t = timeFromString(record.date_);
+	response.accept();
+	response.addCount(static_cast<int>(records.size()));
+	for (auto&& record : records) {
+		messageRecord(record, response);
+	}
+}
 
-		double rec_diff_from = std::difftime(record_t, date_from_t);
-		double to_diff_rec = std::difftime(date_to_t, record_t);
+void BankServer::transactionPage(const Request& request, ResponseWriter& response)
+{
+	std::string_view mail = request.text(0);
+	std::string_view name = request.text(1);
+	int date_from = request.day(2);
+	int date_to = request.day(3);
+	int page_size = request.integer(4);
+	std::string_view cursor = request.text(5);
+
+	if ((page_size <= 0) || (page_size > MAX_PAGE_SIZE)) {
+		response.reject("Page size out of range");
+		return;
+	}
 
-		// Inclusive on both ends
-		if ((rec_diff_from >= 0) && (to_diff_rec >= 0)) {
-			if (count > 0) {
-				result += SEPARATOR;
-			}
+	// The first page follows rowid 0 of the first day, rowids start at 1
+	int after_date = date_from;
+	long long after_rowid = 0;
+	if (!cursor.empty()) {
+		std::size_t separator = cursor.find(CURSOR_SEPARATOR);
+		if (separator == std::string_view::npos) {
+			response.reject("Malformed cursor");
+			return;
+		}
 
-			count += 1;
-			result += record.account_source_ + SEPARATOR;
-			result += record.account_target_ + SEPARATOR;
-			result += record.name_source_ + SEPARATOR;
-			result += record.name_target_ + SEPARATOR;
-			result += std::to_string(record.amount_) + SEPARATOR;
-			result += record.date_;
+		// Both parts are whole numbers, nothing may follow them
+		std::string_view date = cursor.substr(0, separator);
+		std::string_view rowid = cursor.substr(separator + 1);
+		auto date_result = std::from_chars(date.data(), date.data() + date.size(), after_date);
+		auto rowid_result = std::from_chars(rowid.data(), rowid.data() + rowid.size(), after_rowid);
+		if ((date_result.ec != std::errc()) || (date_result.ptr != date.data() + date.size()) ||
+			(rowid_result.ec != std::errc()) || (rowid_result.ptr != rowid.data() + rowid.size())) {
+			response.reject("Malformed cursor");
+			return;
 		}
 	}
 
-	message += ACCEPTED;
-	message += std::to_string(count) + SEPARATOR;
-	message += result;
+	long long id = cache.findAccountId(mail, name);
+	if (id == Database::DB_NO_ACCOUNT) {
+		response.reject("Account does not exist");
+		return;
+	}
+
+	// One record more than the page tells whether another page follows
+	RecordPage page;
+	database.gatherRecordPage(id, date_from, date_to, after_date, after_rowid, page_size + 1, &page);
+
+	std::string next = "";
+	if (page.records.size() > static_cast<std::size_t>(page_size)) {
+		page.records.pop_back();
+		page.rowids.pop_back();
+		next = std::to_string(page.records.back().date_) + CURSOR_SEPARATOR + std::to_string(page.rowids.back());
+	}
+
+	response.accept();
+	response.addText(next);
+	response.addCount(static_cast<int>(page.records.size()));
+	for (auto&& record : page.records) {
+		messageRecord(record, response);
+	}
 }
 
-void BankServer::previousTargets(std::string& incoming, std::string& message)
+void BankServer::previousTargets(const Request& request, ResponseWriter& response)
 {
-	std::string mail = "";
-	std::string name = "";
-
-	fillField(incoming, mail, SEPARATOR);
-	fillField(incoming, name, END);
+	std::string_view mail = request.text(0);
+	std::string_view name = request.text(1);
 
+	long long id = cache.findAccountId(mail, name);
 	std::vector<user_pair> pairs;
 	std::vector<user_pair>* pairs_ptr = &pairs;
-	database.gatherPrevious(mail, name, pairs_ptr);
+	database.gatherPrevious(id, pairs_ptr);
 
-	std::string result = "";
-	int count = 0;
+	response.accept();
+	response.addCount(static_cast<int>(pairs.size()));
 	for (auto&& pair : pairs) {
-		if (count > 0) {
-			result += SEPARATOR;
-		}
+		response.addText(pair.email_source);
+		response.addText(pair.email_target);
+		response.addText(pair.name_source);
+		response.addText(pair.name_target);
+	}
+}
 
-		result += pair.email_source + SEPARATOR;
-		result += pair.email_target + SEPARATOR;
-		result += pair.name_source + SEPARATOR;
-		result += pair.name_target;
+void BankServer::balanceAsOf(const Request& request, ResponseWriter& response)
+{
+	std::string_view mail = request.text(0);
+	std::string_view name = request.text(1);
+	int date = request.day(2);
 
-		count += 1;
+	Account acc{};
+	if (!cache.findAccount(mail, name, AccountCache::Changes(), acc)) {
+		response.reject("Account does not exist");
+		return;
 	}
 
-	message += ACCEPTED;
-	message += std::to_string(count) + SEPARATOR;
-	message += result;
+	// An account whose balance never changed still has the one it was created with
+	Money balance;
+	if (!database.getBalance(acc.id_, date, balance)) {
+		balance = acc.balance_;
+	}
+
+	response.accept();
+	response.addText(acc.mail_);
+	response.addText(acc.name_);
+	response.addDate(date);
+	response.addAmount(balance);
 }
 
-void BankServer::messageAccounts(const User& user, std::string& message)
+void BankServer::statistics(ResponseWriter& response)
 {
-	int count = user.accounts_.size();
-	message += std::to_string(count) + SEPARATOR;
+	response.accept();
+	response.addText(std::to_string(admission.connections));
+	response.addText(std::to_string(admission.requests));
+	response.addText(std::to_string(admission.rejected_connections));
+	response.addText(std::to_string(admission.rejected_requests));
+	response.addText(std::to_string(admission.timeouts));
+}
 
-	int i = 1;
+void BankServer::messageAccounts(const User& user, ResponseWriter& response)
+{
+	response.addCount(static_cast<int>(user.accounts_.size()));
 	for (auto&& acc : user.accounts_) {
-		message += acc.name_ + SEPARATOR;
-		message += std::to_string(acc.balance_) + SEPARATOR;
-		message += getStateString(acc.state_);
-
-		if (i != count) {
-			message += SEPARATOR;
-		}
-
-		i++;
+		response.addText(acc.name_);
+		response.addAmount(acc.balance_);
+		response.addText(getStateString(acc.state_));
 	}
 }
 
-void BankServer::fillField(std::string& source, std::string& field, const char separator)
+void BankServer::messageRecord(const Record& record, ResponseWriter& response)
 {
-	int i = 0;
-	for (;;) {
-		if (source[i] == separator) {
-			break;
-		}
-		field += source[i];
-		i++;
-	}
-	source.erase(0, i+1);
+	response.addText(record.account_source_);
+	response.addText(record.account_target_);
+	response.addText(record.name_source_);
+	response.addText(record.name_target_);
+	response.addAmount(record.amount_);
+	response.addDate(record.date_);
 }
 
 std::string BankServer::getStateString(State state)
@@ -744,132 +996,81 @@ std::string BankServer::getStateString(State state)
 	}
 }
 
-std::time_t BankServer::timeFromString(const std::string& time_str)
+void BankServer::processRecurringPayment(const RecurringPayment& rp, Database& database,
+	const AccountCache& cache, AccountCache::Changes& changes)
 {
-	struct std::tm tm = {0};
-	std::istringstream ss(time_str);
-	// %F doesn't work for some reason
-	ss >> std::get_time(&tm, "%Y-%m-%d");	
-	std::time_t time = mktime(&tm);
-	return time;
-}
-
-std::string BankServer::stringFromTime(std::tm* time)
-{
-	std::time_t time_time_t = mktime(time);
-	tm* time_corrected = localtime(&time_time_t);
-
-	char buffer[32];
-	std::strftime(buffer, 32, "%Y-%m-%d", time_corrected);
-	std::string time_str(buffer);
-	return time_str;
-}
-
-void BankServer::processRecurringPayment(const RecurringPayment& rp, Database& database)
-{
-	std::time_t next_payment = BankServer::timeFromString(rp.next_payment_);
-	std::time_t now = std::time(nullptr);
-
 	// We don't care about payments that are in future
-	double time_diff = std::difftime(next_payment, now);
-	if (time_diff <= 0) {
+	int today = currentDate();
+	if (rp.next_payment_ <= today) {
 		if (rp.type_ == PaymentType::standing_order) {
-			User user_current = database.getUser(rp.account_source_);
-			User user_selected = database.getUser(rp.account_target_);
-
 			Account acc_current{};
 			Account acc_selected{};
-
-			bool current_exists = false;
-			for (auto&& acc : user_current.accounts_) {
-				if (acc.name_ == rp.name_source_) {
-					current_exists = true;
-					acc_current = acc;
-				}
-			}
-
-			bool selected_exists = false;
-			for (auto&& acc : user_selected.accounts_) {
-				if (acc.name_ == rp.name_target_) {
-					selected_exists = true;
-					acc_selected = acc;
-				}
-			}
+			bool current_exists = cache.findAccount(rp.account_source_, rp.name_source_, changes, acc_current);
+			bool selected_exists = cache.findAccount(rp.account_target_, rp.name_target_, changes, acc_selected);
 
 			// Improper recurring payment
 			if (!current_exists || !selected_exists) {
 				return;
 			}
 			
-			if (user_selected.correct_ && user_current.correct_) {
-				if (acc_current.state_ == State::ok) {
-					double user_current_new_balance = acc_current.balance_ - rp.amount_;
-					double user_selected_new_balance = acc_selected.balance_ + rp.amount_;
-
-					// if new balance of an account would change it's state, change the state and inform user
-					if ((user_current_new_balance < BLOCK_LIMIT) && (acc_current.state_ == State::ok)) {
-						database.changeValueAccount(user_current.mail_, acc_current.name_, "state", 
-							std::to_string(Database::DB_USER_BLOCKED));
-						acc_current.state_ = State::blocked;
-						emailStateChanged(user_current.mail_, acc_current.name_, acc_current.state_);
-					}
-
-					// if new balance of an account would change it's state, change the state and inform user
-					if ((user_selected_new_balance >= BLOCK_LIMIT) && (acc_selected.state_ == State::blocked)) {
-						database.changeValueAccount(user_selected.mail_, acc_selected.name_, "state", 
-							std::to_string(Database::DB_USER_OK));
-						acc_selected.state_ = State::ok;
-						emailStateChanged(user_selected.mail_, acc_selected.name_, acc_selected.state_);
-					}
-
-					database.changeValueAccount(user_current.mail_, acc_current.name_, "balance", std::to_string(user_current_new_balance));
-					database.changeValueAccount(user_selected.mail_, acc_selected.name_, "balance", std::to_string(user_selected_new_balance));
-
-					Record record{user_current.mail_, user_selected.mail_, acc_current.name_, acc_selected.name_, rp.amount_, currentDate()};
-					database.addRecord(record);
+			if (acc_current.state_ == State::ok) {
+				debit(database, acc_current, rp.amount_, today, changes);
+
+				// A payment to the same account gets it back as debited
+				if (acc_selected.id_ == acc_current.id_) {
+					acc_selected = acc_current;
+				}
+				credit(database, acc_selected, rp.amount_, today, changes);
+				if (acc_selected.id_ == acc_current.id_) {
+					acc_current = acc_selected;
 				}
-			}
 
-			tm* next_payment_new = localtime(&next_payment);
-			addInterval(rp, next_payment_new);
+				Record record{acc_current.mail_, acc_selected.mail_, acc_current.name_, acc_selected.name_, rp.amount_,
+					today, acc_current.id_, acc_selected.id_};
+				database.addRecord(record);
+			}
 
-			std::string next_payment_str = stringFromTime(next_payment_new);
-			database.updateRecurringPayment(user_current.mail_, acc_current.name_, next_payment_str);
+			database.updateRecurringPayment(rp.source_id_, addInterval(rp, rp.next_payment_));
 
 		}
 		else if (rp.type_ == PaymentType::direct_debit) {
-			tm* next_payment_new = localtime(&next_payment);
-			addInterval(rp, next_payment_new);
-			std::time_t next_payment_new_corrected = mktime(next_payment_new);
-			time_diff = std::difftime(next_payment_new_corrected, now);
+			int next_payment = addInterval(rp, rp.next_payment_);
 
 			// This direct debit wasn't used in the time of the interval, so we update next payment
-			if (time_diff <= 0) {
-				std::string next_payment_str = stringFromTime(next_payment_new);
-				database.updateRecurringPayment(rp.account_source_, rp.name_source_, next_payment_str);
+			if (next_payment <= today) {
+				database.updateRecurringPayment(rp.source_id_, next_payment);
 			}
 		}
 	}
 }
 
-void BankServer::addInterval(const RecurringPayment& payment, tm* time)
+int BankServer::addInterval(const RecurringPayment& payment, int date)
 {
+	int year = 0;
+	unsigned int month = 0;
+	unsigned int day = 0;
+	Protocol::civilFromDays(date, year, month, day);
+
+	// A day past the end of the month continues into the next one
 	switch (payment.interval_)
 	{
 	case Interval::day:
-		time->tm_mday = time->tm_mday + 1;
-		break;
+		return date + 1;
 	case Interval::week:
-		time->tm_mday = time->tm_mday + 7;
-		break;
+		return date + 7;
 	case Interval::month:
-		time->tm_mon = time->tm_mon + 1;
-		break;
+		return (month == 12) ? Protocol::daysFromCivil(year + 1, 1, day) : Protocol::daysFromCivil(year, month + 1, day);
 	case Interval::year:
-		time->tm_year = time->tm_year + 1;
-		break;
+		return Protocol::daysFromCivil(year + 1, month, day);
 	default:
-		break;
+		return date;
+	}
+}
+
+void BankServer::applyChanges(const AccountCache::Changes& changes)
+{
+	for (auto&& account : cache.apply(changes)) {
+		emailStateChanged(account.mail_, account.name_, account.state_);
 	}
 }
 
@@ -887,19 +1088,18 @@ void BankServer::emailStateChanged(const std::string& email, const std::string&
 	message += "Dear user,\n";
 	message += "The status of your account " + name + " has changed to: " + state_str + "\n";
 
-	// Failing to send an email isn't a reason to drop the whole server
-	MailClient mail_client{};
-	try {
-		mail_client.sendEmail("<" + email + ">", message);
-	}
-	catch (mail_exception& e) {
-		std::cerr << e.what() << std::endl;
-	}
+	mail.post("<" + email + ">", message);
 }
 
-std::string BankServer::currentDate()
+int BankServer::currentDate()
 {
 	std::time_t now = std::time(nullptr);
-	tm* now_tm = localtime(&now);
-	return stringFromTime(now_tm);
+	// Sessions and the recurring payments ask for the date at once, localtime shares its result
+	std::tm now_tm{};
+#ifdef _WIN32
+	localtime_s(&now_tm, &now);
+#else
+	localtime_r(&now, &now_tm);
+#endif
+	return Protocol::daysFromCivil(now_tm.tm_year + 1900, now_tm.tm_mon + 1, now_tm.tm_mday);
 }
@@ -2,8 +2,14 @@
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
+#include <atomic>
+#include "account_locks.h"
+#include "admission.h"
 #include "database.h"
-#include "mail_client.h"
+#include "group_commit.h"
+#include "account_cache.h"
+#include "mail_queue.h"
+#include "protocol.h"
 
 #ifndef BANK_SERVER_H_
 #define BANK_SERVER_H_
@@ -20,110 +26,201 @@ class BankServer
 public:
 	/**
 	 * Empty database object; setup is done in `run` method.
+	 * @param[in]	thread_count	Number of threads serving the requests
+	 * @param[in]	limits			Limits of connections and requests served at once
 	 */
-	BankServer() : database() {};
+	BankServer(unsigned int thread_count = DEFAULT_THREAD_COUNT, const AdmissionLimits& limits = AdmissionLimits())
+		: database(), group_commit(), accounts(), cache(), mail(), admission(limits), thread_count(thread_count) {};
 
 	/**
 	 * Periodically execute recurring payments (if neccessary). Queries the database for all
-	 * recurring payments, checks whether they are due, and if yes, executes them.
-	 * @param[in]	current_path	Path to the executable
+	 * recurring payments, checks whether they are due, and if yes, executes them. Each payment
+	 * is processed while holding the locks of both its accounts and committed by `commitOperation`,
+	 * like the operations of the requests; the cache is written through.
 	 * @param[out]	done			True if an exception occured and the thread has terminated
 	 */
-	static void recurringPaymentExecute(std::atomic<bool>& done, const std::string& current_path);
+	void recurringPaymentExecute(std::atomic<bool>& done);
 
 	/**
-	 * Database query callback, creates a recurring payment object for each recurring payment in database.
-	 * @param[out]	data		List of recurring payment unique pointers
-	 * @param[in]	argc		Number of columns
-	 * @param[in]	argv		Values in columns
-	 * @param[in]	azColName	Column names
+	 * Setup database, issue periodical payment checks and listen for requests. A secondary thread
+	 * periodically executes due recurring payments (direct debit, standing order), while a pool of
+	 * `thread_count` threads (including the calling one) accepts connections and serves them
+	 * asynchronously. Requests are then decoded and forwarded to `serve`.
+	 * @param[in]	current_path	Path to the executable
 	 */
-	static int recurringPaymentsCallback(void* data, int argc, char** argv, char** azColName);
+	void run(const std::string& current_path);
 
 	/**
-	 * Setup database, issue periodical payment checks and listen for requests. There are two threads
-	 * running (second one spawned in `run` method): secondary thread that periodically executes due
-	 * recurring payments (direct debit, standing order) and primary thread, that listens on TCP port
-	 * for incoming requests. Requests are then forwarded to `createResponseMessage`.
+	 * Setup database and open its connections, one reader per serving thread and one for the
+	 * recurring payments, and load the accounts into the cache (`run` does this itself, requests
+	 * may be served right away after it).
 	 * @param[in]	current_path	Path to the executable
 	 */
-	void run(const std::string& current_path);
+	void setup(const std::string& current_path);
+
+	/**
+	 * Serve a request of the text protocol and create response.
+	 * @param[in]	incoming	The request
+	 * @param[out]	message		The response
+	 */
+	void createResponseMessage(std::string_view incoming, ResponseBuilder& message);
 
 	/**
-	 * Create time_t object from string representation.
-	 * @param[in]	time_str	String representation of time
-	 * @returns					Corresponding time_t object
+	 * Serve a decoded request, the response is created through the writer of the protocol
+	 * the request came in.
+	 * @param[in]	request		The request
+	 * @param[out]	response	The response
 	 */
-	static std::time_t timeFromString(const std::string& time_str);
+	void serve(const Request& request, ResponseWriter& response);
 
 	/**
-	 * Create string representing time from tm object.
-	 * @param[in]	time	Time object
-	 * @returns				String representation of time
+	 * Split a request of the text protocol into fields in a single pass, without copying them.
+	 * @param[in]	incoming	The request (must outlive the result)
+	 * @returns					The request with all fields of text type
 	 */
-	static std::string stringFromTime(std::tm* time);
+	static Request parseRequest(std::string_view incoming);
+
+	/**
+	 * Split the next operation of a batch in the text protocol: the opcode is a field of its own,
+	 * the fields of the operation follow.
+	 * @param[in,out]	operations	Operations not parsed yet, the parsed one is removed
+	 * @returns						The operation
+	 */
+	static Request parseOperation(std::string_view& operations);
+
+	/**
+	 * Number of fields of an operation allowed in a batch.
+	 * @param[in]	opcode	Opcode of the operation
+	 * @returns				Number of fields
+	 */
+	static std::size_t operationFields(int opcode);
 
 	/**
 	 * Execute recurring payment and update the next date of execution if it is due.
 	 * @param[in]	payment		Payment to be (potentially) executed
 	 * @param[in]	database	Bank database
+	 * @param[in]	cache		Accounts as committed
+	 * @param[out]	changes		Accounts changed by the payment, to be applied once it's committed
 	 */
-	static void processRecurringPayment(const RecurringPayment& payment, Database& database);
+	static void processRecurringPayment(const RecurringPayment& payment, Database& database,
+		const AccountCache& cache, AccountCache::Changes& changes);
 
 	/**
-	 * Add the recurring payment interval to the time object.
+	 * Add the recurring payment interval to a date.
 	 * @param[in]	payment		Payment with interval
-	 * @param[out]	time		Time to be extended by interval
+	 * @param[in]	date		Date to be extended by interval (days since 1970-01-01)
+	 * @returns					The extended date
+	 */
+	static int addInterval(const RecurringPayment& payment, int date);
+
+	/**
+	 * Apply the changes of a committed operation to the cache and inform the owners of the accounts
+	 * whose state they changed. The emails are only queued, the mail thread sends them once the
+	 * caller has released the locks of the accounts; only what was committed is reported.
+	 * @param[in]	changes		Changes of the operation
 	 */
-	static void addInterval(const RecurringPayment& payment, tm* time);
+	void applyChanges(const AccountCache::Changes& changes);
 
 	/**
-	 * Send email to user with given email address informing him his account state has changed.
+	 * Queue an email to user with given email address informing him his account state has changed.
 	 * @param[in]	email	Email address of user
+	 * @param[in]	name	Name of the account
 	 * @param[in]	state	New state of his account
 	 */
-	static void emailStateChanged(const std::string& email, const std::string& name, State state);
+	void emailStateChanged(const std::string& email, const std::string& name, State state);
 
 	/**
-	 * Get current date.
-	 * @returns				String representation of current date
+	 * Number of groups the writer thread has committed so far.
+	 * @returns				The number of groups, zero if write operations aren't committed in groups
 	 */
-	static std::string currentDate();
+	std::size_t committedGroups() const { return group_commit ? group_commit->groups.load() : 0; };
+
+	/**
+	 * Get current (local) date.
+	 * @returns				Number of days since 1970-01-01
+	 */
+	static int currentDate();
 
 	// Account with less money than BLOCK_LIMIT will have its state changed to blocked
-	static const double BLOCK_LIMIT;
+	static const Money BLOCK_LIMIT;
 
-private:
 	// Network communication constants
 	static const char SEPARATOR = ';';
 	static const char END = '\n';
-	const std::string ACCEPTED = "SUC";
-	const std::string REJECTED = "ERR";
+	static const std::string ACCEPTED;
+	static const std::string REJECTED;
+	static const unsigned short PORT = 13;
+
+	// Batch of transfers and deposits: mode and number of operations precede the operations
+	static const int BATCH = 13;
+	static const std::size_t BATCH_HEADER_FIELDS = 2;
+	static const int MAX_BATCH_SIZE = 10'000;
 
+	// A rejected operation rolls back the whole batch / only the operation itself
+	static const int BATCH_ALL_OR_NOTHING = 0;
+	static const int BATCH_BEST_EFFORT = 1;
+
+	// Cursor of a history page: date (days since 1970-01-01) and rowid of the last record, separated by
+	// CURSOR_SEPARATOR
+	static const char CURSOR_SEPARATOR = '/';
+	static const int MAX_PAGE_SIZE = 1'000;
+
+	// Number of threads serving requests if not specified otherwise; a thread blocks while it waits for
+	// the locks of accounts and for its commit, so there are enough of them to keep serving the requests
+	// of other accounts meanwhile (and to fill a group of the group commit)
+	static const unsigned int DEFAULT_THREAD_COUNT = 16;
+
+private:
 	// Object for database manipulation
 	Database database;
 
+	// Writer thread committing the operations together, unless each operation commits on its own
+	std::unique_ptr<GroupCommit> group_commit;
+
+	// Operations changing an account balance hold its lock
+	AccountLocks accounts;
+
+	// Users and accounts as committed, requests read them instead of the database
+	AccountCache cache;
+
+	// Mail thread sending the emails of the requests and the recurring payments
+	MailQueue mail;
+
+	// Limits of the work accepted at once
+	Admission admission;
+
+	// Number of threads running the io_context
+	unsigned int thread_count;
+
 	/**
-	 * Read data from socket and write them to string.
-	 * @param[in]	socket		Socket for network communication with client
-	 * @param[out]	incoming	String to store the request
+	 * Asynchronously accept a connection and start a session for it; the next accept is issued
+	 * right away so that a slow client never delays the others.
+	 * @param[in]	acceptor	Acceptor listening on the server port
 	 */
-	void readIncoming(tcp::socket& socket, std::string& incoming);
+	void startAccept(tcp::acceptor& acceptor);
 
 	/**
-	 * Serve the request and create response.
-	 * @param[in]	incoming	The request
-	 * @param[out]	message		The response
+	 * Reply to a connection over the limit with the busy reason and close it, without reading
+	 * anything from it.
+	 * @param[in]	socket		The connection
+	 */
+	void rejectConnection(tcp::socket socket);
+
+	/**
+	 * Periodically check whether the recurring payment thread is still running and stop serving
+	 * requests if it is not.
+	 * @param[in]	timer		Timer used for scheduling the checks
+	 * @param[in]	done		True if the recurring payment thread has terminated
+	 * @param[in]	io_context	Context to be stopped
 	 */
-	void createResponseMessage(std::string& incoming, std::string& message);
+	void watchRecurringThread(asio::steady_timer& timer, std::atomic<bool>& done, asio::io_context& io_context);
 
 	/**
-	 * Load (and delete) all characters until separator from source string into field string.
-	 * @param[in]	source		Input string
-	 * @param[out]	field		Output string
-	 * @param[in]	separator	Separator 
+	 * Periodically checkpoint the write-ahead log of the database, in the interval given by its
+	 * config (not at all if the interval is zero).
+	 * @param[in]	timer		Timer used for scheduling the checkpoints
 	 */
-	void fillField(std::string& source, std::string& field, const char separator);
+	void scheduleCheckpoint(asio::steady_timer& timer);
 
 	/**
 	 * Get string representation of state.
@@ -135,83 +232,192 @@ private:
 	/**
 	 * Create and log in new user. Attempts to add new user to the database
 	 * and informs client whether it was successful.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 */
-	void registration(std::string& incoming, std::string& message);
+	void registration(const Request& request, ResponseWriter& response);
 
 	/**
 	 * Log in user. Check whether given user exists and whether the
 	 * password is correct.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 */
-	void login(std::string& incoming, std::string& message);
+	void login(const Request& request, ResponseWriter& response);
 
 	/**
 	 * Add funds to the user's account. Increases the accounts
 	 * balance by specified amount.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
+	 */
+	void addMoney(const Request& request, ResponseWriter& response);
+
+	/**
+	 * Run the statements of a business operation in a transaction, so they are committed all at once.
+	 * In the group commit mode the operation is handed to the writer thread and this waits until the
+	 * group it joined is committed; otherwise it has a transaction of its own. Every write of the server
+	 * goes through here, so the writer connection is only ever used by one of the two.
+	 * @param[in]	operation	The operation, returns whether its changes are to be kept
+	 * @returns					Whether the changes were kept
 	 */
-	void addMoney(std::string& incoming, std::string& message);
+	bool commitOperation(const GroupCommit::Operation& operation);
+
+	/**
+	 * Add funds to the user's account, the caller holds the lock of the account.
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
+	 * @param[in]	database	Database the changes are written to
+	 * @param[out]	changes		Accounts changed, to be applied to the cache once committed
+	 */
+	void executeAddMoney(const Request& request, ResponseWriter& response, Database& database,
+		AccountCache::Changes& changes);
 
 	/**
 	 * Money transfer between accounts. If all the criteria are met
 	 * (eg accounts exists) the balance of the source account is lowered by
 	 * given amount and the balance of the target account is increased by
 	 * the same amount.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
+	 * @param[in]	direction	Direction of transfer (from user / to user)
+	 */
+	void transfer(const Request& request, ResponseWriter& response, const std::string& direction);
+
+	/**
+	 * Money transfer between accounts, the caller holds the locks of both accounts.
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 * @param[in]	direction	Direction of transfer (from user / to user)
+	 * @param[in]	database	Database the changes are written to
+	 * @param[out]	changes		Accounts changed, to be applied to the cache once committed
+	 */
+	void executeTransfer(const Request& request, ResponseWriter& response, const std::string& direction,
+		Database& database, AccountCache::Changes& changes);
+
+	/**
+	 * Take money from an account as one leg of an operation, the caller holds its lock. The
+	 * balance and state are written by a single statement; an account left below BLOCK_LIMIT is
+	 * blocked, its owner is informed once the operation is committed (see `applyChanges`).
+	 * @param[in]		database	Database the change is written to
+	 * @param[in,out]	account		The account as changed so far, updated
+	 * @param[in]		amount		Amount taken
+	 * @param[in]		date		Day of the operation (days since 1970-01-01)
+	 * @param[out]		changes		Accounts changed, to be applied to the cache once committed
+	 */
+	static void debit(Database& database, Account& account, Money amount, int date, AccountCache::Changes& changes);
+
+	/**
+	 * Give money to an account as one leg of an operation, the caller holds its lock. The
+	 * balance and state are written by a single statement; a blocked account getting back to
+	 * BLOCK_LIMIT is unblocked, its owner is informed once the operation is committed.
+	 * @param[in]		database	Database the change is written to
+	 * @param[in,out]	account		The account as changed so far, updated
+	 * @param[in]		amount		Amount given
+	 * @param[in]		date		Day of the operation (days since 1970-01-01)
+	 * @param[out]		changes		Accounts changed, to be applied to the cache once committed
 	 */
-	void transfer(std::string& incoming, std::string& message, const std::string& direction);
+	static void credit(Database& database, Account& account, Money amount, int date, AccountCache::Changes& changes);
+
+	/**
+	 * Execute a batch of transfers and deposits in a single database transaction, while holding
+	 * the locks of all the accounts involved. In the all-or-nothing mode the first rejected
+	 * operation rolls back the batch and the batch is rejected; in the best-effort mode the
+	 * rejected operations are skipped. The request carries the mode and the number of operations,
+	 * followed by each operation as its opcode and fields (e.g. `131;2;03;a;b;x;y;10;07;a;x;5`).
+	 * The response lists the outcome of each operation.
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
+	 */
+	void batch(const Request& request, ResponseWriter& response);
+
+	/**
+	 * Execute a single operation of a batch.
+	 * @param[in]	operation	The operation
+	 * @param[out]	response	Response
+	 * @param[in]	database	Database of the batch transaction
+	 * @param[out]	changes		Accounts changed by the batch so far, to be applied once committed
+	 */
+	void executeOperation(const Request& operation, ResponseWriter& response, Database& database,
+		AccountCache::Changes& changes);
 
 	/**
 	 * Create a recurring payment.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 * @param[in]	tp			Type of payment (Direct debit / standing order)
 	 */
-	void recurringPayment(std::string& incoming, std::string& message, PaymentType pt);
+	void recurringPayment(const Request& request, ResponseWriter& response, PaymentType pt);
 
 	/**
 	 * Send client a list of accounts corresponding to given email.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 */
-	void listAccounts(std::string& incoming, std::string& message);
+	void listAccounts(const Request& request, ResponseWriter& response);
 
 	/**
 	 * Create a new account for user with given name.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 */
-	void addAccount(std::string& incoming, std::string& message);
+	void addAccount(const Request& request, ResponseWriter& response);
 
 	/**
 	 * Send client a sorted sequence of transactions such that the user
 	 * was either payer or payee.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
+	 */
+	void transactionHistory(const Request& request, ResponseWriter& response);
+
+	/**
+	 * Send client one page of the transaction history. The page starts after the position given
+	 * by the cursor (empty for the first page) and the response carries the cursor of the next
+	 * page (empty if this is the last one), so only a page of records is ever held in memory.
+	 * A cursor that isn't two whole numbers and an account that doesn't exist are rejected.
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 */
-	void transactionHistory(std::string& incoming, std::string& message);
+	void transactionPage(const Request& request, ResponseWriter& response);
 
 	/**
 	 * Send client a sequence of accounts (email + name) such that the user
 	 * has sent a transaction to these accounts before.
-	 * @param[in]	incoming	Request
-	 * @param[out]	message		Response
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
 	 */
-	void previousTargets(std::string& incoming, std::string& message);
+	void previousTargets(const Request& request, ResponseWriter& response);
 
 	/**
-	 * Append message with sequence of accounts corresponding to given
+	 * Send client the balance of an account at the end of a given day, read from the end-of-day
+	 * balances instead of the history.
+	 * @param[in]	request		Request
+	 * @param[out]	response	Response
+	 */
+	void balanceAsOf(const Request& request, ResponseWriter& response);
+
+	/**
+	 * Send client the admission counters: open connections, requests in progress, rejected
+	 * connections, rejected requests and connections closed after a timeout.
+	 * @param[out]	response	Response
+	 */
+	void statistics(ResponseWriter& response);
+
+	/**
+	 * Append response with sequence of accounts corresponding to given
 	 * user.
 	 * @param[in]	user		User whose accounts we would like to know
-	 * @param[out]	message		String augmented by said accounts
+	 * @param[out]	response	Response augmented by said accounts
+	 */
+	void messageAccounts(const User& user, ResponseWriter& response);
+
+	/**
+	 * Append response with a record of the transaction history.
+	 * @param[in]	record		The record
+	 * @param[out]	response	Response augmented by the record
 	 */
-	void messageAccounts(const User& user, std::string& message);
+	void messageRecord(const Record& record, ResponseWriter& response);
 };
 
 #endif
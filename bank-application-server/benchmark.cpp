@@ -0,0 +1,387 @@
+// Define either here or when building, to count the heap allocations (this replaces the global
+// operator new and delete of the whole program, so the server built for production leaves it out)
+// #define COUNT_ALLOCATIONS
+
+#include "benchmark.h"
+#include "bank_server.h"
+#include "transaction.h"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Results of the measured operations end up here, so that they are not optimized out
+static volatile std::size_t sink = 0;
+
+// Number of heap allocations made by the current thread
+static thread_local std::size_t allocations = 0;
+
+#ifdef COUNT_ALLOCATIONS
+// Allocations are counted for the whole program, the overhead is a single increment
+void* operator new(std::size_t size)
+{
+	allocations++;
+	if (void* p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+// Compilers call the sized form when they know the size, it must match the replaced new as well
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+#endif
+
+/**
+ * Count heap allocations made by an operation.
+ * @param[in]	operation	The operation
+ * @returns					Number of allocations, always zero unless COUNT_ALLOCATIONS is defined
+ */
+template <typename Operation>
+static std::size_t countAllocations(Operation operation)
+{
+	std::size_t before = allocations;
+	sink = sink + operation();
+	return allocations - before;
+}
+
+/**
+ * Measure average duration of an operation.
+ * @param[in]	iterations	Number of repetitions
+ * @param[in]	operation	The operation, returns a value depending on its result
+ * @returns					Nanoseconds per operation
+ */
+template <typename Operation>
+static double measure(std::size_t iterations, Operation operation)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < iterations; i++) {
+		sink = sink + operation();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+void Benchmark::run(std::ostream& out)
+{
+	out << "Protocol benchmark, " << iterations << " iterations per case" << std::endl;
+#ifndef COUNT_ALLOCATIONS
+	out << "Allocations aren't counted, build with COUNT_ALLOCATIONS defined to count them" << std::endl;
+#endif
+	out << std::left << std::setw(24) << "case"
+		<< std::right << std::setw(10) << "v1 bytes" << std::setw(10) << "v1 ns" << std::setw(10) << "v1 alloc"
+		<< std::setw(10) << "v2 bytes" << std::setw(10) << "v2 ns" << std::setw(10) << "v2 alloc" << std::endl;
+
+	compareRequest(out, "login request", "01alice@example.com;secret\n", "SS");
+	compareRequest(out, "add money request", "07alice@example.com;savings;250.75\n", "SSA");
+	compareRequest(out, "transfer request",
+		"03alice@example.com;bob@example.com;savings;checking;1234.56\n", "SSSSA");
+	compareRequest(out, "standing order request",
+		"06alice@example.com;bob@example.com;savings;checking;99.99;2030-01-01;1\n", "SSSSADI");
+	compareRequest(out, "history request", "09alice@example.com;savings;2020-01-01;2020-12-31\n", "SSDD");
+
+	compareHistory(out, 1);
+	compareHistory(out, 100);
+
+	measureDatabase(out);
+	measureDecoding(out);
+	measureGroupCommit(out);
+}
+
+void Benchmark::compareRequest(std::ostream& out, const std::string& name, const std::string& text,
+	const std::string& schema)
+{
+	std::string frame = encodeFrame(text, schema);
+
+	auto parse_text = [&]() {
+		return readFields(BankServer::parseRequest(text), schema);
+	};
+	auto parse_binary = [&]() {
+		return readFields(Protocol::decodeRequest(frame), schema);
+	};
+
+	report(out, name, text.size(), measure(iterations, parse_text), countAllocations(parse_text),
+		Protocol::LENGTH_SIZE + frame.size(), measure(iterations, parse_binary), countAllocations(parse_binary));
+}
+
+void Benchmark::compareHistory(std::ostream& out, int records)
+{
+	Request request{};
+	request.opcode_ = 9;
+
+	// Same calls as `BankServer::transactionHistory` makes
+	int date = Protocol::daysFromDate("2020-06-15");
+	auto build = [records, date](ResponseWriter& response) {
+		response.accept();
+		response.addCount(records);
+		for (int i = 0; i < records; i++) {
+			response.addText("alice@example.com");
+			response.addText("bob@example.com");
+			response.addText("savings");
+			response.addText("checking");
+			response.addAmount(Money(123456 + i * Money::SCALE));
+			response.addDate(date);
+		}
+	};
+
+	// A new builder for every response, as the session does
+	std::size_t text_size = 0;
+	auto build_text = [&]() {
+		ResponseBuilder message;
+		TextResponseWriter response(message);
+		build(response);
+		message.append(BankServer::END);
+		return text_size = message.size();
+	};
+
+	std::size_t binary_size = 0;
+	auto build_binary = [&]() {
+		ResponseBuilder frame;
+		BinaryResponseWriter response(frame, request);
+		build(response);
+		response.finish();
+		return binary_size = frame.size();
+	};
+
+	report(out, "history response (" + std::to_string(records) + ")",
+		text_size, measure(iterations, build_text), countAllocations(build_text),
+		binary_size, measure(iterations, build_binary), countAllocations(build_binary));
+}
+
+void Benchmark::measureDatabase(std::ostream& out)
+{
+	// The server finds the database relative to its executable
+	fs::path root = fs::temp_directory_path() / "bank-benchmark";
+	fs::remove_all(root);
+	fs::create_directories(root / "db");
+
+	{
+		BankServer server(1);
+		server.setup((root / "bin" / "server").string());
+
+		auto serve = [&server](const std::string& text) {
+			ResponseBuilder message;
+			server.createResponseMessage(text, message);
+			return message.size();
+		};
+
+		serve("02alice@example.com;secret\n");
+		serve("02bob@example.com;secret\n");
+		serve("08alice@example.com;savings\n");
+		serve("08bob@example.com;checking\n");
+
+		out << std::endl << "Database benchmark, " << DATABASE_ITERATIONS << " iterations per case" << std::endl;
+		out << std::left << std::setw(24) << "case"
+			<< std::right << std::setw(10) << "us" << std::setw(10) << "opens" << std::endl;
+
+		const std::pair<std::string, std::string> cases[] = {
+			{ "login", "01alice@example.com;secret\n" },
+			{ "add money", "07alice@example.com;savings;10\n" },
+			{ "transfer", "03alice@example.com;bob@example.com;savings;checking;1\n" },
+			{ "history page", "14alice@example.com;savings;2000-01-01;2100-01-01;50;\n" },
+			{ "balance as of", "15alice@example.com;savings;2100-01-01\n" },
+		};
+		for (auto&& c : cases) {
+			std::size_t opens = ConnectionPool::opens;
+			double ns = measure(DATABASE_ITERATIONS, [&]() { return serve(c.second); });
+			double opens_per_request = static_cast<double>(ConnectionPool::opens - opens) / DATABASE_ITERATIONS;
+
+			out << std::left << std::setw(24) << c.first << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(10) << ns / 1000 << std::setw(10) << opens_per_request << std::endl;
+		}
+	}
+
+	fs::remove_all(root);
+}
+
+void Benchmark::measureDecoding(std::ostream& out)
+{
+	fs::path root = fs::temp_directory_path() / "bank-benchmark";
+	fs::remove_all(root);
+	fs::create_directories(root / "db");
+
+	{
+		Database database;
+		database.setup((root / "bin" / "server").string());
+		database.addAccount(Account("alice@example.com", "savings", Money(), State::ok));
+		database.addAccount(Account("bob@example.com", "checking", Money(), State::ok));
+		long long alice = database.getAccountId("alice@example.com", "savings");
+		long long bob = database.getAccountId("bob@example.com", "checking");
+
+		// Ten years of history, written at once
+		{
+			Transaction transaction(database);
+			for (int i = 0; i < HISTORY_RECORDS; i++) {
+				Record record{"alice@example.com", "bob@example.com", "savings", "checking", Money(100 + i),
+					i % 3650, alice, bob};
+				transaction.database().addRecord(record);
+			}
+			transaction.commit();
+		}
+
+		auto gather = [&]() {
+			RecordList records;
+			database.gatherRecords(alice, 0, 3650, &records);
+			return records.size();
+		};
+		double ns = measure(DECODING_ITERATIONS, gather) / HISTORY_RECORDS;
+		double allocations_per_record = static_cast<double>(countAllocations(gather)) / HISTORY_RECORDS;
+
+		out << std::endl << "History of " << HISTORY_RECORDS << " records, " << DECODING_ITERATIONS
+			<< " iterations" << std::endl;
+		out << std::left << std::setw(24) << "case"
+			<< std::right << std::setw(10) << "ns" << std::setw(10) << "alloc" << std::endl;
+		out << std::left << std::setw(24) << "read per record" << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << ns << std::setw(10) << allocations_per_record << std::endl;
+	}
+
+	fs::remove_all(root);
+}
+
+void Benchmark::measureGroupCommit(std::ostream& out)
+{
+	out << std::endl << "Concurrent deposits, " << BankServer::DEFAULT_THREAD_COUNT << " threads, "
+		<< DEPOSITS_PER_THREAD << " deposits each" << std::endl;
+	out << std::left << std::setw(24) << "case"
+		<< std::right << std::setw(10) << "ops/s" << std::setw(10) << "commits" << std::endl;
+
+	const std::pair<std::string, std::string> cases[] = {
+		{ "NORMAL, own commit", "synchronous = NORMAL\n" },
+		{ "NORMAL, group commit", "synchronous = NORMAL\ngroup_commit_batch = 64\n" },
+		{ "FULL, own commit", "synchronous = FULL\n" },
+		{ "FULL, group commit", "synchronous = FULL\ngroup_commit_batch = 64\n" },
+	};
+	for (auto&& c : cases) {
+		std::size_t groups = 0;
+		double throughput = concurrentDeposits(c.second, groups);
+		std::size_t commits = (groups != 0) ? groups : BankServer::DEFAULT_THREAD_COUNT * DEPOSITS_PER_THREAD;
+
+		out << std::left << std::setw(24) << c.first << std::right << std::fixed << std::setprecision(0)
+			<< std::setw(10) << throughput << std::setw(10) << commits << std::endl;
+	}
+}
+
+double Benchmark::concurrentDeposits(const std::string& config, std::size_t& groups)
+{
+	fs::path root = fs::temp_directory_path() / "bank-benchmark";
+	fs::remove_all(root);
+	fs::create_directories(root / "db");
+	std::ofstream(root / "db" / "database.conf") << config;
+
+	double throughput = 0;
+	{
+		BankServer server;
+		server.setup((root / "bin" / "server").string());
+
+		auto serve = [&server](const std::string& text) {
+			ResponseBuilder message;
+			server.createResponseMessage(text, message);
+			return message.size();
+		};
+
+		// Every thread deposits to an account of its own, so they only compete for the commits
+		for (unsigned int t = 0; t < BankServer::DEFAULT_THREAD_COUNT; t++) {
+			serve("02user" + std::to_string(t) + "@example.com;secret\n");
+			serve("08user" + std::to_string(t) + "@example.com;savings\n");
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < BankServer::DEFAULT_THREAD_COUNT; t++) {
+			threads.emplace_back([&serve, t]() {
+				std::string deposit = "07user" + std::to_string(t) + "@example.com;savings;1\n";
+				for (std::size_t i = 0; i < DEPOSITS_PER_THREAD; i++) {
+					sink = sink + serve(deposit);
+				}
+			});
+		}
+		for (auto&& thread : threads) {
+			thread.join();
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		throughput = BankServer::DEFAULT_THREAD_COUNT * DEPOSITS_PER_THREAD
+			/ std::chrono::duration<double>(end - start).count();
+		groups = server.committedGroups();
+	}
+
+	fs::remove_all(root);
+	return throughput;
+}
+
+std::string Benchmark::encodeFrame(const std::string& text, const std::string& schema)
+{
+	Request request = BankServer::parseRequest(text);
+
+	std::string frame = "";
+	Protocol::putNumber(frame, request.opcode_, 1);
+	Protocol::putNumber(frame, 0, 4);
+	Protocol::putNumber(frame, Protocol::STATUS_ACCEPTED, 1);
+
+	for (std::size_t i = 0; i < request.size(); i++) {
+		switch (schema.at(i)) {
+		case 'A':
+			Protocol::putNumber(frame, static_cast<std::uint8_t>(FieldType::amount), 1);
+			Protocol::putNumber(frame, static_cast<std::uint64_t>(request.amount(i).cents()), 8);
+			break;
+		case 'D':
+			Protocol::putNumber(frame, static_cast<std::uint8_t>(FieldType::date), 1);
+			Protocol::putNumber(frame, static_cast<std::uint32_t>(request.day(i)), 4);
+			break;
+		case 'I':
+			Protocol::putNumber(frame, static_cast<std::uint8_t>(FieldType::integer), 1);
+			Protocol::putNumber(frame, request.integer(i), 4);
+			break;
+		default:
+			Protocol::putNumber(frame, static_cast<std::uint8_t>(FieldType::text), 1);
+			Protocol::putNumber(frame, request.text(i).size(), 2);
+			frame += request.text(i);
+		}
+	}
+
+	return frame;
+}
+
+std::size_t Benchmark::readFields(const Request& request, const std::string& schema)
+{
+	std::size_t result = 0;
+	for (std::size_t i = 0; i < schema.size(); i++) {
+		switch (schema[i]) {
+		case 'A':
+			result += static_cast<std::size_t>(request.amount(i).cents());
+			break;
+		case 'D':
+			result += request.day(i);
+			break;
+		case 'I':
+			result += request.integer(i);
+			break;
+		default:
+			result += request.text(i).size();
+		}
+	}
+	return result;
+}
+
+void Benchmark::report(std::ostream& out, const std::string& name, std::size_t text_size, double text_ns,
+	std::size_t text_allocations, std::size_t binary_size, double binary_ns, std::size_t binary_allocations)
+{
+	out << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << text_size << std::setw(10) << text_ns << std::setw(10) << text_allocations
+		<< std::setw(10) << binary_size << std::setw(10) << binary_ns << std::setw(10) << binary_allocations
+		<< std::endl;
+}
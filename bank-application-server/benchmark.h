@@ -0,0 +1,131 @@
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "protocol.h"
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+/**
+ * Micro benchmark of the request codecs. It needs neither the database nor the network: for a set
+ * of typical requests and responses it reports the size on the wire, the time spent parsing
+ * (requests) or building (responses) them and the number of heap allocations this takes (counted
+ * in a build with COUNT_ALLOCATIONS defined only), with the text protocol (v1) and the binary one (v2).
+ *
+ * A second part serves typical requests against a scratch database and reports the latency
+ * of a request and the number of database connections opened per request.
+ */
+class Benchmark
+{
+public:
+	/**
+	 * @param[in]	iterations	Number of times each case is repeated
+	 */
+	Benchmark(std::size_t iterations = DEFAULT_ITERATIONS) : iterations(iterations) {};
+
+	/**
+	 * Run all the cases and print the results.
+	 * @param[out]	out		Stream the results are written to
+	 */
+	void run(std::ostream& out);
+
+	// Number of repetitions if not specified otherwise
+	static const std::size_t DEFAULT_ITERATIONS = 100000;
+
+	// Number of repetitions of the database cases, each of them commits to the disk
+	static const std::size_t DATABASE_ITERATIONS = 200;
+
+	// Number of records in the history read by the decoding case
+	static const int HISTORY_RECORDS = 200000;
+
+	// Number of times the whole history is read
+	static const std::size_t DECODING_ITERATIONS = 5;
+
+	// Deposits each thread serves; there are as many threads as the server has by default, the most
+	// operations its sessions can have waiting for a commit at once
+	static const std::size_t DEPOSITS_PER_THREAD = 200;
+
+private:
+	// Number of times each case is repeated
+	std::size_t iterations;
+
+	/**
+	 * Compare parsing of the same request in both protocols; the typed values are read as well,
+	 * since that is where the text protocol converts them.
+	 * @param[out]	out		Stream the results are written to
+	 * @param[in]	name	Name of the case
+	 * @param[in]	text	Request in the text protocol
+	 * @param[in]	schema	Types of the fields ('S' text, 'A' amount, 'D' date, 'I' integer)
+	 */
+	void compareRequest(std::ostream& out, const std::string& name, const std::string& text,
+		const std::string& schema);
+
+	/**
+	 * Compare building of a transaction history response with given number of records.
+	 * @param[out]	out		Stream the results are written to
+	 * @param[in]	records	Number of records in the response
+	 */
+	void compareHistory(std::ostream& out, int records);
+
+	/**
+	 * Serve requests against a scratch database (created in the temporary directory and removed
+	 * afterwards) and print the latency and connections opened per request.
+	 * @param[out]	out		Stream the results are written to
+	 */
+	void measureDatabase(std::ostream& out);
+
+	/**
+	 * Read a long transaction history from a scratch database and print the time and allocations
+	 * it takes per record.
+	 * @param[out]	out		Stream the results are written to
+	 */
+	void measureDecoding(std::ostream& out);
+
+	/**
+	 * Serve deposits from many threads at once against a scratch database, each operation
+	 * committed on its own and with group commit, and print the throughput.
+	 * @param[out]	out		Stream the results are written to
+	 */
+	void measureGroupCommit(std::ostream& out);
+
+	/**
+	 * Serve deposits from many threads at once against a scratch database with given config.
+	 * @param[in]	config		Lines of the database config file
+	 * @param[out]	groups		Number of commits made by the writer thread (zero without group commit)
+	 * @returns					Deposits per second
+	 */
+	static double concurrentDeposits(const std::string& config, std::size_t& groups);
+
+	/**
+	 * Encode a text request as a frame of the binary protocol.
+	 * @param[in]	text	Request in the text protocol
+	 * @param[in]	schema	Types of the fields
+	 * @returns				The frame without the length prefix
+	 */
+	static std::string encodeFrame(const std::string& text, const std::string& schema);
+
+	/**
+	 * Read all the fields of a request as their types.
+	 * @param[in]	request		The request
+	 * @param[in]	schema		Types of the fields
+	 * @returns					Something depending on the values, so that the reads are not optimized out
+	 */
+	static std::size_t readFields(const Request& request, const std::string& schema);
+
+	/**
+	 * Print a single result line.
+	 * @param[out]	out					Stream the results are written to
+	 * @param[in]	name				Name of the case
+	 * @param[in]	text_size			Bytes in the text protocol
+	 * @param[in]	text_ns				Nanoseconds per operation in the text protocol
+	 * @param[in]	text_allocations	Allocations per operation in the text protocol
+	 * @param[in]	binary_size			Bytes in the binary protocol
+	 * @param[in]	binary_ns			Nanoseconds per operation in the binary protocol
+	 * @param[in]	binary_allocations	Allocations per operation in the binary protocol
+	 */
+	static void report(std::ostream& out, const std::string& name, std::size_t text_size, double text_ns,
+		std::size_t text_allocations, std::size_t binary_size, double binary_ns, std::size_t binary_allocations);
+};
+
+#endif
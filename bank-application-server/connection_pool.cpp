@@ -0,0 +1,120 @@
+#include "connection_pool.h"
+#include "bank_exception.h"
+
+std::atomic<std::size_t> ConnectionPool::opens{ 0 };
+
+ConnectionPool::ConnectionPool(const std::string& path, std::size_t readers, const DatabaseConfig& config) :
+	writer(nullptr), writer_idle(true)
+{
+	// The writer goes first, it creates the file if it doesn't exist yet
+	try {
+		writer = connect(path, config);
+		connections.push_back(writer);
+
+		for (std::size_t i = 0; i < readers; i++) {
+			idle_readers.push_back(connect(path, config));
+			connections.push_back(idle_readers.back());
+		}
+	}
+	catch (db_exception&) {
+		for (auto&& db : connections) {
+			sqlite3_close(db);
+		}
+		throw;
+	}
+
+	for (auto&& db : connections) {
+		statements[db] = std::vector<sqlite3_stmt*>();
+		partitioned[db] = std::unordered_map<long long, sqlite3_stmt*>();
+	}
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	for (auto&& db : connections) {
+		for (auto&& statement : statements[db]) {
+			sqlite3_finalize(statement);
+		}
+		for (auto&& statement : partitioned[db]) {
+			sqlite3_finalize(statement.second);
+		}
+		sqlite3_close(db);
+	}
+}
+
+sqlite3* ConnectionPool::acquire(bool write)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (write) {
+		released.wait(lock, [this]() { return writer_idle; });
+		writer_idle = false;
+		return writer;
+	}
+
+	released.wait(lock, [this]() { return !idle_readers.empty(); });
+	sqlite3* db = idle_readers.back();
+	idle_readers.pop_back();
+	return db;
+}
+
+void ConnectionPool::release(sqlite3* db)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (db == writer) {
+			writer_idle = true;
+		}
+		else {
+			idle_readers.push_back(db);
+		}
+	}
+	released.notify_all();
+}
+
+sqlite3_stmt*& ConnectionPool::statement(sqlite3* db, std::size_t id)
+{
+	std::vector<sqlite3_stmt*>& prepared = statements.at(db);
+	if (prepared.size() <= id) {
+		prepared.resize(id + 1, nullptr);
+	}
+	return prepared[id];
+}
+
+sqlite3_stmt*& ConnectionPool::statement(sqlite3* db, std::size_t id, int partition)
+{
+	long long key = (static_cast<long long>(partition) << 32) | static_cast<long long>(id);
+	return partitioned.at(db)[key];
+}
+
+sqlite3* ConnectionPool::connect(const std::string& path, const DatabaseConfig& config)
+{
+	// A borrowed connection is used by a single thread, so SQLite needn't lock it on every call
+	sqlite3* db;
+	int error_code = sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX,
+		nullptr);
+	if (error_code == SQLITE_OK) {
+		// Waits for a lock instead of failing with SQLITE_BUSY right away
+		error_code = sqlite3_busy_timeout(db, config.busy_timeout);
+	}
+	if (error_code == SQLITE_OK) {
+		// The journal mode is persistent, but setting it again is cheap
+		std::string pragmas = "PRAGMA journal_mode = " + config.journal_mode + ";" \
+			"PRAGMA synchronous = " + config.synchronous + ";" \
+			"PRAGMA cache_size = " + std::to_string(config.cache_size) + ";" \
+			"PRAGMA mmap_size = " + std::to_string(config.mmap_size) + ";" \
+			"PRAGMA temp_store = " + config.temp_store + ";" \
+			"PRAGMA wal_autocheckpoint = " + std::to_string(config.wal_autocheckpoint) + ";";
+		error_code = sqlite3_exec(db, pragmas.c_str(), NULL, 0, NULL);
+	}
+	if (error_code != SQLITE_OK) {
+		std::string message = "can't open database (";
+		message += sqlite3_errmsg(db);
+		message += ")";
+		sqlite3_close(db);
+		throw db_exception(message);
+	}
+
+	opens++;
+	return db;
+}
@@ -0,0 +1,117 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "database_config.h"
+#include "sqlite/sqlite3.h"
+
+#ifndef CONNECTION_POOL_H_
+#define CONNECTION_POOL_H_
+
+/**
+ * Database connections kept open for the life of the pool: a single writer connection and
+ * a number of reader connections. Opening a connection opens the file and reads the schema,
+ * so reusing them saves this work on every statement. A connection is borrowed by `acquire` and
+ * must be given back by `release`; while all the connections of the requested kind are borrowed,
+ * `acquire` waits. Having a single writer also means writes of this process never compete for
+ * the database lock with each other. Each connection also keeps the statements prepared on it, so
+ * a statement is compiled only once per connection. All the methods are thread safe, the
+ * connections themselves are not (they are opened without their own mutex, see `connect`).
+ *
+ * Every connection is tuned by the pragmas of the config when opened. In the WAL journal mode
+ * the readers see the last committed state while the writer works, so they never wait for it;
+ * a connection that still finds the database locked (by another process, or a checkpoint) waits
+ * in the busy handler of SQLite for up to the busy timeout.
+ */
+class ConnectionPool
+{
+public:
+	/**
+	 * Open the connections.
+	 * @param[in]	path		Path to the database file
+	 * @param[in]	readers		Number of reader connections
+	 * @param[in]	config		Tuning of the connections
+	 */
+	ConnectionPool(const std::string& path, std::size_t readers, const DatabaseConfig& config);
+
+	/**
+	 * Finalize the prepared statements and close the connections, none of them may be borrowed.
+	 */
+	~ConnectionPool();
+
+	ConnectionPool(const ConnectionPool&) = delete;
+	ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+	/**
+	 * Borrow a connection.
+	 * @param[in]	write	Whether the connection is going to be used for writing
+	 * @returns				The connection
+	 */
+	sqlite3* acquire(bool write);
+
+	/**
+	 * Give back a borrowed connection.
+	 * @param[in]	db		The connection
+	 */
+	void release(sqlite3* db);
+
+	/**
+	 * Slot of a prepared statement of a borrowed connection, only the borrower may use it.
+	 * @param[in]	db		The connection
+	 * @param[in]	id		Identifier of the statement
+	 * @returns				The slot, null until the statement is prepared
+	 */
+	sqlite3_stmt*& statement(sqlite3* db, std::size_t id);
+
+	/**
+	 * Slot of a prepared statement on a partition of the history of a borrowed connection, only the
+	 * borrower may use it.
+	 * @param[in]	db			The connection
+	 * @param[in]	id			Identifier of the statement
+	 * @param[in]	partition	Identifier of the partition
+	 * @returns					The slot, null until the statement is prepared
+	 */
+	sqlite3_stmt*& statement(sqlite3* db, std::size_t id, int partition);
+
+	// Number of connections opened since the start of the program
+	static std::atomic<std::size_t> opens;
+
+private:
+	// The writer connection
+	sqlite3* writer;
+
+	// Whether the writer connection is not borrowed
+	bool writer_idle;
+
+	// Reader connections not borrowed
+	std::vector<sqlite3*> idle_readers;
+
+	// Guards the idle connections
+	std::mutex mutex;
+
+	// Signalled whenever a connection is given back
+	std::condition_variable released;
+
+	// All the connections, closed with the pool
+	std::vector<sqlite3*> connections;
+
+	// Statements prepared on each connection, indexed by their identifier (the map itself never changes)
+	std::unordered_map<sqlite3*, std::vector<sqlite3_stmt*>> statements;
+
+	// Statements on the partitions prepared on each connection, by the partition and the identifier
+	// (the outer map never changes)
+	std::unordered_map<sqlite3*, std::unordered_map<long long, sqlite3_stmt*>> partitioned;
+
+	/**
+	 * Open a database connection.
+	 * @param[in]	path	Path to the database file
+	 * @param[in]	config	Tuning of the connection
+	 * @returns				The connection
+	 */
+	static sqlite3* connect(const std::string& path, const DatabaseConfig& config);
+};
+
+#endif
@@ -1,17 +1,38 @@
 #include "database.h"
 #include "bank_exception.h"
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 
-void Database::setup(const std::string& current_path)
+void Database::setup(const std::string& current_path, std::size_t readers)
 {
 	// Resolve database path
 	setupPath(current_path);
 
+	// Missing config file means the defaults
+	config = DatabaseConfig::load((fs::path(path).parent_path() / "database.conf").string());
+
+	// Connections are opened once and reused for all the statements
+	pool = std::make_shared<ConnectionPool>(path, readers, config);
+
 	// Try opening / creating the database
-	sqlite3* db = open();
+	sqlite3* db = open(Access::write);
+
+	// A database from before the account identifiers is converted first, then one with text dates,
+	// then one with floating point amounts
+	if (tableExists(db, "account") && columnType(db, "account", "id").empty()) {
+		migrateAccountIds(db);
+	}
+	if ((columnType(db, "record", "date") == "TEXT") || (columnType(db, "recurring_payment", "next_payment") == "TEXT")) {
+		migrateEpochDays(db);
+	}
+	if ((columnType(db, "account", "balance") == "DOUBLE") || (columnType(db, "record", "amount") == "DOUBLE") ||
+		(columnType(db, "recurring_payment", "amount") == "DOUBLE")) {
+		migrateMinorUnits(db);
+	}
 
 	// Make sure tables exist
 	if (!tableExists(db, "user")) {
@@ -23,15 +44,38 @@ void Database::setup(const std::string& current_path)
 	if (!tableExists(db, "account")) {
 		createAccountTable(db);
 	}
-	if (!tableExists(db, "record")) {
-		createRecordTable(db);
-	}
 	if (!tableExists(db, "previous")) {
 		createPreviousTable(db);
 	}
 
-	// Free the database
-	sqlite3_close(db);
+	// A database from before the partitions has all the records in a single table
+	if (tableExists(db, "record")) {
+		migratePartitions(db);
+	}
+	if (!tableExists(db, "record_archive")) {
+		createArchiveTable(db);
+	}
+	loadPartitions(db);
+
+	// A database from before the end-of-day balances gets them from its history
+	if (!tableExists(db, "balance_day")) {
+		rebuildBalances(db);
+	}
+
+	// Give the connection back
+	close(db);
+}
+
+void Database::checkpoint()
+{
+	// A reader connection does it, so the writer is not held up
+	sqlite3* db = open(Access::read);
+
+	int error_code = sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+	std::string message = (error_code == SQLITE_OK) ? "" : sqlite3_errmsg(db);
+
+	close(db);
+	errorCheck(error_code, message);
 }
 
 void Database::setupPath(const std::string& current_path)
@@ -57,33 +101,25 @@ void Database::createUserTable(sqlite3* db)
 
 bool Database::tableExists(sqlite3* db, const std::string& table_name)
 {
-	char *zErrMsg = 0;
-	std::string command = "SELECT name FROM sqlite_master " \
-		"WHERE type='table' AND name=";
-	command += "'" + table_name + "';";
-
 	bool exists = false;
-	bool* exists_ptr = &exists;
 
-	int error_code = sqlite3_exec(db, command.c_str(), callbackTableExists, (void*) exists_ptr, &zErrMsg);
-	errorCheck(error_code, zErrMsg);
+	int error_code = query(db, SELECT_TABLE, { table_name }, callbackTableExists, &exists);
+	errorCheck(error_code, sqlite3_errmsg(db));
 
-	return *exists_ptr;
+	return exists;
 }
 
 void Database::createRecurringPaymentTable(sqlite3* db)
 {
 	char *zErrMsg = 0;
 	std::string command = "CREATE TABLE recurring_payment("  \
-		"account_source	TEXT		NOT NULL," \
-		"account_target	TEXT		NOT NULL," \
-		"name_source	TEXT		NOT NULL," \
-		"name_target	TEXT		NOT NULL," \
-		"next_payment	TEXT		NOT NULL," \
-		"amount			DOUBLE		NOT NULL," \
+		"source_id		INTEGER		NOT NULL," \
+		"target_id		INTEGER		NOT NULL," \
+		"next_payment	INTEGER		NOT NULL," \
+		"amount			INTEGER		NOT NULL," \
 		"interval		INT			NOT NULL," \
 		"type			INT			NOT NULL," \
-		"UNIQUE(account_source, name_source));";
+		"UNIQUE(source_id));";
 
 	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
@@ -93,306 +129,580 @@ void Database::createAccountTable(sqlite3* db)
 {
 	char *zErrMsg = 0;
 	std::string command = "CREATE TABLE account("  \
+		"id				INTEGER		PRIMARY KEY," \
 		"name			TEXT		NOT NULL," \
 		"email			TEXT		NOT NULL," \
-		"balance		DOUBLE		NOT NULL," \
+		"balance		INTEGER		NOT NULL," \
 		"state			INT			NOT NULL," \
 		"UNIQUE(email, name));";
 
+	// Deposits come from the external account
+	command += "INSERT INTO account (id,name,email,balance,state) VALUES (" + std::to_string(DB_EXTERNAL_ACCOUNT) +
+		",'-','-',0," + std::to_string(DB_USER_OK) + ");";
+
 	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
 }
 
-void Database::createRecordTable(sqlite3* db)
+void Database::createRecordTable(sqlite3* db, const std::string& table)
 {
 	char *zErrMsg = 0;
-	std::string command = "CREATE TABLE record("  \
-		"account_source		TEXT		NOT NULL," \
-		"account_target		TEXT		NOT NULL," \
-		"name_source		TEXT		NOT NULL," \
-		"name_target		TEXT		NOT NULL," \
-		"amount				DOUBLE		NOT NULL," \
-		"date				TEXT		NOT NULL );";
+	std::string command = "CREATE TABLE IF NOT EXISTS " + table + "("  \
+		"source_id			INTEGER		NOT NULL," \
+		"target_id			INTEGER		NOT NULL," \
+		"amount				INTEGER		NOT NULL," \
+		"date				INTEGER		NOT NULL );";
 
 	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
 }
 
-void Database::createPreviousTable(sqlite3* db)
+void Database::createRecordIndexes(sqlite3* db, const std::string& table)
 {
 	char *zErrMsg = 0;
-	std::string command = "CREATE TABLE previous("  \
-		"account_source		TEXT		NOT NULL," \
-		"account_target		TEXT		NOT NULL," \
-		"name_source		TEXT		NOT NULL," \
-		"name_target		TEXT		NOT NULL," \
-		"UNIQUE(account_source, account_target, name_source, name_target));";
+	std::string command = "CREATE INDEX IF NOT EXISTS " + table + "_source ON " + table + "(source_id, date);" \
+		"CREATE INDEX IF NOT EXISTS " + table + "_target ON " + table + "(target_id, date);";
 
 	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
 }
 
-void Database::addUser(const User& user)
+void Database::dropRecordIndexes(sqlite3* db, const std::string& table)
 {
-	int error_code = SQLITE_BUSY;
 	char *zErrMsg = 0;
+	std::string command = "DROP INDEX IF EXISTS " + table + "_source;" \
+		"DROP INDEX IF EXISTS " + table + "_target;";
 
-	sqlite3* db = open();
-
-	std::string command = "INSERT INTO user (email,password) VALUES (";
-	command += "'" + user.mail_ + "',";
-	command += "'" + user.password_ + "');";
+	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
+}
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
-	}
+void Database::createArchiveTable(sqlite3* db)
+{
+	char *zErrMsg = 0;
+	std::string command = "CREATE TABLE record_archive("  \
+		"month				INTEGER		PRIMARY KEY," \
+		"file				TEXT		NOT NULL );";
 
-	sqlite3_close(db);
+	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
 }
 
-void Database::addAccount(const Account& account)
+void Database::loadPartitions(sqlite3* db)
 {
-	int error_code = SQLITE_BUSY;
-	char *zErrMsg = 0;
+	partitions = std::make_shared<Partitions>();
+
+	std::vector<int> months;
+	int error_code = query(db, SELECT_PARTITIONS, {}, callbackGatherPartitions, &months);
+	errorCheck(error_code, sqlite3_errmsg(db));
+	for (int month : months) {
+		// Left out if a bulk load didn't finish
+		createRecordIndexes(db, Partitions::table(month));
+		partitions->add(month);
+	}
 
-	sqlite3* db = open();
+	std::vector<Partitions::Partition> archives;
+	error_code = query(db, SELECT_ARCHIVES, {}, callbackGatherArchives, &archives);
+	errorCheck(error_code, sqlite3_errmsg(db));
+	for (auto&& archive : archives) {
+		partitions->add(archive.month, archivePath(archive.archive));
+	}
+}
 
-	int state;
-	switch (account.state_) {
-	case State::ok:
-		state = DB_USER_OK;
-		break;
-	case State::blocked:
-		state = DB_USER_BLOCKED;
-		break;
-	default:
-		state = DB_USER_BLOCKED;
-		break;
+bool Database::preparePartition(sqlite3* db, int month)
+{
+	if (partitions->archived(month)) {
+		throw db_exception("the records of " + Partitions::name(month) + " are archived");
 	}
 
-	std::string command = "INSERT INTO account (name,email,balance,state) VALUES (";
-	command += "'" + account.name_ + "',";
-	command += "'" + account.mail_ + "',";
-	command += std::to_string(account.balance_) + ",";
-	command += std::to_string(state) + ");";
+	bool exists = partitions->contains(month) || (std::find(created.begin(), created.end(), month) != created.end());
+	bool first = partitions->loading() && partitions->load(month);
+	std::string table = Partitions::table(month);
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
+	if (!exists) {
+		// A bulk load builds the indexes at its end
+		createRecordTable(db, table);
+		if (!first) {
+			createRecordIndexes(db, table);
+		}
+
+		// Other connections can't see the table until the transaction creating it is committed
+		if (connection != nullptr) {
+			created.push_back(month);
+		}
+		else {
+			partitions->add(month);
+		}
+	}
+	else if (first) {
+		dropRecordIndexes(db, table);
 	}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+	return first;
 }
 
-void Database::addRecord(const Record& record)
+std::string Database::archivePath(const std::string& file)
+{
+	return (fs::path(path).parent_path() / "archive" / file).string();
+}
+
+void Database::createBalanceTable(sqlite3* db)
 {
-	int error_code = SQLITE_BUSY;
 	char *zErrMsg = 0;
+	// Clustered by account and day, the balance of a day is found by a single range lookup
+	std::string command = "CREATE TABLE IF NOT EXISTS balance_day("  \
+		"account_id			INTEGER		NOT NULL," \
+		"date				INTEGER		NOT NULL," \
+		"balance			INTEGER		NOT NULL," \
+		"delta				INTEGER		NOT NULL," \
+		"PRIMARY KEY(account_id, date)) WITHOUT ROWID;";
 
-	sqlite3* db = open();
+	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
+}
 
-	std::string command = "INSERT INTO record ";
-	command += "(account_source,account_target,name_source,name_target,amount,date) VALUES (";
-	command += "'" + record.account_source_ + "',";
-	command += "'" + record.account_target_ + "',";
-	command += "'" + record.name_source_ + "',";
-	command += "'" + record.name_target_ + "',";
-	command += std::to_string(record.amount_) + ",";
-	command += "'" + record.date_ + "');";
+void Database::rebuildBalances(sqlite3* db)
+{
+	char *zErrMsg = 0;
+	int error_code = sqlite3_exec(db, "CREATE TEMP TABLE IF NOT EXISTS day_delta(account_id, date, delta);" \
+		"DELETE FROM temp.day_delta;", NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
+	// Net change of each account on each day, outside of the transaction so that archives can be attached;
+	// a day belongs to a single month, so each of them is summed up once
+	for (auto&& partition : partitions->all()) {
+		queryPartition(db, partition, INSERT_DAY_DELTAS, { DB_EXTERNAL_ACCOUNT }, NULL, NULL);
 	}
 
-	sqlite3_close(db);
+	error_code = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
+
+	try {
+		createBalanceTable(db);
+
+		// A day ends with the current balance less the changes of the days after it
+		std::string command = "DELETE FROM balance_day;" \
+			"INSERT INTO balance_day (account_id,date,balance,delta) " \
+			"SELECT d.account_id,d.date,a.balance-(SUM(d.delta) OVER (PARTITION BY d.account_id ORDER BY d.date DESC " \
+			"ROWS UNBOUNDED PRECEDING)-d.delta),d.delta FROM temp.day_delta d JOIN account a ON a.id=d.account_id " \
+			"ORDER BY d.account_id,d.date;" \
+			"COMMIT;" \
+			"DROP TABLE temp.day_delta;";
+		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+	}
+	catch (db_exception&) {
+		sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+		throw;
+	}
 }
 
-void Database::addPrevious(const user_pair& pair)
+void Database::createPreviousTable(sqlite3* db)
 {
-	int error_code = SQLITE_BUSY;
 	char *zErrMsg = 0;
+	std::string command = "CREATE TABLE previous("  \
+		"source_id			INTEGER		NOT NULL," \
+		"target_id			INTEGER		NOT NULL," \
+		"UNIQUE(source_id, target_id));";
 
-	sqlite3* db = open();
+	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
+}
 
-	std::string command = "INSERT INTO previous ";
-	command += "(account_source,account_target,name_source,name_target) VALUES (";
-	command += "'" + pair.email_source + "',";
-	command += "'" + pair.email_target+ "',";
-	command += "'" + pair.name_source + "',";
-	command += "'" + pair.name_target + "');";
+std::string Database::columnType(sqlite3* db, const std::string& table_name, const std::string& column_name)
+{
+	std::string type = "";
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
-	}
+	int error_code = query(db, SELECT_COLUMN, { table_name, column_name }, callbackColumnType, &type);
+	errorCheck(error_code, sqlite3_errmsg(db));
 
-	sqlite3_close(db);
+	return type;
+}
 
-	// This pair of users already has a record in the `previous` table
-	if (error_code == SQLITE_CONSTRAINT) {
-		return;
-	}
+/**
+ * SQL expression converting a YYYY-MM-DD text column to the number of days since 1970-01-01.
+ * @param[in]	column	Name of the column
+ * @returns				The expression
+ */
+static std::string epochDays(const std::string& column)
+{
+	return "CAST(julianday(" + column + ") - julianday('1970-01-01') AS INTEGER)";
+}
 
-	errorCheck(error_code, zErrMsg);
+/**
+ * SQL expression converting a floating point amount column to whole hundredths.
+ * @param[in]	column	Name of the column
+ * @returns				The expression
+ */
+static std::string minorUnits(const std::string& column)
+{
+	return "CAST(ROUND(" + column + " * " + std::to_string(Money::SCALE) + ") AS INTEGER)";
 }
 
-User Database::getUser(const std::string& email)
+void Database::migrateAccountIds(sqlite3* db)
 {
-	int error_code = SQLITE_BUSY;
+	// The old tables are renamed, their rows copied into the new ones and then dropped
+	std::vector<std::string> tables = { "account", "record", "previous", "recurring_payment" };
+	std::vector<std::string> old_tables;
+
 	char *zErrMsg = 0;
+	int error_code = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
 
-	sqlite3* db = open();
+	try {
+		for (auto&& table : tables) {
+			if (tableExists(db, table)) {
+				std::string command = "ALTER TABLE " + table + " RENAME TO " + table + "_old;";
+				error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+				errorCheck(error_code, zErrMsg);
+				old_tables.push_back(table);
+			}
+		}
 
-	std::string command = "SELECT * FROM user WHERE email = ";
-	command += "'" + email + "';";
+		// The indexes went with the old record table, the partitions it is split into get their own
+		createAccountTable(db);
+		createRecordTable(db, "record");
+		createPreviousTable(db);
+		createRecurringPaymentTable(db);
 
-	User user{};
+		// Accounts are numbered in the order they were created; deposits ("-") resolve to the external
+		// account and records keep their rowid, so the cursors of the history pages stay valid
+		std::string command = "INSERT INTO account (name,email,balance,state) " \
+			"SELECT name,email," + minorUnits("balance") + ",state FROM account_old ORDER BY rowid;";
+		std::string resolve = "JOIN account s ON s.email=o.account_source AND s.name=o.name_source " \
+			"JOIN account t ON t.email=o.account_target AND t.name=o.name_target;";
+		for (auto&& table : old_tables) {
+			if (table == "record") {
+				command += "INSERT INTO record (rowid,source_id,target_id,amount,date) " \
+					"SELECT o.rowid,s.id,t.id," + minorUnits("o.amount") + "," + epochDays("o.date") + " FROM record_old o " + resolve;
+			}
+			else if (table == "previous") {
+				command += "INSERT OR IGNORE INTO previous (source_id,target_id) " \
+					"SELECT s.id,t.id FROM previous_old o " + resolve;
+			}
+			else if (table == "recurring_payment") {
+				// A payment to an account that doesn't exist could never be executed, it is dropped
+				command += "INSERT INTO recurring_payment (source_id,target_id,next_payment,amount,interval,type) " \
+					"SELECT s.id,t.id," + epochDays("o.next_payment") + "," + minorUnits("o.amount") + ",o.interval,o.type " \
+					"FROM recurring_payment_old o " + resolve;
+			}
+		}
+		for (auto&& table : old_tables) {
+			command += "DROP TABLE " + table + "_old;";
+		}
+		command += "COMMIT;";
 
-	// Fill password
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), callbackGetUser, &user, &zErrMsg);
-		i++;
+		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+	}
+	catch (db_exception&) {
+		sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+		throw;
 	}
+}
 
-	// Fill rest of the fields
-	if (error_code == SQLITE_OK) {
-		error_code = SQLITE_BUSY;
+void Database::migrateEpochDays(sqlite3* db)
+{
+	char *zErrMsg = 0;
+	int error_code = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
 
-		command = "SELECT * FROM account WHERE email = ";
-		command += "'" + email + "';";
+	// The tables are created again with integer dates, records keep their rowid
+	try {
+		if (columnType(db, "record", "date") == "TEXT") {
+			error_code = sqlite3_exec(db, "ALTER TABLE record RENAME TO record_old;", NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+			createRecordTable(db, "record");
+
+			std::string command = "INSERT INTO record (rowid,source_id,target_id,amount,date) " \
+				"SELECT rowid,source_id,target_id," + minorUnits("amount") + "," + epochDays("date") + " FROM record_old;" \
+				"DROP TABLE record_old;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+		}
 
-		i = 0;
-		while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-			error_code = sqlite3_exec(db, command.c_str(), callbackFillAccounts, &user, &zErrMsg);
-			i++;
+		if (columnType(db, "recurring_payment", "next_payment") == "TEXT") {
+			error_code = sqlite3_exec(db, "ALTER TABLE recurring_payment RENAME TO recurring_payment_old;", NULL, 0,
+				&zErrMsg);
+			errorCheck(error_code, zErrMsg);
+			createRecurringPaymentTable(db);
+
+			std::string command = "INSERT INTO recurring_payment (source_id,target_id,next_payment,amount,interval,type) " \
+				"SELECT source_id,target_id," + epochDays("next_payment") + "," + minorUnits("amount") + ",interval,type " \
+				"FROM recurring_payment_old;" \
+				"DROP TABLE recurring_payment_old;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
 		}
+
+		error_code = sqlite3_exec(db, "COMMIT;", NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+	}
+	catch (db_exception&) {
+		sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+		throw;
 	}
+}
 
-	sqlite3_close(db);
+void Database::migrateMinorUnits(sqlite3* db)
+{
+	char *zErrMsg = 0;
+	int error_code = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg);
 	errorCheck(error_code, zErrMsg);
 
-	return user;
+	// The tables are created again with integer amounts, accounts keep their id and records their rowid
+	try {
+		if (columnType(db, "account", "balance") == "DOUBLE") {
+			error_code = sqlite3_exec(db, "ALTER TABLE account RENAME TO account_old;", NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+			createAccountTable(db);
+
+			// The external account is already there
+			std::string command = "INSERT INTO account (id,name,email,balance,state) " \
+				"SELECT id,name,email," + minorUnits("balance") + ",state FROM account_old " \
+				"WHERE id<>" + std::to_string(DB_EXTERNAL_ACCOUNT) + ";" \
+				"DROP TABLE account_old;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+		}
+
+		if (columnType(db, "record", "amount") == "DOUBLE") {
+			error_code = sqlite3_exec(db, "ALTER TABLE record RENAME TO record_old;", NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+			createRecordTable(db, "record");
+
+			std::string command = "INSERT INTO record (rowid,source_id,target_id,amount,date) " \
+				"SELECT rowid,source_id,target_id," + minorUnits("amount") + ",date FROM record_old;" \
+				"DROP TABLE record_old;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+		}
+
+		if (columnType(db, "recurring_payment", "amount") == "DOUBLE") {
+			error_code = sqlite3_exec(db, "ALTER TABLE recurring_payment RENAME TO recurring_payment_old;", NULL, 0,
+				&zErrMsg);
+			errorCheck(error_code, zErrMsg);
+			createRecurringPaymentTable(db);
+
+			std::string command = "INSERT INTO recurring_payment (source_id,target_id,next_payment,amount,interval,type) " \
+				"SELECT source_id,target_id,next_payment," + minorUnits("amount") + ",interval,type " \
+				"FROM recurring_payment_old;" \
+				"DROP TABLE recurring_payment_old;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+		}
+
+		error_code = sqlite3_exec(db, "COMMIT;", NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+	}
+	catch (db_exception&) {
+		sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+		throw;
+	}
 }
 
-RecurringPayment Database::getRecurringPayment(const std::string& email, const std::string& name)
+void Database::migratePartitions(sqlite3* db)
 {
-	int error_code = SQLITE_BUSY;
 	char *zErrMsg = 0;
+	int error_code = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg);
+	errorCheck(error_code, zErrMsg);
 
-	sqlite3* db = open();
+	// Each month is found through an index of the dates (dropped with the table) and copied with the
+	// rowids, so the cursors of the history pages stay valid
+	try {
+		error_code = sqlite3_exec(db, "CREATE INDEX record_date ON record(date);", NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+
+		std::pair<int, int> dates(0, -1);
+		error_code = query(db, SELECT_RECORD_DATES, {}, callbackDateRange, &dates);
+		errorCheck(error_code, sqlite3_errmsg(db));
+
+		for (int month = Partitions::month(dates.first); month <= Partitions::month(dates.second); month++) {
+			std::string table = Partitions::table(month);
+			createRecordTable(db, table);
+
+			std::string command = "INSERT INTO " + table + " (rowid,source_id,target_id,amount,date) " \
+				"SELECT rowid,source_id,target_id,amount,date FROM record WHERE date>=" +
+				std::to_string(Partitions::firstDay(month)) + " AND date<=" + std::to_string(Partitions::lastDay(month)) + ";";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
+
+			// A month without records gets no partition
+			if (sqlite3_changes(db) == 0) {
+				command = "DROP TABLE " + table + ";";
+				error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+				errorCheck(error_code, zErrMsg);
+			}
+			else {
+				createRecordIndexes(db, table);
+			}
+		}
 
-	std::string command = "SELECT * FROM recurring_payment WHERE account_source = ";
-	command += "'" + email + "'";
-	command += " AND ";
-	command += "name_source = ";
-	command += "'" + name + "';";
+		error_code = sqlite3_exec(db, "DROP TABLE record; COMMIT;", NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+	}
+	catch (db_exception&) {
+		sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+		throw;
+	}
+}
 
-	RecurringPayment rp{};
+void Database::addUser(const User& user)
+{
+	execute(Access::write, INSERT_USER, { user.mail_, user.password_ });
+}
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), callbackGetPayment, &rp, &zErrMsg);
-		i++;
+long long Database::addAccount(const Account& account)
+{
+	int state;
+	switch (account.state_) {
+	case State::ok:
+		state = DB_USER_OK;
+		break;
+	case State::blocked:
+		state = DB_USER_BLOCKED;
+		break;
+	default:
+		state = DB_USER_BLOCKED;
+		break;
 	}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+	sqlite3* db = open(Access::write);
 
-	return rp;
+	// The identifier has to be read before the connection is given to someone else
+	int error_code = query(db, INSERT_ACCOUNT, { account.name_, account.mail_, account.balance_, state }, NULL, NULL);
+	std::string message = (error_code == SQLITE_OK) ? "" : sqlite3_errmsg(db);
+	long long id = sqlite3_last_insert_rowid(db);
+
+	close(db);
+	errorCheck(error_code, message);
+	return id;
 }
 
-void Database::changeValue(const std::string& email, const std::string& column_name, const std::string& new_value)
+void Database::addRecord(const Record& record)
 {
-	int error_code = SQLITE_BUSY;
-	char* zErrMsg = 0;
+	int month = Partitions::month(record.date_);
+	sqlite3* db = open(Access::write);
 
-	sqlite3* db = open();
+	try {
+		bool first = preparePartition(db, month);
 
-	std::string command = "UPDATE user SET ";
-	command += column_name + "=";
-	command += new_value;
-	command += " WHERE email=";
-	command += "'" + email + "';";
+		queryPartition(db, Partitions::Partition{ month, "" }, INSERT_RECORD,
+			{ record.source_id_, record.target_id_, record.amount_, record.date_ }, NULL, NULL);
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
+		if (first) {
+			partitions->loadFrom(month, sqlite3_last_insert_rowid(db));
+		}
+	}
+	catch (db_exception&) {
+		close(db);
+		throw;
 	}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+	close(db);
 }
 
-void Database::changeValueAccount(const std::string& email, const std::string& account, const std::string& column_name, const std::string& new_value)
+void Database::addPrevious(long long source_id, long long target_id)
 {
-	int error_code = SQLITE_BUSY;
-	char* zErrMsg = 0;
+	// A pair of accounts that already has a record in the `previous` table is ignored
+	execute(Access::write, INSERT_PREVIOUS, { source_id, target_id });
+}
 
-	sqlite3* db = open();
+long long Database::getAccountId(const std::string& email, const std::string& name)
+{
+	long long id = DB_NO_ACCOUNT;
+	execute(Access::read, SELECT_ACCOUNT_ID, { email, name }, callbackGetAccountId, &id);
+	return id;
+}
 
-	std::string command = "UPDATE account SET ";
-	command += column_name + "=";
-	command += new_value;
-	command += " WHERE email=";
-	command += "'" + email + "'";
-	command += " AND ";
-	command += "name=";
-	command += "'" + account + "';";
+User Database::getUser(const std::string& email)
+{
+	User user{};
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
-	}
+	// Fill password, then the rest of the fields
+	execute(Access::read, SELECT_USER, { email }, callbackGetUser, &user);
+	execute(Access::read, SELECT_ACCOUNTS, { email }, callbackFillAccounts, &user);
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+	return user;
 }
 
-void Database::updateRecurringPayment(const std::string& account_source, const std::string& name_source, const std::string& new_value)
+void Database::gatherUsers(std::vector<User>* users)
 {
-	int error_code = SQLITE_BUSY;
-	char* zErrMsg = 0;
+	execute(Access::read, SELECT_USERS, {}, callbackGatherUsers, users);
 
-	sqlite3* db = open();
+	// All the accounts are read at once and handed to their owners
+	User all{};
+	execute(Access::read, SELECT_ALL_ACCOUNTS, {}, callbackFillAccounts, &all);
 
-	std::string command = "UPDATE recurring_payment SET ";
-	command += "next_payment=";
-	command += "'" + new_value + "'";
-	command += " WHERE account_source=";
-	command += "'" + account_source + "'";
-	command += " AND ";
-	command += "name_source=";
-	command += "'" + name_source + "';";
+	std::unordered_map<std::string_view, User*> owners;
+	for (auto&& user : *users) {
+		owners.emplace(user.mail_, &user);
+	}
+	for (auto&& account : all.accounts_) {
+		auto owner = owners.find(account.mail_);
+		if (owner != owners.end()) {
+			owner->second->accounts_.push_back(std::move(account));
+		}
+	}
+}
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
+RecurringPayment Database::getRecurringPayment(long long source_id)
+{
+	RecurringPayment rp{};
+	execute(Access::read, SELECT_RECURRING_PAYMENT, { source_id }, callbackGetPayment, &rp);
+	return rp;
+}
+
+void Database::changeValue(const std::string& email, const std::string& column_name, const std::string& new_value)
+{
+	// Column names can't be bound, each column has its own statement
+	if (column_name == "password") {
+		execute(Access::write, UPDATE_USER_PASSWORD, { new_value, email });
+	}
+	else {
+		throw db_exception("column " + column_name + " of user can't be changed");
+	}
+}
+
+void Database::changeValueAccount(long long id, const std::string& column_name, const std::string& new_value)
+{
+	// Column names can't be bound, each column has its own statement
+	if (column_name == "balance") {
+		execute(Access::write, UPDATE_ACCOUNT_BALANCE, { new_value, id });
+	}
+	else if (column_name == "state") {
+		execute(Access::write, UPDATE_ACCOUNT_STATE, { new_value, id });
 	}
+	else {
+		throw db_exception("column " + column_name + " of account can't be changed");
+	}
+}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+void Database::addToBalance(long long id, Money delta, State state, int date)
+{
+	int db_state = (state == State::blocked) ? DB_USER_BLOCKED : DB_USER_OK;
+	execute(Access::write, UPDATE_ACCOUNT_BALANCE_DELTA, { delta, db_state, id });
+
+	// The day ends with the balance just written, whatever else changes it that day
+	execute(Access::write, UPDATE_BALANCE_DAY, { id, date, delta });
 }
 
-void Database::addRecurringPayment(const RecurringPayment& rp)
+bool Database::getBalance(long long id, int date, Money& balance)
 {
-	int error_code = SQLITE_BUSY;
-	char *zErrMsg = 0;
+	std::pair<bool, Money> found(false, Money());
+	execute(Access::read, SELECT_BALANCE, { id, date }, callbackGetBalance, &found);
 
-	sqlite3* db = open();
+	balance = found.second;
+	return found.first;
+}
 
+void Database::updateRecurringPayment(long long source_id, int new_value)
+{
+	execute(Access::write, UPDATE_RECURRING_PAYMENT, { new_value, source_id });
+}
+
+void Database::addRecurringPayment(const RecurringPayment& rp)
+{
 	int type;
 	switch (rp.type_) {
 	case PaymentType::standing_order:
@@ -425,268 +735,690 @@ void Database::addRecurringPayment(const RecurringPayment& rp)
 		break;
 	}
 
-	std::string command = "INSERT INTO recurring_payment ";
-	command += "(account_source,account_target,name_source,name_target,next_payment,amount,interval,type) ";
-	command += "VALUES (";
-	command += "'" + rp.account_source_ + "',";
-	command += "'" + rp.account_target_ + "',";
-	command += "'" + rp.name_source_ + "',";
-	command += "'" + rp.name_target_ + "',";
-	command += "'" + rp.next_payment_ + "',";
-	command += std::to_string(rp.amount_) + ",";
-	command += std::to_string(interval) + ",";
-	command += std::to_string(type) + ");";
-
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
-		i++;
+	execute(Access::write, INSERT_RECURRING_PAYMENT, { rp.source_id_, rp.target_id_, rp.next_payment_, rp.amount_,
+		interval, type });
+}
+
+void Database::gatherRecurringPayments(PaymentList* payments)
+{
+	execute(Access::read, SELECT_RECURRING_PAYMENTS, {}, callbackGatherPayments, payments);
+}
+
+void Database::gatherRecords(long long id, int date_from, int date_to, RecordList* records)
+{
+	// The months are read in order on a single connection, so the records stay ordered by date
+	sqlite3* db = open(Access::read);
+	bool reading = false;
+
+	try {
+		for (auto&& partition : partitions->overlapping(date_from, date_to)) {
+			readPartition(db, &partition, reading);
+			queryPartition(db, partition, SELECT_RECORDS, { id, date_from, date_to }, callbackGatherRecords, records);
+		}
+		readPartition(db, nullptr, reading);
+	}
+	catch (db_exception&) {
+		if (reading) {
+			query(db, ROLLBACK, {}, NULL, NULL);
+		}
+		close(db);
+		throw;
 	}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+	close(db);
 }
 
-void Database::gatherRecurringPayments(int(*callback)(void*, int, char**, char**), PaymentList* payments)
+void Database::gatherRecordPage(long long id, int date_from, int date_to, int after_date, long long after_rowid,
+	int limit, RecordPage* page)
 {
-	int error_code = SQLITE_BUSY;
-	char *zErrMsg = 0;
+	// Rowids are only compared within a month, the dates of different months never tie
+	sqlite3* db = open(Access::read);
+	bool reading = false;
+
+	try {
+		for (auto&& partition : partitions->overlapping(std::max(date_from, after_date), date_to)) {
+			int remaining = limit - static_cast<int>(page->records.size());
+			if (remaining <= 0) {
+				break;
+			}
+			readPartition(db, &partition, reading);
+			queryPartition(db, partition, SELECT_RECORD_PAGE,
+				{ id, date_from, date_to, after_date, after_rowid, remaining }, callbackGatherRecordPage, page);
+		}
+		readPartition(db, nullptr, reading);
+	}
+	catch (db_exception&) {
+		if (reading) {
+			query(db, ROLLBACK, {}, NULL, NULL);
+		}
+		close(db);
+		throw;
+	}
+
+	close(db);
+}
 
-	sqlite3* db = open();
-	std::string command = "SELECT * FROM recurring_payment;";
+void Database::gatherPrevious(long long id, std::vector<user_pair>* pairs)
+{
+	execute(Access::read, SELECT_PREVIOUS, { id }, callbackGatherPrevious, pairs);
+}
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), callback, payments, &zErrMsg);
-		i++;
+void Database::callbackGatherPartitions(const Row& row, void* data)
+{
+	std::vector<int>* months = (std::vector<int>*)data;
+	int month = 0;
+	if (Partitions::parse(std::string(row.text(0)), month)) {
+		months->push_back(month);
 	}
+}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+void Database::callbackGatherArchives(const Row& row, void* data)
+{
+	std::vector<Partitions::Partition>* archives = (std::vector<Partitions::Partition>*)data;
+	archives->push_back(Partitions::Partition{ static_cast<int>(row.integer(0)), std::string(row.text(1)) });
 }
 
-void Database::gatherRecords(const std::string& email, const std::string& account, RecordList* records)
+void Database::callbackGetBalance(const Row& row, void* data)
 {
-	int error_code = SQLITE_BUSY;
-	char *zErrMsg = 0;
+	std::pair<bool, Money>* balance = (std::pair<bool, Money>*)data;
+	balance->first = true;
+	balance->second = row.amount(0);
+}
+
+void Database::callbackDateRange(const Row& row, void* data)
+{
+	std::pair<int, int>* dates = (std::pair<int, int>*)data;
+	dates->first = row.day(0);
+	dates->second = row.day(1);
+}
+
+void Database::callbackTableExists(const Row&, void* data)
+{
+	// Because the callback is called only if a table was found, this is sufficient
+	bool* kk = (bool*) data;
+	*kk = true;
+}
+
+void Database::callbackColumnType(const Row& row, void* data)
+{
+	std::string* type = (std::string*) data;
+	*type = row.text(0);
+}
+
+void Database::callbackGetAccountId(const Row& row, void* data)
+{
+	long long* id = (long long*) data;
+	*id = row.integer(0);
+}
+
+void Database::callbackGetUser(const Row& row, void* data)
+{
+	User* user = (User*) data;
+	user->correct_ = true;
+	user->mail_ = row.text(USER_EMAIL);
+	user->password_ = row.text(USER_PASSWORD);
+}
+
+void Database::callbackGatherUsers(const Row& row, void* data)
+{
+	std::vector<User>* users = (std::vector<User>*) data;
+	User& user = users->emplace_back();
+	callbackGetUser(row, &user);
+}
+
+void Database::callbackFillAccounts(const Row& row, void* data)
+{
+	User* user = (User*) data;
+	Account& account = user->accounts_.emplace_back();
+
+	account.id_ = row.integer(ACCOUNT_ID);
+	account.mail_ = row.text(ACCOUNT_EMAIL);
+	account.name_ = row.text(ACCOUNT_NAME);
+	account.balance_ = row.amount(ACCOUNT_BALANCE);
+	account.state_ = (row.integer(ACCOUNT_STATE) == DB_USER_BLOCKED) ? State::blocked : State::ok;
+}
+
+void Database::callbackGetPayment(const Row& row, void* data)
+{
+	RecurringPayment* rp = (RecurringPayment*) data;
+	readPayment(row, *rp);
+}
 
-	sqlite3* db = open();
+void Database::callbackGatherPayments(const Row& row, void* data)
+{
+	PaymentList* payments = (PaymentList*) data;
+	payments->push_back(std::make_unique<RecurringPayment>());
+	readPayment(row, *payments->back());
+}
 
-	std::string command = "SELECT * FROM record WHERE (account_source=";
-	command += "'" + email + "'";
-	command += " AND ";
-	command += "name_source=";
-	command += "'" + account + "')";
-	command += " OR ";
-	command += "(account_target=";
-	command += "'" + email + "'";
-	command += " AND ";
-	command += "name_target=";
-	command += "'" + account + "')";
-	command += "ORDER BY date;";
+void Database::readPayment(const Row& row, RecurringPayment& rp)
+{
+	rp.correct_ = true;
+	rp.source_id_ = row.integer(PAYMENT_SOURCE_ID);
+	rp.target_id_ = row.integer(PAYMENT_TARGET_ID);
+	rp.account_source_ = row.text(PAYMENT_ACCOUNT_SOURCE);
+	rp.account_target_ = row.text(PAYMENT_ACCOUNT_TARGET);
+	rp.name_source_ = row.text(PAYMENT_NAME_SOURCE);
+	rp.name_target_ = row.text(PAYMENT_NAME_TARGET);
+	rp.next_payment_ = row.day(PAYMENT_NEXT_PAYMENT);
+	rp.amount_ = row.amount(PAYMENT_AMOUNT);
+
+	switch (row.integer(PAYMENT_INTERVAL)) {
+	case DB_INTERVAL_DAY:
+		rp.interval_ = Interval::day;
+		break;
+	case DB_INTERVAL_WEEK:
+		rp.interval_ = Interval::week;
+		break;
+	case DB_INTERVAL_MONTH:
+		rp.interval_ = Interval::month;
+		break;
+	case DB_INTERVAL_YEAR:
+		rp.interval_ = Interval::year;
+		break;
+	}
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), callbackGatherRecords, records, &zErrMsg);
-		i++;
+	switch (row.integer(PAYMENT_TYPE)) {
+	case DB_PAYMENT_STANDING_ORDER:
+		rp.type_ = PaymentType::standing_order;
+		break;
+	case DB_PAYMENT_DIRECT_DEBIT:
+		rp.type_ = PaymentType::direct_debit;
+		break;
 	}
+}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+void Database::callbackGatherRecords(const Row& row, void* data)
+{
+	RecordList* records = (RecordList*)data;
+	Record& record = records->emplace_back();
+
+	record.account_source_ = row.text(RECORD_ACCOUNT_SOURCE);
+	record.account_target_ = row.text(RECORD_ACCOUNT_TARGET);
+	record.name_source_ = row.text(RECORD_NAME_SOURCE);
+	record.name_target_ = row.text(RECORD_NAME_TARGET);
+	record.amount_ = row.amount(RECORD_AMOUNT);
+	record.date_ = row.day(RECORD_DATE);
 }
 
-void Database::gatherPrevious(const std::string& email, const std::string& account, std::vector<user_pair>* pairs)
+void Database::callbackGatherRecordPage(const Row& row, void* data)
 {
-	int error_code = SQLITE_BUSY;
-	char *zErrMsg = 0;
+	RecordPage* page = (RecordPage*)data;
+	callbackGatherRecords(row, &page->records);
+	page->rowids.push_back(row.integer(RECORD_ROWID));
+}
 
-	sqlite3* db = open();
+void Database::callbackGatherPrevious(const Row& row, void* data)
+{
+	std::vector<user_pair>* pairs = (std::vector<user_pair>*)data;
+	user_pair& pair = pairs->emplace_back();
 
-	std::string command = "SELECT * FROM previous WHERE account_source=";
-	command += "'" + email + "'";
-	command += " AND ";
-	command += "name_source=";
-	command += "'" + account + "';";
+	pair.email_source = row.text(PREVIOUS_ACCOUNT_SOURCE);
+	pair.email_target = row.text(PREVIOUS_ACCOUNT_TARGET);
+	pair.name_source = row.text(PREVIOUS_NAME_SOURCE);
+	pair.name_target = row.text(PREVIOUS_NAME_TARGET);
+}
 
-	int i = 0;
-	while ((error_code == SQLITE_BUSY) && (i < TIMEOUT_ATEMPTS)) {
-		error_code = sqlite3_exec(db, command.c_str(), callbackGatherPrevious, pairs, &zErrMsg);
-		i++;
+void Database::begin()
+{
+	connection = open(Access::write);
+
+	// Take the write lock right away, so the transaction can't fail halfway because of another writer
+	try {
+		execute(Access::write, BEGIN);
+	}
+	catch (db_exception&) {
+		end();
+		throw;
 	}
+}
 
-	sqlite3_close(db);
-	errorCheck(error_code, zErrMsg);
+void Database::commit()
+{
+	execute(Access::write, COMMIT);
+	end();
+
+	// The partitions created by the transaction can be read by the other connections now
+	for (int month : created) {
+		partitions->add(month);
+	}
+	created.clear();
 }
 
-int Database::callbackTableExists(void* data, int argc, char** argv, char** azColName)
+void Database::rollback()
 {
-	// Because the callback is called only if a table was found, this is sufficient
-	bool* kk = (bool*) data;
-	*kk = true;
-	return 0;
+	// A rollback only fails if there is no transaction in progress
+	try {
+		execute(Access::write, ROLLBACK);
+	}
+	catch (db_exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	end();
+	created.clear();
 }
 
-int Database::callbackGetUser(void* data, int argc, char** argv, char** azColName)
+void Database::savepoint()
 {
-	User* user = (User*) data;
-	user->correct_ = true;
-   
-	for(int i = 0; i < argc; i++){
-		if (std::string(azColName[i]) == "email") {
-			user->mail_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "password") {
-			user->password_ = argv[i];
-		}
+	execute(Access::write, SAVEPOINT);
+}
+
+void Database::rollbackToSavepoint()
+{
+	execute(Access::write, ROLLBACK_TO_SAVEPOINT);
+
+	// A partition created since the savepoint is gone with it
+	created.erase(std::remove_if(created.begin(), created.end(),
+		[this](int month) { return !tableExists(connection, Partitions::table(month)); }), created.end());
+}
+
+void Database::releaseSavepoint()
+{
+	execute(Access::write, RELEASE_SAVEPOINT);
+}
+
+long long Database::lastInsertId()
+{
+	if (connection == nullptr) {
+		throw db_exception("no transaction in progress");
 	}
-	return 0;
+	return sqlite3_last_insert_rowid(connection);
 }
 
-int Database::callbackFillAccounts(void* data, int argc, char** argv, char** azColName)
+void Database::beginBulkLoad()
 {
-	User* user = (User*) data;
-	Account account{};
-   
-	for(int i = 0; i < argc; i++){
-		if (std::string(azColName[i]) == "email") {
-			account.mail_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name") {
-			account.name_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "balance") {
-			account.balance_ = std::stod(argv[i]); 
-		}
-		else if (std::string(azColName[i]) == "state") {
-			if (std::stoi(argv[i]) == DB_USER_OK) {
-				account.state_ = State::ok;
-			}
-			else if (std::stoi(argv[i]) == DB_USER_BLOCKED) {
-				account.state_ = State::blocked;
+	sqlite3* db = open(Access::write);
+
+	char *zErrMsg = 0;
+	// The indexes are sorted faster through temporary files than in memory
+	std::string command = "PRAGMA synchronous = OFF;" \
+		"PRAGMA temp_store = FILE;";
+	int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+
+	close(db);
+	errorCheck(error_code, zErrMsg);
+
+	// The indexes of a month are dropped once the load writes to it
+	partitions->beginLoad();
+}
+
+void Database::endBulkLoad()
+{
+	sqlite3* db = open(Access::write);
+
+	try {
+		for (auto&& loaded : partitions->endLoad()) {
+			std::string table = Partitions::table(loaded.first);
+			createRecordIndexes(db, table);
+
+			// Grouped with the index of the sources in place, before temporary data goes to memory again
+			if (loaded.second != 0) {
+				queryPartition(db, Partitions::Partition{ loaded.first, "" }, INSERT_PREVIOUS_FROM_RECORDS,
+					{ loaded.second, DB_EXTERNAL_ACCOUNT }, NULL, NULL);
 			}
 		}
+
+		// The records loaded are history the balances imported already include
+		rebuildBalances(db);
+
+		char *zErrMsg = 0;
+		std::string command = "PRAGMA synchronous = " + config.synchronous + ";" \
+			"PRAGMA temp_store = " + config.temp_store + ";";
+		int error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+	}
+	catch (db_exception&) {
+		close(db);
+		throw;
 	}
-	user->accounts_.push_back(account);
 
-	return 0;
+	close(db);
 }
 
-int Database::callbackGetPayment(void* data, int argc, char** argv, char** azColName)
+void Database::archive(int month)
 {
-	RecurringPayment* rp = (RecurringPayment*) data;
-	rp->correct_ = true;
-   
-	for(int i = 0; i < argc; i++){
-		if (std::string(azColName[i]) == "account_source") {
-			rp->account_source_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "account_target") {
-			rp->account_target_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name_source") {
-			rp->name_source_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name_target") {
-			rp->name_target_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "next_payment") {
-			rp->next_payment_ = argv[i];
+	if (!partitions->contains(month) || partitions->archived(month)) {
+		throw db_exception("there are no records of " + Partitions::name(month) + " to archive");
+	}
+
+	std::string table = Partitions::table(month);
+	std::string file = table + ".db";
+	fs::path archive = archivePath(file);
+
+	// Left over by an archive that didn't finish
+	std::error_code ignored;
+	fs::create_directories(archive.parent_path(), ignored);
+	fs::permissions(archive, fs::perms::owner_write, fs::perm_options::add, ignored);
+	fs::remove(archive, ignored);
+
+	sqlite3* db = open(Access::write);
+
+	// The archive is committed first, the records only leave the database once it is complete
+	try {
+		int error_code = query(db, ATTACH_ARCHIVE, { archive.string() }, NULL, NULL);
+		errorCheck(error_code, sqlite3_errmsg(db));
+
+		char *zErrMsg = 0;
+		std::string command = "PRAGMA archive.journal_mode = DELETE;" \
+			"BEGIN IMMEDIATE;";
+		error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+
+		try {
+			createRecordTable(db, "archive.record");
+			command = "INSERT INTO archive.record (rowid,source_id,target_id,amount,date) " \
+				"SELECT rowid,source_id,target_id,amount,date FROM main." + table + " ORDER BY rowid;" \
+				"CREATE INDEX archive.record_source ON record(source_id, date);" \
+				"CREATE INDEX archive.record_target ON record(target_id, date);" \
+				"COMMIT;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
 		}
-		else if (std::string(azColName[i]) == "amount") {
-			rp->amount_ = std::stod(argv[i]);
+		catch (db_exception&) {
+			sqlite3_exec(db, "ROLLBACK; DETACH DATABASE archive;", NULL, 0, NULL);
+			throw;
 		}
-		else if (std::string(azColName[i]) == "interval") {
-			if (std::stoi(argv[i]) == DB_INTERVAL_DAY) {
-				rp->interval_ = Interval::day;
-			}
-			else if (std::stoi(argv[i]) == DB_INTERVAL_WEEK) {
-				rp->interval_ = Interval::week;
-			}
-			else if (std::stoi(argv[i]) == DB_INTERVAL_MONTH) {
-				rp->interval_ = Interval::month;
-			}
-			else if (std::stoi(argv[i]) == DB_INTERVAL_YEAR) {
-				rp->interval_ = Interval::year;
-			}
+
+		error_code = query(db, DETACH_ARCHIVE, {}, NULL, NULL);
+		errorCheck(error_code, sqlite3_errmsg(db));
+
+		error_code = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg);
+		errorCheck(error_code, zErrMsg);
+
+		try {
+			error_code = query(db, INSERT_ARCHIVE, { month, file }, NULL, NULL);
+			errorCheck(error_code, sqlite3_errmsg(db));
+
+			command = "DROP TABLE " + table + "; COMMIT;";
+			error_code = sqlite3_exec(db, command.c_str(), NULL, 0, &zErrMsg);
+			errorCheck(error_code, zErrMsg);
 		}
-		else if (std::string(azColName[i]) == "type") {
-			if (std::stoi(argv[i]) == DB_PAYMENT_STANDING_ORDER) {
-				rp->type_ = PaymentType::standing_order;
-			}
-			else if (std::stoi(argv[i]) == DB_PAYMENT_DIRECT_DEBIT) {
-				rp->type_ = PaymentType::direct_debit;
-			}
+		catch (db_exception&) {
+			sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+			throw;
 		}
 	}
+	catch (db_exception&) {
+		close(db);
+		throw;
+	}
+
+	close(db);
+	partitions->add(month, archive.string());
 
-	return 0;
+	// Nothing writes to an archive
+	fs::permissions(archive, fs::perms::owner_write | fs::perms::group_write | fs::perms::others_write,
+		fs::perm_options::remove, ignored);
 }
 
-int Database::callbackGatherRecords(void* data, int argc, char** argv, char** azColName)
+void Database::compact()
 {
-	RecordList* records = (RecordList*)data;
-	records->push_back(std::make_unique<Record>());
+	sqlite3* db = open(Access::write);
 
-	for(int i = 0; i < argc; i++){
-		if (std::string(azColName[i]) == "account_source") {
-			records->back()->account_source_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "account_target") {
-			records->back()->account_target_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name_source") {
-			records->back()->name_source_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "name_target") {
-			records->back()->name_target_ = argv[i];
-		}
-		else if (std::string(azColName[i]) == "amount") {
-			records->back()->amount_ = std::stod(argv[i]);
-		}
-		else if (std::string(azColName[i]) == "date") {
-			records->back()->date_ = argv[i];
-		}
+	char *zErrMsg = 0;
+	int error_code = sqlite3_exec(db, "VACUUM;", NULL, 0, &zErrMsg);
+
+	close(db);
+	errorCheck(error_code, zErrMsg);
+}
+
+void Database::execute(Access access, Statement id, std::initializer_list<Parameter> parameters,
+	RowCallback callback, void* data)
+{
+	sqlite3* db = open(access);
+
+	// The message has to be read before the connection is given to someone else
+	int error_code = query(db, id, parameters, callback, data);
+	std::string message = (error_code == SQLITE_OK) ? "" : sqlite3_errmsg(db);
+
+	close(db);
+	errorCheck(error_code, message);
+}
+
+void Database::readPartition(sqlite3* db, const Partitions::Partition* partition, bool& reading)
+{
+	bool needed = (connection == nullptr) && (partition != nullptr) && partition->archive.empty();
+	if (needed == reading) {
+		return;
 	}
 
-	return 0;
+	int error_code = query(db, needed ? BEGIN_READ : COMMIT, {}, NULL, NULL);
+	errorCheck(error_code, sqlite3_errmsg(db));
+	reading = needed;
 }
 
-int Database::callbackGatherPrevious(void* data, int argc, char** argv, char** azColName)
+int Database::query(sqlite3* db, Statement id, std::initializer_list<Parameter> parameters,
+	RowCallback callback, void* data)
 {
-	std::vector<user_pair>* pairs = (std::vector<user_pair>*)data;
-	user_pair pair{"", "", "", ""};
+	return run(db, pool->statement(db, id), sql(id), parameters, callback, data);
+}
+
+void Database::queryPartition(sqlite3* db, const Partitions::Partition& partition, Statement id,
+	std::initializer_list<Parameter> parameters, RowCallback callback, void* data)
+{
+	bool archived = !partition.archive.empty();
+	if (archived) {
+		int error_code = query(db, ATTACH_ARCHIVE, { partition.archive }, NULL, NULL);
+		errorCheck(error_code, sqlite3_errmsg(db));
+	}
 
-	for(int i = 0; i < argc; i++){
-		if (std::string(azColName[i]) == "account_source") {
-			pair.email_source = argv[i];
+	// The SQL is only built the first time the statement is prepared on this connection; the one on
+	// an archive stays prepared and is compiled again when another archive is attached
+	sqlite3_stmt*& statement = pool->statement(db, id, archived ? ARCHIVE_SLOT : partition.month);
+	std::string text = (statement != nullptr) ? "" : sql(id, archived ? "archive.record" : Partitions::table(partition.month));
+	int error_code = run(db, statement, text.c_str(), parameters, callback, data);
+	std::string message = (error_code == SQLITE_OK) ? "" : sqlite3_errmsg(db);
+
+	if (archived) {
+		int detached = query(db, DETACH_ARCHIVE, {}, NULL, NULL);
+		if (error_code == SQLITE_OK) {
+			error_code = detached;
+			message = (error_code == SQLITE_OK) ? "" : sqlite3_errmsg(db);
 		}
-		else if (std::string(azColName[i]) == "account_target") {
-			pair.email_target = argv[i];
+	}
+
+	errorCheck(error_code, message);
+}
+
+int Database::run(sqlite3* db, sqlite3_stmt*& statement, const char* text,
+	std::initializer_list<Parameter> parameters, RowCallback callback, void* data)
+{
+	// Compiled on the first use on this connection only
+	if (statement == nullptr) {
+		int error_code = sqlite3_prepare_v2(db, text, -1, &statement, nullptr);
+		if (error_code != SQLITE_OK) {
+			return error_code;
 		}
-		else if (std::string(azColName[i]) == "name_source") {
-			pair.name_source = argv[i];
+	}
+
+	int index = 1;
+	for (auto&& parameter : parameters) {
+		switch (parameter.type) {
+		case SQLITE_TEXT:
+			sqlite3_bind_text(statement, index, parameter.text.data(), static_cast<int>(parameter.text.size()),
+				SQLITE_STATIC);
+			break;
+		default:
+			sqlite3_bind_int64(statement, index, parameter.integer);
+			break;
 		}
-		else if (std::string(azColName[i]) == "name_target") {
-			pair.name_target = argv[i];
+		index++;
+	}
+
+	int error_code = step(statement, callback, data);
+	sqlite3_reset(statement);
+
+	// The bound text belongs to the caller
+	sqlite3_clear_bindings(statement);
+	return error_code;
+}
+
+int Database::step(sqlite3_stmt* statement, RowCallback callback, void* data)
+{
+	// The callback reads the columns straight from the statement
+	Row row(statement);
+
+	int error_code = sqlite3_step(statement);
+	while (error_code == SQLITE_ROW) {
+		if (callback != NULL) {
+			callback(row, data);
 		}
+		error_code = sqlite3_step(statement);
 	}
 
-	pairs->push_back(pair);
+	return (error_code == SQLITE_DONE) ? SQLITE_OK : error_code;
+}
+
+// Columns of a recurring payment with the emails and names of its accounts, in the order of `PaymentColumn`
+#define PAYMENT_COLUMNS "p.source_id, p.target_id, p.next_payment, p.amount, p.interval, p.type, " \
+	"s.email AS account_source, t.email AS account_target, s.name AS name_source, t.name AS name_target " \
+	"FROM recurring_payment p JOIN account s ON s.id=p.source_id JOIN account t ON t.id=p.target_id "
 
-	return 0;
+const char* Database::sql(Statement id)
+{
+	switch (id) {
+	case SELECT_TABLE:
+		return "SELECT name FROM sqlite_master WHERE type='table' AND name=?;";
+	case INSERT_USER:
+		return "INSERT INTO user (email,password) VALUES (?,?);";
+	case INSERT_ACCOUNT:
+		return "INSERT INTO account (name,email,balance,state) VALUES (?,?,?,?);";
+	case INSERT_PREVIOUS:
+		return "INSERT OR IGNORE INTO previous (source_id,target_id) VALUES (?,?);";
+	case SELECT_USER:
+		return "SELECT email,password FROM user WHERE email=?;";
+	// The external account belongs to no user
+	case SELECT_ACCOUNTS:
+		return "SELECT id,email,name,balance,state FROM account WHERE email=? AND id!=0;";
+	case SELECT_RECURRING_PAYMENT:
+		return "SELECT " PAYMENT_COLUMNS "WHERE p.source_id=?;";
+	case UPDATE_USER_PASSWORD:
+		return "UPDATE user SET password=? WHERE email=?;";
+	case UPDATE_ACCOUNT_BALANCE:
+		return "UPDATE account SET balance=? WHERE id=?;";
+	case UPDATE_ACCOUNT_STATE:
+		return "UPDATE account SET state=? WHERE id=?;";
+	case UPDATE_ACCOUNT_BALANCE_DELTA:
+		return "UPDATE account SET balance=balance+?,state=? WHERE id=?;";
+	case UPDATE_RECURRING_PAYMENT:
+		return "UPDATE recurring_payment SET next_payment=? WHERE source_id=?;";
+	case INSERT_RECURRING_PAYMENT:
+		return "INSERT INTO recurring_payment (source_id,target_id,next_payment,amount,interval,type) " \
+			"VALUES (?,?,?,?,?,?);";
+	case SELECT_RECURRING_PAYMENTS:
+		return "SELECT " PAYMENT_COLUMNS ";";
+	case SELECT_PREVIOUS:
+		return "SELECT s.email AS account_source, t.email AS account_target, s.name AS name_source, " \
+			"t.name AS name_target FROM previous p JOIN account s ON s.id=p.source_id " \
+			"JOIN account t ON t.id=p.target_id WHERE p.source_id=?;";
+	case BEGIN:
+		return "BEGIN IMMEDIATE;";
+	case COMMIT:
+		return "COMMIT;";
+	case ROLLBACK:
+		return "ROLLBACK;";
+	case SELECT_COLUMN:
+		return "SELECT type FROM pragma_table_info(?) WHERE name=?;";
+	case SELECT_ACCOUNT_ID:
+		return "SELECT id FROM account WHERE email=? AND name=?;";
+	case SAVEPOINT:
+		return "SAVEPOINT operation;";
+	case ROLLBACK_TO_SAVEPOINT:
+		return "ROLLBACK TO operation;";
+	case RELEASE_SAVEPOINT:
+		return "RELEASE operation;";
+	case SELECT_USERS:
+		return "SELECT email,password FROM user;";
+	case SELECT_ALL_ACCOUNTS:
+		return "SELECT id,email,name,balance,state FROM account WHERE id!=0 ORDER BY email,name;";
+	case SELECT_PARTITIONS:
+		return "SELECT name FROM sqlite_master WHERE type='table' AND name GLOB 'record_[0-9][0-9][0-9][0-9]_[0-9][0-9]';";
+	case SELECT_ARCHIVES:
+		return "SELECT month,file FROM record_archive;";
+	case INSERT_ARCHIVE:
+		return "INSERT OR REPLACE INTO record_archive (month,file) VALUES (?,?);";
+	// Nothing for an empty table
+	case SELECT_RECORD_DATES:
+		return "SELECT MIN(date),MAX(date) FROM record HAVING COUNT(*)>0;";
+	case ATTACH_ARCHIVE:
+		return "ATTACH DATABASE ? AS archive;";
+	case DETACH_ARCHIVE:
+		return "DETACH DATABASE archive;";
+	// Takes no lock until the first statement reads
+	case BEGIN_READ:
+		return "BEGIN DEFERRED;";
+	case UPDATE_BALANCE_DAY:
+		return "INSERT INTO balance_day (account_id,date,balance,delta) SELECT id,?2,balance,?3 FROM account WHERE id=?1 " \
+			"ON CONFLICT(account_id,date) DO UPDATE SET balance=excluded.balance,delta=delta+excluded.delta;";
+	// The end of the last day with a change up to the date, otherwise what the first change started from
+	case SELECT_BALANCE:
+		return "SELECT balance FROM (SELECT balance FROM balance_day WHERE account_id=?1 AND date<=?2 " \
+			"ORDER BY date DESC LIMIT 1) UNION ALL SELECT balance-delta FROM (SELECT balance,delta FROM balance_day " \
+			"WHERE account_id=?1 AND date>?2 ORDER BY date LIMIT 1) LIMIT 1;";
+	default:
+		return "";
+	}
 }
 
-sqlite3* Database::open()
+#undef PAYMENT_COLUMNS
+
+std::string Database::sql(Statement id, const std::string& table)
 {
-	sqlite3* db;
-	int error_code = sqlite3_open(path.c_str(), &db);
-	if (error_code) {
-		std::string message = "can't open database (";
-		message += sqlite3_errmsg(db);
-		message += ")";
-		throw db_exception(message);
+	// Columns of a record with the emails and names of its accounts, in the order of `RecordColumn`
+	auto columns = [&table]() {
+		return "SELECT r.rowid AS rowid, s.email AS account_source, t.email AS account_target, " \
+			"s.name AS name_source, t.name AS name_target, r.amount AS amount, r.date AS date FROM " + table + " r " \
+			"JOIN account s ON s.id=r.source_id JOIN account t ON t.id=r.target_id ";
+	};
+
+	switch (id) {
+	case INSERT_RECORD:
+		return "INSERT INTO " + table + " (source_id,target_id,amount,date) VALUES (?,?,?,?);";
+	// Grouped, the pairs come sorted and go into the index of `previous` in order
+	case INSERT_PREVIOUS_FROM_RECORDS:
+		return "INSERT OR IGNORE INTO previous (source_id,target_id) SELECT source_id,target_id " \
+			"FROM " + table + " WHERE rowid>=? AND source_id!=? GROUP BY source_id,target_id;";
+	// One index range scan per side of the records, merged in order; a record of a transfer to the
+	// same account is only taken from the source side
+	case SELECT_RECORDS:
+		return columns() + "WHERE r.source_id=?1 AND r.date>=?2 AND r.date<=?3 UNION ALL " + columns() +
+			"WHERE r.target_id=?1 AND r.source_id!=?1 AND r.date>=?2 AND r.date<=?3 ORDER BY date, rowid;";
+	case SELECT_RECORD_PAGE:
+		return columns() + "WHERE r.source_id=?1 AND r.date>=?2 AND r.date<=?3 AND (r.date, r.rowid)>(?4,?5) " \
+			"UNION ALL " + columns() + "WHERE r.target_id=?1 AND r.source_id!=?1 AND r.date>=?2 AND r.date<=?3 " \
+			"AND (r.date, r.rowid)>(?4,?5) ORDER BY date, rowid LIMIT ?6;";
+	// Both sides of each record, summed up by account and day; deposits come from outside of the bank
+	case INSERT_DAY_DELTAS:
+		return "INSERT INTO temp.day_delta (account_id,date,delta) SELECT account_id,date,SUM(delta) FROM (" \
+			"SELECT target_id AS account_id,date,amount AS delta FROM " + table + " UNION ALL " \
+			"SELECT source_id,date,-amount FROM " + table + ") WHERE account_id!=? GROUP BY account_id,date;";
+	default:
+		return "";
+	}
+}
+
+void Database::end()
+{
+	sqlite3* db = connection;
+	connection = nullptr;
+	close(db);
+}
+
+sqlite3* Database::open(Access access)
+{
+	// Statements of a transaction share its connection
+	if (connection != nullptr) {
+		return connection;
+	}
+
+	return pool->acquire(access == Access::write);
+}
+
+void Database::close(sqlite3* db)
+{
+	if (db != connection) {
+		pool->release(db);
 	}
-	return db;
 }
 
 void Database::errorCheck(int error_code, char* zErrMsg)
@@ -697,3 +1429,10 @@ void Database::errorCheck(int error_code, char* zErrMsg)
 		throw db_exception(message);
 	}
 }
+
+void Database::errorCheck(int error_code, const std::string& message)
+{
+	if (error_code != SQLITE_OK) {
+		throw db_exception(message);
+	}
+}
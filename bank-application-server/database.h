@@ -1,28 +1,73 @@
 #include <string>
+#include <string_view>
+#include <initializer_list>
 #include "sqlite/sqlite3.h"
 #include  <vector>
 #include  <memory>
+#include "connection_pool.h"
+#include "database_config.h"
 #include "dto.h"
+#include "partitions.h"
+#include "row.h"
 
 #ifndef DATABASE_H_
 #define DATABASE_H_
 
 using PaymentList = std::vector<std::unique_ptr<RecurringPayment>>;
-using RecordList = std::vector<std::unique_ptr<Record>>;
+using RecordList = std::vector<Record>;
+
+// Called for each row of a result, with the data passed along with the statement
+using RowCallback = void (*)(const Row& row, void* data);
+
+/**
+ * A page of records together with the rowid of each of them, the date and rowid of a record
+ * give its position in the history.
+ */
+struct RecordPage {
+	RecordList records;
+	std::vector<long long> rowids;
+};
 
 /**
  * Database management, issuing SQL queries for actions. This class aims
  * to simplify and make the database access more abstract. It wraps
  * SQLite queries as methods on this class, making it easier for
  * BankServer to access database.
+ *
+ * Every query is a statement with bound parameters, prepared once per connection and then
+ * reused, so no SQL is compiled while serving requests.
+ *
+ * The history of records is split by month, see `Partitions`. The balance of each account at the
+ * end of each day it changed is kept next to it (`balance_day`), so a past balance is read
+ * without going through the history.
  */
 class Database {
 public:
 	/**
-	 * Ensure the database exists and contains the neccessary tables.
+	 * Ensure the database exists and contains the neccessary tables, open the connections.
+	 * Copies of the object share the connections.
 	 * @param[in]	current_path	path to the executable
+	 * @param[in]	readers			Number of connections for reading (one per thread using the object)
+	 */
+	void setup(const std::string& current_path, std::size_t readers = 1);
+
+	/**
+	 * Copy the changes committed to the write-ahead log into the database file, as far as it goes
+	 * without waiting for the readers. Keeps the log short, so that commits don't have to do it.
+	 */
+	void checkpoint();
+
+	/**
+	 * The tuning of the connections, read from `database.conf` next to the database file.
+	 * @returns		The config
+	 */
+	const DatabaseConfig& getConfig() const { return config; };
+
+	/**
+	 * The months the history of records is split into.
+	 * @returns		The partitions
 	 */
-	void setup(const std::string& current_path);
+	const Partitions& getPartitions() const { return *partitions; };
 
 	/**
 	 * Add new user to database.
@@ -33,20 +78,32 @@ public:
 	/**
 	 * Add new account to database.
 	 * @param[in]	account	Account to be added
+	 * @returns				Identifier of the account, read from the connection that inserted it
 	 */
-	void addAccount(const Account& account);
+	long long addAccount(const Account& account);
 
 	/**
-	 * Add new record to database.
+	 * Add new record to database, stored with the identifiers of its accounts in the partition of
+	 * its month (created if it doesn't exist yet).
 	 * @param[in]	record	Record to be added
+	 * @throws db_exception if the month of the record has been archived
 	 */
 	void addRecord(const Record& record);
 
 	/**
-	 * Add new user pair to database.
-	 * @param[in]	pair	User pair to be added
+	 * Add new pair of accounts to database.
+	 * @param[in]	source_id	Identifier of the source account
+	 * @param[in]	target_id	Identifier of the target account
+	 */
+	void addPrevious(long long source_id, long long target_id);
+
+	/**
+	 * Find the identifier of an account, so that the rest of a request can use it.
+	 * @param[in]	email	Email of the account owner
+	 * @param[in]	name	Name of the account
+	 * @returns				The identifier, DB_NO_ACCOUNT if there is no such account
 	 */
-	void addPrevious(const user_pair& pair);
+	long long getAccountId(const std::string& email, const std::string& name);
 
 	/**
 	 * Return existing user from the database.
@@ -55,12 +112,18 @@ public:
 	 */
 	User getUser(const std::string& email);
 
+	/**
+	 * List all the users with their accounts (ordered by name), at once.
+	 * @param[out]	users	A list of users
+	 */
+	void gatherUsers(std::vector<User>* users);
+
 	/**
 	 * Return recurring payment from the database.
-	 * @param[in]	email	Email identifying the recurring payment
-	 * returns				The recurring payment
+	 * @param[in]	source_id	Identifier of the source account, identifying the recurring payment
+	 * returns					The recurring payment
 	 */
-	RecurringPayment getRecurringPayment(const std::string& email, const std::string& name);
+	RecurringPayment getRecurringPayment(long long source_id);
 
 	/**
 	 * Update a value in the user table.
@@ -73,49 +136,156 @@ public:
 
 	/**
 	 * Update a value in the account table.
-	 * @param[in]	email		Email identifying the user
-	 * @param[in]	account		Name identifying the account
+	 * @param[in]	id			Identifier of the account
 	 * @param[in]	column_name	Column containing the value
 	 * @param[in]	new_value	New value
 	 */
-	void changeValueAccount(const std::string& email, const std::string& account, 
-		const std::string& column_name, const std::string& new_value);
+	void changeValueAccount(long long id, const std::string& column_name, const std::string& new_value);
+
+	/**
+	 * Change the balance of an account in place together with its state, in a single statement.
+	 * The delta is added to the balance stored, so the write doesn't depend on the balance read.
+	 * The balance of the account at the end of the day becomes the new one.
+	 * @param[in]	id		Identifier of the account
+	 * @param[in]	delta	Amount added to the balance (negative to take money from it)
+	 * @param[in]	state	State of the account after the change
+	 * @param[in]	date	Day of the change (days since 1970-01-01)
+	 */
+	void addToBalance(long long id, Money delta, State state, int date);
+
+	/**
+	 * Find the balance of an account at the end of a day, by a single lookup of the index of the
+	 * end-of-day balances: the last day the balance changed up to the date, or if it only changed
+	 * later, the balance it had before the first change.
+	 * @param[in]	id		Identifier of the account
+	 * @param[in]	date	The day (days since 1970-01-01)
+	 * @param[out]	balance	The balance
+	 * @returns				Whether the balance has ever changed, the current one applies if not
+	 */
+	bool getBalance(long long id, int date, Money& balance);
 
 	/**
 	 * Update the next payment date of recurring payment in the recurring_payment table.
-	 * @param[in]	account_source	Email identifying the payment
-	 * @param[in]	new_value		New date
+	 * @param[in]	source_id	Identifier of the source account, identifying the payment
+	 * @param[in]	new_value	New date (days since 1970-01-01)
 	 */
-	void updateRecurringPayment(const std::string& account_source, const std::string& name_source, const std::string& new_value);
+	void updateRecurringPayment(long long source_id, int new_value);
 
 	/**
-	 * Add new recurring payment into the database.
+	 * Add new recurring payment into the database, stored with the identifiers of its accounts.
 	 * @param[in]	rp	Payment to be added to database
 	 */
 	void addRecurringPayment(const RecurringPayment& rp);
 
 	/**
 	 * List all the recurring payments in database.
-	 * @param[in]	callback	A callback responsible for adding a recurring payment into the list
 	 * @param[out]	payments	A list of of recurring payments	
 	 */
-	void gatherRecurringPayments(int (*callback)(void*,int,char**,char**), PaymentList* payments);
+	void gatherRecurringPayments(PaymentList* payments);
 
 	/**
-	 * List all the records in database corresponding to given account.
-	 * @param[in]	email		User email
-	 * @param[in]	account		Account name
+	 * List the records corresponding to given account within a date range, ordered by date.
+	 * The range is read from the indexes of the months it overlaps, so the rest of the history is
+	 * not touched. Archived months are attached while they are read, which can't be done within
+	 * a transaction.
+	 * @param[in]	id			Identifier of the account
+	 * @param[in]	date_from	First date of the range (inclusive, days since 1970-01-01)
+	 * @param[in]	date_to		Last date of the range (inclusive, days since 1970-01-01)
 	 * @param[out]	records		A list of of records
 	 */
-	void gatherRecords(const std::string& email, const std::string& account, RecordList* records);
+	void gatherRecords(long long id, int date_from, int date_to, RecordList* records);
+
+	/**
+	 * List a page of the records corresponding to given account within a date range, ordered by
+	 * date and rowid. Only the rows of the page are read, whatever the length of the history: the
+	 * months from the one of the cursor on are read until the page is full.
+	 * @param[in]	id			Identifier of the account
+	 * @param[in]	date_from	First date of the range (inclusive, days since 1970-01-01)
+	 * @param[in]	date_to		Last date of the range (inclusive, days since 1970-01-01)
+	 * @param[in]	after_date	Date of the record the page follows (anything before date_from for the first page)
+	 * @param[in]	after_rowid	Rowid of the record the page follows
+	 * @param[in]	limit		Maximum number of records
+	 * @param[out]	page		The records
+	 */
+	void gatherRecordPage(long long id, int date_from, int date_to, int after_date, long long after_rowid, int limit,
+		RecordPage* page);
 
 	/**
 	 * List all accounts an account has interacted with (as source, not target).
-	 * @param[in]	email		User email
-	 * @param[in]	account		Account name
+	 * @param[in]	id			Identifier of the account
 	 * @param[out]	pairs		A list of of user pairs (this account, account it interacted with)
 	 */
-	void gatherPrevious(const std::string& email, const std::string& account, std::vector<user_pair>* pairs);
+	void gatherPrevious(long long id, std::vector<user_pair>* pairs);
+
+	/**
+	 * Start a transaction. Until it is committed or rolled back, all the methods share a single
+	 * connection, so the object must not be used by other threads meanwhile (a copy of the shared
+	 * object is meant to be used, `Transaction` takes care of this).
+	 */
+	void begin();
+
+	/**
+	 * Commit the transaction in progress.
+	 */
+	void commit();
+
+	/**
+	 * Roll back the transaction in progress.
+	 */
+	void rollback();
+
+	/**
+	 * Mark the start of an operation within the transaction in progress.
+	 */
+	void savepoint();
+
+	/**
+	 * Discard the changes made since the last savepoint, the savepoint stays in place.
+	 */
+	void rollbackToSavepoint();
+
+	/**
+	 * Forget the last savepoint, its changes become a part of the transaction.
+	 */
+	void releaseSavepoint();
+
+	/**
+	 * Identifier (rowid) of the row last inserted by the transaction in progress.
+	 * @returns		The identifier
+	 */
+	long long lastInsertId();
+
+	/**
+	 * Prepare the database for loading a large amount of rows: the indexes of each month of the
+	 * history are dropped once the load writes to it, so that they are built once at the end instead
+	 * of row by row, commits don't wait for the disk and temporary data goes to files (sorting a
+	 * large index in memory is slower). Meant for a database no server is using meanwhile.
+	 */
+	void beginBulkLoad();
+
+	/**
+	 * Rebuild the indexes dropped by the bulk load, add the pairs of accounts of the transfers
+	 * loaded to the `previous` table (deposits are left out), derive the end-of-day balances from the
+	 * history again and go back to the settings of the config.
+	 */
+	void endBulkLoad();
+
+	/**
+	 * Move the records of a closed month out of the database into an archive file of their own
+	 * (`archive/record_YYYY_MM.db` next to the database), which is then made read-only. The file is
+	 * written in rowid order with the indexes built after the rows, so it holds no free space; the
+	 * pages the month leaves in the database are reused by the next months. The archive is
+	 * complete before the records are dropped, an archive that doesn't finish is started over.
+	 * Meant for a database no server is using meanwhile.
+	 * @param[in]	month	The month (see `Partitions::month`)
+	 */
+	void archive(int month);
+
+	/**
+	 * Rewrite the database file without its free pages, such as those the archived months left.
+	 * Meant for a database no server is using meanwhile.
+	 */
+	void compact();
 
 	// Integer representation of user state
 	static const int DB_USER_OK = 0;
@@ -131,12 +301,64 @@ public:
 	static const  int DB_INTERVAL_MONTH = 2;
 	static const  int DB_INTERVAL_YEAR = 3;
 
+	// Identifier of the account standing for the outside of the bank, the source of deposits ("-")
+	static const int DB_EXTERNAL_ACCOUNT = 0;
+
+	// Identifier returned for an account that doesn't exist
+	static const int DB_NO_ACCOUNT = -1;
+
 private:
 	// Path to the database file
 	std::string path = "";
 
-	// An exception is thrown if the same SQL query fails too many times because the database is busy 
-	const int TIMEOUT_ATEMPTS = 5;
+	// Tuning of the connections
+	DatabaseConfig config{};
+
+	// Kind of use of a connection
+	enum class Access {
+		read, write
+	};
+
+	// Identifiers of the prepared statements
+	enum Statement : std::size_t {
+		SELECT_TABLE, INSERT_USER, INSERT_ACCOUNT, INSERT_RECORD, INSERT_PREVIOUS, SELECT_USER, SELECT_ACCOUNTS,
+		SELECT_RECURRING_PAYMENT, UPDATE_USER_PASSWORD, UPDATE_ACCOUNT_BALANCE, UPDATE_ACCOUNT_STATE,
+		UPDATE_RECURRING_PAYMENT, INSERT_RECURRING_PAYMENT, SELECT_RECURRING_PAYMENTS, SELECT_RECORDS,
+		SELECT_RECORD_PAGE, SELECT_PREVIOUS, BEGIN, COMMIT, ROLLBACK, SELECT_COLUMN, SELECT_ACCOUNT_ID, SAVEPOINT,
+		ROLLBACK_TO_SAVEPOINT, RELEASE_SAVEPOINT, SELECT_USERS, SELECT_ALL_ACCOUNTS,
+		UPDATE_ACCOUNT_BALANCE_DELTA, INSERT_PREVIOUS_FROM_RECORDS, SELECT_PARTITIONS, SELECT_ARCHIVES,
+		INSERT_ARCHIVE, SELECT_RECORD_DATES, ATTACH_ARCHIVE, DETACH_ARCHIVE, BEGIN_READ, UPDATE_BALANCE_DAY,
+		SELECT_BALANCE, INSERT_DAY_DELTAS
+	};
+
+	/**
+	 * Value bound to a parameter of a statement, text refers to the caller's data.
+	 */
+	struct Parameter {
+		Parameter(const std::string& text) : type(SQLITE_TEXT), text(text), integer(0) {};
+		Parameter(long long integer) : type(SQLITE_INTEGER), text(), integer(integer) {};
+		Parameter(int integer) : type(SQLITE_INTEGER), text(), integer(integer) {};
+		Parameter(Money amount) : type(SQLITE_INTEGER), text(), integer(amount.cents()) {};
+
+		int type;
+		std::string_view text;
+		long long integer;
+	};
+
+	// Connections reused by all the statements
+	std::shared_ptr<ConnectionPool> pool;
+
+	// Months of the history, shared by the copies
+	std::shared_ptr<Partitions> partitions;
+
+	// Months whose partition the transaction in progress created, added to `partitions` once it's committed
+	std::vector<int> created;
+
+	// Partition the statements on an attached archive are kept for, whatever its month
+	static const int ARCHIVE_SLOT = -0x7fffffff;
+
+	// Connection of the transaction in progress (if any)
+	sqlite3* connection = nullptr;
 
 	/**
 	 * Sets the appropriate directory where the database file ought to reside.
@@ -170,10 +392,70 @@ private:
 	void createAccountTable(sqlite3* db);
 
 	/**
-	 * Create record table in database.
+	 * Create record table in database, unless it exists already.
+	 * @param[in]	db			Database
+	 * @param[in]	table		Name of the table
+	 */
+	void createRecordTable(sqlite3* db, const std::string& table);
+
+	/**
+	 * Create the indexes of the history of an account (as source and as target) in a record
+	 * table, unless they exist already.
+	 * @param[in]	db			Database
+	 * @param[in]	table		Name of the table
+	 */
+	void createRecordIndexes(sqlite3* db, const std::string& table);
+
+	/**
+	 * Drop the indexes of the history of an account in a record table.
+	 * @param[in]	db			Database
+	 * @param[in]	table		Name of the table
+	 */
+	void dropRecordIndexes(sqlite3* db, const std::string& table);
+
+	/**
+	 * Create the table of the archived months in database.
+	 * @param[in]	db			Database
+	 */
+	void createArchiveTable(sqlite3* db);
+
+	/**
+	 * Read the months of the history there are (in the database and archived) and build the
+	 * indexes a bulk load that didn't finish left out.
+	 * @param[in]	db			Database
+	 */
+	void loadPartitions(sqlite3* db);
+
+	/**
+	 * Make sure the partition of a month can be written to: create it if it doesn't exist yet and
+	 * drop its indexes if a bulk load writes to it for the first time.
+	 * @param[in]	db			Database
+	 * @param[in]	month		The month
+	 * @returns					Whether a bulk load writes to the partition for the first time
+	 */
+	bool preparePartition(sqlite3* db, int month);
+
+	/**
+	 * Path to an archive file.
+	 * @param[in]	file		Name of the file
+	 * @returns					The path
+	 */
+	std::string archivePath(const std::string& file);
+
+	/**
+	 * Create the table of the balances of the accounts at the end of each day they changed in
+	 * database, unless it exists already.
 	 * @param[in]	db			Database
 	 */
-	void createRecordTable(sqlite3* db);
+	void createBalanceTable(sqlite3* db);
+
+	/**
+	 * Fill the end-of-day balances from the history of records, replayed back from the current
+	 * balances: a day ends with the balance less the changes of the days after it. The history is
+	 * read a month at a time (archives included) and the balances are replaced all at once.
+	 * @param[in]	db			Database
+	 */
+	void rebuildBalances(sqlite3* db);
 
 	/**
 	 * Create previous table in database.
@@ -181,62 +463,280 @@ private:
 	 */
 	void createPreviousTable(sqlite3* db);
 
+	/**
+	 * Get the declared type of a column.
+	 * @param[in]	db			Database
+	 * @param[in]	table_name	Name of the table
+	 * @param[in]	column_name	Name of the column
+	 * @returns					The type, empty if the table has no such column
+	 */
+	std::string columnType(sqlite3* db, const std::string& table_name, const std::string& column_name);
+
+	/**
+	 * Convert a database from before the account identifiers in place: number the accounts and
+	 * replace the emails and names in the other tables by the identifiers. Either the whole
+	 * conversion is committed or nothing is changed.
+	 * @param[in]	db			Database
+	 */
+	void migrateAccountIds(sqlite3* db);
+
+	/**
+	 * Convert the YYYY-MM-DD text dates of the records and recurring payments to the number of
+	 * days since 1970-01-01 in place, committed all at once.
+	 * @param[in]	db			Database
+	 */
+	void migrateEpochDays(sqlite3* db);
+
+	/**
+	 * Convert the balances and amounts stored as floating point numbers to whole hundredths in
+	 * place, committed all at once.
+	 * @param[in]	db			Database
+	 */
+	void migrateMinorUnits(sqlite3* db);
+
+	/**
+	 * Split the records of a database from before the partitions by month in place, keeping their
+	 * rowid, committed all at once.
+	 * @param[in]	db			Database
+	 */
+	void migratePartitions(sqlite3* db);
+
+	// Positions of the columns in the results, in the order the statements select them
+	enum UserColumn : int {
+		USER_EMAIL, USER_PASSWORD
+	};
+	enum AccountColumn : int {
+		ACCOUNT_ID, ACCOUNT_EMAIL, ACCOUNT_NAME, ACCOUNT_BALANCE, ACCOUNT_STATE
+	};
+	enum RecordColumn : int {
+		RECORD_ROWID, RECORD_ACCOUNT_SOURCE, RECORD_ACCOUNT_TARGET, RECORD_NAME_SOURCE, RECORD_NAME_TARGET,
+		RECORD_AMOUNT, RECORD_DATE
+	};
+	enum PaymentColumn : int {
+		PAYMENT_SOURCE_ID, PAYMENT_TARGET_ID, PAYMENT_NEXT_PAYMENT, PAYMENT_AMOUNT, PAYMENT_INTERVAL, PAYMENT_TYPE,
+		PAYMENT_ACCOUNT_SOURCE, PAYMENT_ACCOUNT_TARGET, PAYMENT_NAME_SOURCE, PAYMENT_NAME_TARGET
+	};
+	enum PreviousColumn : int {
+		PREVIOUS_ACCOUNT_SOURCE, PREVIOUS_ACCOUNT_TARGET, PREVIOUS_NAME_SOURCE, PREVIOUS_NAME_TARGET
+	};
+
 	/**
 	 * Database query callback, sets boolean to true if table exists.
+	 * @param[in]	row			The table
 	 * @param[out]	data		Boolean indicating existence of table
 	 */
-	static int callbackTableExists(void* data, int argc, char** argv, char** azColName);
+	static void callbackTableExists(const Row& row, void* data);
+
+	/**
+	 * Database query callback, reads the declared type of a column.
+	 * @param[in]	row			The column
+	 * @param[out]	data		Pointer to the type
+	 */
+	static void callbackColumnType(const Row& row, void* data);
+
+	/**
+	 * Database query callback, reads the identifier of an account.
+	 * @param[in]	row			The account
+	 * @param[out]	data		Pointer to the identifier
+	 */
+	static void callbackGetAccountId(const Row& row, void* data);
 
 	/**
 	 * Database query callback, creates a user corresponding to user in database (if exists).
+	 * @param[in]	row			The user
 	 * @param[out]	data		User object to fill with database data
-	 * @param[in]	argc		Number of columns
-	 * @param[in]	argv		Values in columns
-	 * @param[in]	azColName	Column names
 	 */
-	static int callbackGetUser(void* data, int argc, char** argv, char** azColName);
+	static void callbackGetUser(const Row& row, void* data);
+
+	/**
+	 * Database query callback, creates a user object for each user in database.
+	 * @param[in]	row			The user
+	 * @param[out]	data		Pointer to (initially empty) vector of users
+	 */
+	static void callbackGatherUsers(const Row& row, void* data);
 
 	/**
 	 * Database query callback, creates an account object for each account in database.
+	 * @param[in]	row			The account
 	 * @param[out]	data		Pointer to user object (whose accounts we want)
-	 * @param[in]	argc		Number of columns
-	 * @param[in]	argv		Values in columns
-	 * @param[in]	azColName	Column names
 	 */
-	static int callbackFillAccounts(void* data, int argc, char** argv, char** azColName);
+	static void callbackFillAccounts(const Row& row, void* data);
 
 	/**
 	 * Database query callback, creates a payment corresponding to payment in database (if exists).
-	 * @para[out]	data		Recurring payment object to fill with database data
-	 * @para[in]	argc		Number of columns
-	 * @para[in]	argv		Values in columns
-	 * @para[in]	azColName	Column names
+	 * @param[in]	row			The payment
+	 * @param[out]	data		Recurring payment object to fill with database data
+	 */
+	static void callbackGetPayment(const Row& row, void* data);
+
+	/**
+	 * Database query callback, creates a recurring payment object for each payment in database.
+	 * @param[in]	row			The payment
+	 * @param[out]	data		Pointer to (initially empty) list of recurring payments
 	 */
-	static int callbackGetPayment(void* data, int argc, char** argv, char** azColName);
+	static void callbackGatherPayments(const Row& row, void* data);
 
 	/**
 	 * Database query callback, creates a record object for each record in database.
+	 * @param[in]	row			The record
 	 * @param[out]	data		Pointer to (initially empty) vector of records
-	 * @param[in]	argc		Number of columns
-	 * @param[in]	argv		Values in columns
-	 * @param[in]	azColName	Column names
 	 */
-	static int callbackGatherRecords(void* data, int argc, char** argv, char** azColName);
+	static void callbackGatherRecords(const Row& row, void* data);
+
+	/**
+	 * Database query callback, creates a record object for each record in database and keeps its rowid.
+	 * @param[in]	row			The record
+	 * @param[out]	data		Pointer to (initially empty) page of records
+	 */
+	static void callbackGatherRecordPage(const Row& row, void* data);
 	
 	/**
 	 * Database query callback, creates a previous object for each 'previous' in database.
+	 * @param[in]	row			The pair of accounts
 	 * @param[out]	data		Pointer to (initially empty) vector of user pairs
-	 * @param[in]	argc		Number of columns
-	 * @param[in]	argv		Values in columns
-	 * @param[in]	azColName	Column names
 	 */
-	static int callbackGatherPrevious(void* data, int argc, char** argv, char** azColName);
+	static void callbackGatherPrevious(const Row& row, void* data);
 
 	/**
-	 * Open a database connection.
-	 * @returns		Database connection
+	 * Database query callback, reads the month of each partition table.
+	 * @param[in]	row			The table
+	 * @param[out]	data		Pointer to (initially empty) vector of months
 	 */
-	sqlite3* open();
+	static void callbackGatherPartitions(const Row& row, void* data);
+
+	/**
+	 * Database query callback, reads the month and file of each archived month.
+	 * @param[in]	row			The archived month
+	 * @param[out]	data		Pointer to (initially empty) vector of partitions
+	 */
+	static void callbackGatherArchives(const Row& row, void* data);
+
+	/**
+	 * Database query callback, reads the balance of an account.
+	 * @param[in]	row			The balance
+	 * @param[out]	data		Pointer to the pair of whether it was found and the balance
+	 */
+	static void callbackGetBalance(const Row& row, void* data);
+
+	/**
+	 * Database query callback, reads the first and last date of the records.
+	 * @param[in]	row			The dates
+	 * @param[out]	data		Pointer to the pair of dates
+	 */
+	static void callbackDateRange(const Row& row, void* data);
+
+	/**
+	 * Fill a recurring payment from a row.
+	 * @param[in]	row		The payment
+	 * @param[out]	rp		The payment to fill
+	 */
+	static void readPayment(const Row& row, RecurringPayment& rp);
+
+	/**
+	 * Borrow a database connection from the pool (or get the one of the transaction in progress).
+	 * @param[in]	access	Whether the connection is used for reading or writing
+	 * @returns				Database connection
+	 */
+	sqlite3* open(Access access);
+
+	/**
+	 * Give a database connection back, unless it belongs to the transaction in progress.
+	 * @param[in]	db		Database connection
+	 */
+	void close(sqlite3* db);
+
+	/**
+	 * Run a statement on a connection borrowed for it (or the one of the transaction in progress).
+	 * @param[in]	access		Whether the statement reads or writes
+	 * @param[in]	id			Identifier of the statement
+	 * @param[in]	parameters	Values of the parameters, in order
+	 * @param[in]	callback	Called for each row of the result (may be NULL)
+	 * @param[out]	data		Passed to the callback
+	 */
+	void execute(Access access, Statement id, std::initializer_list<Parameter> parameters = {},
+		RowCallback callback = NULL, void* data = NULL);
+
+	/**
+	 * Run a statement on given connection, preparing it first if this connection hasn't yet.
+	 * While the database is locked the connection waits in the busy handler (see `DatabaseConfig`).
+	 * @param[in]	db			Database connection
+	 * @param[in]	id			Identifier of the statement
+	 * @param[in]	parameters	Values of the parameters, in order
+	 * @param[in]	callback	Called for each row of the result (may be NULL)
+	 * @param[out]	data		Passed to the callback
+	 * @returns					SQLite result code
+	 */
+	int query(sqlite3* db, Statement id, std::initializer_list<Parameter> parameters,
+		RowCallback callback, void* data);
+
+	/**
+	 * Run a statement on a partition of the history on given connection, preparing it first if this
+	 * connection hasn't yet. An archived partition is attached for the statement, which can't be
+	 * done within a transaction.
+	 * @param[in]	db			Database connection
+	 * @param[in]	partition	The partition
+	 * @param[in]	id			Identifier of the statement (see `sql(Statement, const std::string&)`)
+	 * @param[in]	parameters	Values of the parameters, in order
+	 * @param[in]	callback	Called for each row of the result (may be NULL)
+	 * @param[out]	data		Passed to the callback
+	 * @throws db_exception if the statement fails
+	 */
+	void queryPartition(sqlite3* db, const Partitions::Partition& partition, Statement id,
+		std::initializer_list<Parameter> parameters, RowCallback callback, void* data);
+
+	/**
+	 * Keep the statements reading the partitions in the database within a single read transaction
+	 * on a connection, so the locks of the database are taken once for all of them (and they see
+	 * the same state); an archive is attached outside of it. Nothing is done within a transaction
+	 * of the object.
+	 * @param[in]		db			Database connection
+	 * @param[in]		partition	Partition read next, nullptr once all of them have been read
+	 * @param[in,out]	reading		Whether the read transaction is in progress
+	 */
+	void readPartition(sqlite3* db, const Partitions::Partition* partition, bool& reading);
+
+	/**
+	 * Prepare a statement unless it is already, bind its parameters and run it.
+	 * @param[in]		db			Database connection
+	 * @param[in,out]	statement	Slot of the statement on the connection
+	 * @param[in]		text		SQL of the statement
+	 * @param[in]		parameters	Values of the parameters, in order
+	 * @param[in]		callback	Called for each row of the result (may be NULL)
+	 * @param[out]		data		Passed to the callback
+	 * @returns						SQLite result code
+	 */
+	static int run(sqlite3* db, sqlite3_stmt*& statement, const char* text,
+		std::initializer_list<Parameter> parameters, RowCallback callback, void* data);
+
+	/**
+	 * Step through the result of a prepared statement, handing each row to the callback.
+	 * @param[in]	statement	The statement with bound parameters
+	 * @param[in]	callback	Called for each row of the result (may be NULL)
+	 * @param[out]	data		Passed to the callback
+	 * @returns					SQLite result code
+	 */
+	static int step(sqlite3_stmt* statement, RowCallback callback, void* data);
+
+	/**
+	 * SQL of a statement.
+	 * @param[in]	id		Identifier of the statement
+	 * @returns				The SQL
+	 */
+	static const char* sql(Statement id);
+
+	/**
+	 * SQL of a statement on a partition of the history (INSERT_RECORD, INSERT_PREVIOUS_FROM_RECORDS,
+	 * SELECT_RECORDS, SELECT_RECORD_PAGE or INSERT_DAY_DELTAS).
+	 * @param[in]	id		Identifier of the statement
+	 * @param[in]	table	Table of the partition
+	 * @returns				The SQL
+	 */
+	static std::string sql(Statement id, const std::string& table);
+
+	/**
+	 * Close the connection of the transaction in progress.
+	 */
+	void end();
 
 	/**
 	 * Throw an exception if an error occured during execution of SQL query.
@@ -244,6 +744,13 @@ private:
 	 * @param[in]	zErrMsg		Detailed error message
 	 */
 	void errorCheck(int error_code, char* zErrMsg);
+
+	/**
+	 * Throw an exception if an error occured during execution of SQL statement.
+	 * @param[in]	error_code	Error type (or indication that no error occured)
+	 * @param[in]	message		Detailed error message
+	 */
+	void errorCheck(int error_code, const std::string& message);
 };
 
 #endif
@@ -0,0 +1,88 @@
+#include "database_config.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+
+/**
+ * Strip the whitespace around a string.
+ * @param[in]	text	The string
+ * @returns				The string without leading and trailing whitespace
+ */
+static std::string trim(const std::string& text)
+{
+	auto space = [](unsigned char c) { return std::isspace(c); };
+	auto begin = std::find_if_not(text.begin(), text.end(), space);
+	auto end = std::find_if_not(text.rbegin(), text.rend(), space).base();
+	return (begin < end) ? std::string(begin, end) : "";
+}
+
+/**
+ * Check that a value of a pragma is a single keyword, so it can be put into the pragma safely.
+ * @param[in]	value	The value
+ * @returns				True if the value is a keyword
+ */
+static bool keyword(const std::string& value)
+{
+	return !value.empty() && std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isalpha(c); });
+}
+
+DatabaseConfig DatabaseConfig::load(const std::string& file)
+{
+	DatabaseConfig config{};
+
+	std::ifstream in(file);
+	std::string line;
+	while (std::getline(in, line)) {
+		line = trim(line);
+		std::size_t separator = line.find('=');
+		if (line.empty() || (line[0] == '#') || (separator == std::string::npos)) {
+			continue;
+		}
+
+		std::string key = trim(line.substr(0, separator));
+		std::string value = trim(line.substr(separator + 1));
+
+		// A bad value is reported and the default is kept, the server can still run
+		try {
+			if ((key == "journal_mode") && keyword(value)) {
+				config.journal_mode = value;
+			}
+			else if ((key == "synchronous") && keyword(value)) {
+				config.synchronous = value;
+			}
+			else if (key == "busy_timeout") {
+				config.busy_timeout = std::stoi(value);
+			}
+			else if (key == "cache_size") {
+				config.cache_size = std::stoi(value);
+			}
+			else if (key == "mmap_size") {
+				config.mmap_size = std::stoll(value);
+			}
+			else if ((key == "temp_store") && keyword(value)) {
+				config.temp_store = value;
+			}
+			else if (key == "wal_autocheckpoint") {
+				config.wal_autocheckpoint = std::stoi(value);
+			}
+			else if (key == "checkpoint_interval") {
+				config.checkpoint_interval = std::stoi(value);
+			}
+			else if (key == "group_commit_batch") {
+				config.group_commit_batch = std::stoi(value);
+			}
+			else if (key == "group_commit_window") {
+				config.group_commit_window = std::stoi(value);
+			}
+			else {
+				std::cerr << "Ignoring database config line: " << line << std::endl;
+			}
+		}
+		catch (std::exception&) {
+			std::cerr << "Ignoring database config line: " << line << std::endl;
+		}
+	}
+
+	return config;
+}
@@ -0,0 +1,53 @@
+#include <string>
+
+#ifndef DATABASE_CONFIG_H_
+#define DATABASE_CONFIG_H_
+
+/**
+ * Tuning of the database connections, read from a config file with a `key = value` pair on each
+ * line (lines starting with '#' are comments). Keys are the names of the members, missing keys and
+ * a missing file leave the defaults in place. Values of the pragmas are passed to SQLite as they
+ * are, see its documentation for their meaning.
+ */
+struct DatabaseConfig {
+	// Readers don't block the writer and the writer doesn't block readers in the WAL mode
+	std::string journal_mode = "WAL";
+
+	// A commit doesn't wait for the disk in the WAL mode, only a checkpoint does
+	std::string synchronous = "NORMAL";
+
+	// Milliseconds a statement waits for a lock held by another connection before it fails
+	int busy_timeout = 5000;
+
+	// Page cache of each connection, negative values are in KiB
+	int cache_size = -16000;
+
+	// Bytes of the database file accessed through memory mapping
+	long long mmap_size = 256LL * 1024 * 1024;
+
+	// Where temporary tables and indices are kept
+	std::string temp_store = "MEMORY";
+
+	// Pages in the WAL after which a commit checkpoints it, a fallback for the background checkpoint
+	int wal_autocheckpoint = 10000;
+
+	// Seconds between background checkpoints of the WAL (0 disables them)
+	int checkpoint_interval = 30;
+
+	// Most write operations committed together by the writer thread (0 commits each operation on its own);
+	// a serving thread waits for its operation, so the server lowers it to the number of its threads
+	int group_commit_batch = 0;
+
+	// Microseconds the writer thread waits for more operations before it commits a group (0 takes
+	// just the operations that queued up while the previous group was being committed)
+	int group_commit_window = 0;
+
+	/**
+	 * Read the config file.
+	 * @param[in]	file	Path to the file
+	 * @returns				The config
+	 */
+	static DatabaseConfig load(const std::string& file);
+};
+
+#endif
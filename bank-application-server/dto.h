@@ -1,5 +1,6 @@
 #include <string>
 #include <vector>
+#include "money.h"
 
 #ifndef	DTO_H_
 #define	DTO_H_
@@ -21,18 +22,21 @@ public:
 	 * @param[in]	balance		Balance of an account
 	 * @param[in]	state		State of the account (ok / blocked)
 	 */
-	Account(std::string mail, std::string name, double balance, State state)
-		: mail_(mail), name_(name), balance_(balance), state_(state) {};
+	Account(std::string mail, std::string name, Money balance, State state)
+		: id_(0), mail_(mail), name_(name), balance_(balance), state_(state) {};
 
 	/**
 	 * An "improper" constructor (it is expected that fields will be manually filled later).
 	 */
-	Account() : mail_(""), name_(""), balance_(0), state_(State::ok) {};
+	Account() : id_(0), mail_(""), name_(""), balance_(), state_(State::ok) {};
+
+	// Identifier in the database (0 until the account is read from it)
+	long long id_;
 
 	// User data
 	std::string mail_;
 	std::string name_;
-	double balance_;
+	Money balance_;
 	State state_;
 };
 
@@ -49,25 +53,33 @@ public:
 	 * @param[in]	name_source		Source account name
 	 * @param[in]	name_target		Target account name
 	 * @param[in]	amount			Amount associated with the transaction
-	 * @param[in]	date			When was the transaction executed
+	 * @param[in]	date			When was the transaction executed (days since 1970-01-01)
+	 * @param[in]	source_id		Source account identifier
+	 * @param[in]	target_id		Target account identifier
 	 */
 	Record(const std::string& account_source, const std::string& account_target, const std::string& name_source, 
-		const std::string& name_target, double amount, const std::string& date)
-		: account_source_(account_source), account_target_(account_target), name_source_(name_source),
-		  name_target_(name_target), amount_(amount), date_(date) {};
+		const std::string& name_target, Money amount, int date, long long source_id,
+		long long target_id)
+		: source_id_(source_id), target_id_(target_id), account_source_(account_source),
+		  account_target_(account_target), name_source_(name_source), name_target_(name_target), amount_(amount),
+		  date_(date) {};
 
 	/**
 	 * An "improper" constructor (it is expected that fields will be manually filled later).
 	 */
-	Record() : account_source_(""), account_target_(""), name_source_(""), name_target_(""), amount_(0), 
-		date_("") {};
+	Record() : source_id_(0), target_id_(0), account_source_(""), account_target_(""), name_source_(""),
+		name_target_(""), amount_(), date_(0) {};
+
+	// Identifiers of the accounts in the database, the record is stored with these
+	long long source_id_;
+	long long target_id_;
 
 	std::string account_source_;
 	std::string account_target_;
 	std::string name_source_;
 	std::string name_target_;
-	double amount_;
-	std::string date_;
+	Money amount_;
+	int date_;
 };
 
 enum class PaymentType {
@@ -90,32 +102,36 @@ public:
 	 * @param[in]	account_target	Target account email
 	 * @param[in]	name_source		Source account name
 	 * @param[in]	name_target		Target account name
-	 * @param[in]	next_payment	The date after which the payment may be executed
+	 * @param[in]	next_payment	The date after which the payment may be executed (days since 1970-01-01)
 	 * @param[in]	amount			The amount of money the recurring payment can transfer per period
 	 * @param[in]	interval		How often the payment may be executed
 	 * @param[in]	type			Payment type (direct debit / standing order)
 	 */
 	RecurringPayment(const std::string& account_source, const std::string& account_target,
-		const std::string& name_source, const std::string& name_target, const std::string& next_payment, 
-		double amount, Interval interval, PaymentType type) 
-		: account_source_(account_source), account_target_(account_target), name_source_(name_source), 
-		  name_target_(name_target), next_payment_(next_payment), amount_(amount), interval_(interval), 
-		  type_(type), correct_(true) {};
+		const std::string& name_source, const std::string& name_target, int next_payment,
+		Money amount, Interval interval, PaymentType type) 
+		: source_id_(0), target_id_(0), account_source_(account_source), account_target_(account_target),
+		  name_source_(name_source), name_target_(name_target), next_payment_(next_payment), amount_(amount),
+		  interval_(interval), type_(type), correct_(true) {};
 
 	/**
 	 * An "improper" constructor creating an incomplete recurring payment.
 	 */
-	RecurringPayment() : account_source_(""), account_target_(""), name_source_(""), name_target_(""), 
-		next_payment_(""), amount_(0), interval_(Interval::day), type_(PaymentType::standing_order),
-		correct_(false) {};
+	RecurringPayment() : source_id_(0), target_id_(0), account_source_(""), account_target_(""), name_source_(""),
+		name_target_(""), next_payment_(0), amount_(), interval_(Interval::day),
+		type_(PaymentType::standing_order), correct_(false) {};
+
+	// Identifiers of the accounts in the database (0 until they are known)
+	long long source_id_;
+	long long target_id_;
 
 	// Recurring payment data
 	std::string account_source_;
 	std::string account_target_;
 	std::string name_source_;
 	std::string name_target_;
-	std::string next_payment_;
-	double amount_;
+	int next_payment_;
+	Money amount_;
 	bool correct_;
 	Interval interval_;
 	PaymentType type_;
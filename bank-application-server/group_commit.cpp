@@ -0,0 +1,103 @@
+#include "group_commit.h"
+#include "transaction.h"
+#include <exception>
+
+GroupCommit::GroupCommit(const Database& database, std::size_t batch_size, std::chrono::microseconds window)
+	: database(database), batch_size(batch_size), window(window)
+{
+	writer = std::thread(&GroupCommit::run, this);
+}
+
+GroupCommit::~GroupCommit()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	submitted.notify_one();
+	writer.join();
+}
+
+std::future<bool> GroupCommit::submit(const Operation& operation)
+{
+	std::future<bool> result;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(Pending{ &operation, std::promise<bool>() });
+		result = queue.back().result.get_future();
+	}
+	submitted.notify_one();
+	return result;
+}
+
+void GroupCommit::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		submitted.wait(lock, [this]() { return stopping || !queue.empty(); });
+		if (queue.empty()) {
+			return;
+		}
+
+		// Give other operations a chance to join, unless the group is full already
+		if (window.count() > 0) {
+			auto deadline = std::chrono::steady_clock::now() + window;
+			submitted.wait_until(lock, deadline, [this]() { return stopping || (queue.size() >= batch_size); });
+		}
+
+		std::vector<Pending> group;
+		while (!queue.empty() && (group.size() < batch_size)) {
+			group.push_back(std::move(queue.front()));
+			queue.pop_front();
+		}
+
+		// Operations submitted meanwhile form the next group
+		lock.unlock();
+		commit(group);
+		lock.lock();
+	}
+}
+
+void GroupCommit::commit(std::vector<Pending>& group)
+{
+	std::vector<bool> kept(group.size(), false);
+	std::vector<std::exception_ptr> errors(group.size());
+
+	try {
+		Transaction transaction(database);
+		Database& scoped = transaction.database();
+
+		for (std::size_t i = 0; i < group.size(); i++) {
+			scoped.savepoint();
+			try {
+				kept[i] = (*group[i].operation)(scoped);
+			}
+			catch (...) {
+				errors[i] = std::current_exception();
+			}
+			if (!kept[i]) {
+				scoped.rollbackToSavepoint();
+			}
+			scoped.releaseSavepoint();
+		}
+
+		transaction.commit();
+	}
+	catch (...) {
+		// Nothing of the group has been committed
+		for (auto&& pending : group) {
+			pending.result.set_exception(std::current_exception());
+		}
+		return;
+	}
+
+	groups++;
+	for (std::size_t i = 0; i < group.size(); i++) {
+		if (errors[i]) {
+			group[i].result.set_exception(errors[i]);
+		}
+		else {
+			group[i].result.set_value(kept[i]);
+		}
+	}
+}
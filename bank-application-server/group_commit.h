@@ -0,0 +1,108 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "database.h"
+
+#ifndef GROUP_COMMIT_H_
+#define GROUP_COMMIT_H_
+
+/**
+ * Writer thread committing the write operations of many requests together. The request handlers
+ * submit their operations and wait for the futures; the thread collects the operations pending
+ * within a short window (or until the group is full), runs them one after another in a single
+ * transaction and commits them at once, so a whole group pays for a single commit.
+ *
+ * Each operation runs within a savepoint of its own: an operation that throws (or asks for its
+ * changes to be discarded) is rolled back alone and the rest of the group is still committed.
+ * If the commit itself fails, every operation of the group fails with it.
+ */
+class GroupCommit
+{
+public:
+	/**
+	 * Statements of a single operation, run on the connection of the group's transaction.
+	 * Returns whether the changes are to be kept.
+	 */
+	using Operation = std::function<bool(Database&)>;
+
+	/**
+	 * Start the writer thread.
+	 * @param[in]	database	Database shared by the threads, the writer works on a copy of it
+	 * @param[in]	batch_size	Most operations committed together; each submitter waits for its operation,
+	 *							so a group holds at most as many operations as there are submitting threads
+	 * @param[in]	window		How long the writer waits for more operations before it commits a group
+	 */
+	GroupCommit(const Database& database, std::size_t batch_size, std::chrono::microseconds window);
+
+	/**
+	 * Commit the operations still pending and stop the writer thread.
+	 */
+	~GroupCommit();
+
+	GroupCommit(const GroupCommit&) = delete;
+	GroupCommit& operator=(const GroupCommit&) = delete;
+
+	/**
+	 * Hand an operation to the writer thread. The operation must stay valid until the future is ready.
+	 * @param[in]	operation	The operation
+	 * @returns					Whether the changes were kept, once they are committed (or the exception
+	 *							the operation or the commit failed with)
+	 */
+	std::future<bool> submit(const Operation& operation);
+
+	// Number of groups committed so far, to compare with the number of operations
+	std::atomic<std::size_t> groups{ 0 };
+
+private:
+	/**
+	 * An operation waiting for the writer.
+	 */
+	struct Pending {
+		const Operation* operation;
+		std::promise<bool> result;
+	};
+
+	// Copy of the database the writer works on
+	Database database;
+
+	// Most operations committed together
+	std::size_t batch_size;
+
+	// How long the writer waits for more operations
+	std::chrono::microseconds window;
+
+	// Guards the queue and the stop flag
+	std::mutex mutex;
+
+	// Signalled when an operation is submitted or the writer is to stop
+	std::condition_variable submitted;
+
+	// Operations waiting for the writer, in the order they were submitted
+	std::deque<Pending> queue;
+
+	// Whether the writer is to stop once the queue is empty
+	bool stopping = false;
+
+	// The writer thread
+	std::thread writer;
+
+	/**
+	 * Body of the writer thread: take groups of operations from the queue and commit them.
+	 */
+	void run();
+
+	/**
+	 * Run a group of operations in a single transaction and complete their futures.
+	 * @param[in]	group	The operations
+	 */
+	void commit(std::vector<Pending>& group);
+};
+
+#endif
@@ -0,0 +1,462 @@
+#include "importer.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include "bank_exception.h"
+#include "money.h"
+#include "protocol.h"
+
+namespace fs = std::filesystem;
+
+Importer::Importer(const std::string& current_path, std::size_t batch_rows)
+	: statistics(), database(), batch_rows(batch_rows)
+{
+	database.setup(current_path);
+
+	// Rows may refer to the users and accounts there are already
+	std::vector<User> known;
+	database.gatherUsers(&known);
+	for (auto&& user : known) {
+		users.insert(user.mail_);
+		for (auto&& account : user.accounts_) {
+			accounts.emplace(key(account.mail_, account.name_), account.id_);
+		}
+	}
+
+	// Deposits come from the external account
+	accounts.emplace(key("-", "-"), static_cast<long long>(Database::DB_EXTERNAL_ACCOUNT));
+
+	database.beginBulkLoad();
+	start = std::chrono::steady_clock::now();
+}
+
+void Importer::import(const std::string& path, std::ostream& log)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("can't open " + path);
+	}
+
+	bool csv = (fs::path(path).extension() == ".csv");
+	std::size_t rows_before = rows();
+	auto file_start = std::chrono::steady_clock::now();
+
+	std::string line;
+	std::size_t number = 0;
+	while (std::getline(file, line)) {
+		number++;
+		std::string_view row = line;
+		if (!row.empty() && (row.back() == '\r')) {
+			row.remove_suffix(1);
+		}
+		if (row.empty()) {
+			continue;
+		}
+
+		// A malformed row is skipped, a failing database stops the import
+		try {
+			if (csv) {
+				splitCsv(row);
+			}
+			else {
+				splitJson(row);
+			}
+
+			// The first line of a CSV may name the columns
+			if (csv && (number == 1) && (fields[0] == "type")) {
+				continue;
+			}
+
+			if (!transaction) {
+				transaction = std::make_unique<Transaction>(database);
+			}
+			importRow(transaction->database());
+		}
+		catch (db_exception&) {
+			throw;
+		}
+		catch (std::exception& e) {
+			statistics.rejected++;
+			log << path << ":" << number << ": " << e.what() << std::endl;
+			continue;
+		}
+
+		if (++pending >= batch_rows) {
+			commit();
+		}
+	}
+	commit();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - file_start).count();
+	std::size_t imported = rows() - rows_before;
+	log << path << ": " << imported << " rows in " << std::fixed << std::setprecision(1) << seconds << " s ("
+		<< std::setprecision(0) << imported / seconds << " rows/s)" << std::endl;
+}
+
+void Importer::finish(std::ostream& log)
+{
+	commit();
+
+	database.endBulkLoad();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	log << "Imported " << rows() << " rows in " << std::fixed << std::setprecision(1) << seconds << " s ("
+		<< std::setprecision(0) << rows() / seconds << " rows/s): " << statistics.users << " users, "
+		<< statistics.accounts << " accounts, " << statistics.records << " records, " << statistics.rejected
+		<< " rejected" << std::endl;
+}
+
+void Importer::splitCsv(std::string_view line)
+{
+	std::size_t count = 0;
+	std::size_t i = 0;
+	for (;;) {
+		if (fields.size() <= count) {
+			fields.emplace_back();
+		}
+		std::string& field = fields[count++];
+		field.clear();
+
+		if ((i < line.size()) && (line[i] == '"')) {
+			// A quote within a quoted field is doubled
+			for (i++;; i += 2) {
+				std::size_t quote = line.find('"', i);
+				if (quote == std::string_view::npos) {
+					throw std::invalid_argument("unterminated quoted field");
+				}
+				field.append(line.substr(i, quote - i));
+				i = quote;
+				if ((i + 1 < line.size()) && (line[i + 1] == '"')) {
+					field.push_back('"');
+					continue;
+				}
+				i++;
+				break;
+			}
+			if ((i < line.size()) && (line[i] != ',')) {
+				throw std::invalid_argument("text after a quoted field");
+			}
+		}
+		else {
+			std::size_t comma = std::min(line.find(',', i), line.size());
+			field.append(line.substr(i, comma - i));
+			i = comma;
+		}
+
+		if (i >= line.size()) {
+			break;
+		}
+		i++;
+	}
+	fields.resize(count);
+}
+
+void Importer::splitJson(std::string_view line)
+{
+	std::size_t count = 0;
+
+	auto skip = [&line](std::size_t& i) {
+		while ((i < line.size()) && ((line[i] == ' ') || (line[i] == '\t'))) {
+			i++;
+		}
+	};
+
+	std::size_t i = 0;
+	skip(i);
+	if ((i >= line.size()) || (line[i] != '{')) {
+		throw std::invalid_argument("not a JSON object");
+	}
+	i++;
+	skip(i);
+
+	while ((i < line.size()) && (line[i] != '}')) {
+		if (members.size() <= count) {
+			members.emplace_back();
+		}
+		auto& member = members[count++];
+
+		readJsonString(line, i, member.first);
+		skip(i);
+		if ((i >= line.size()) || (line[i] != ':')) {
+			throw std::invalid_argument("missing ':' in JSON object");
+		}
+		i++;
+		skip(i);
+
+		// A number (or literal) is taken as it's written, so amounts aren't rounded
+		if ((i < line.size()) && (line[i] == '"')) {
+			readJsonString(line, i, member.second);
+		}
+		else {
+			std::size_t end = std::min(line.find_first_of(",} \t", i), line.size());
+			member.second.assign(line.substr(i, end - i));
+			i = end;
+		}
+		skip(i);
+
+		if ((i < line.size()) && (line[i] == ',')) {
+			i++;
+			skip(i);
+		}
+		else if ((i >= line.size()) || (line[i] != '}')) {
+			throw std::invalid_argument("missing ',' in JSON object");
+		}
+	}
+	if (i >= line.size()) {
+		throw std::invalid_argument("unterminated JSON object");
+	}
+	i++;
+	skip(i);
+	if (i != line.size()) {
+		throw std::invalid_argument("text after JSON object");
+	}
+
+	auto find = [&](const std::string& name) -> const std::string* {
+		for (std::size_t m = 0; m < count; m++) {
+			if (members[m].first == name) {
+				return &members[m].second;
+			}
+		}
+		return nullptr;
+	};
+
+	const std::string* type = find("type");
+	if (type == nullptr) {
+		throw std::invalid_argument("row without a type");
+	}
+	const std::vector<std::string>& names = columns(*type);
+	if (names.empty()) {
+		throw std::invalid_argument("unknown row type " + *type);
+	}
+
+	// A missing member ends the row, so only the trailing optional ones may be left out
+	fields.resize(names.size());
+	fields[0] = *type;
+	for (std::size_t c = 1; c < names.size(); c++) {
+		const std::string* value = find(names[c]);
+		if (value == nullptr) {
+			fields.resize(c);
+			break;
+		}
+		fields[c] = *value;
+	}
+}
+
+void Importer::importRow(Database& database)
+{
+	const std::string& type = fields[0];
+
+	if (type == "user") {
+		if (fields.size() != 3) {
+			throw std::invalid_argument("a user has an email and a password");
+		}
+		if (users.count(fields[1]) != 0) {
+			throw std::invalid_argument("user " + fields[1] + " exists already");
+		}
+
+		database.addUser(User(fields[1], fields[2], {}));
+		users.insert(fields[1]);
+		statistics.users++;
+	}
+	else if (type == "account") {
+		if ((fields.size() != 4) && (fields.size() != 5)) {
+			throw std::invalid_argument("an account has an email, a name, a balance and optionally a state");
+		}
+		if (users.count(fields[1]) == 0) {
+			throw std::invalid_argument("user " + fields[1] + " does not exist");
+		}
+		if (accounts.count(key(fields[1], fields[2])) != 0) {
+			throw std::invalid_argument("account " + fields[2] + " of " + fields[1] + " exists already");
+		}
+
+		Money balance = Money::parse(fields[3]);
+		State state = State::ok;
+		if ((fields.size() == 5) && (fields[4] == "BLOCKED")) {
+			state = State::blocked;
+		}
+		else if ((fields.size() == 5) && !fields[4].empty() && (fields[4] != "OK")) {
+			throw std::invalid_argument("unknown state " + fields[4]);
+		}
+
+		long long id = database.addAccount(Account(fields[1], fields[2], balance, state));
+		accounts.emplace(key(fields[1], fields[2]), id);
+		statistics.accounts++;
+	}
+	else if (type == "record") {
+		if (fields.size() != 7) {
+			throw std::invalid_argument("a record has two accounts, an amount and a date");
+		}
+
+		auto source = accounts.find(key(fields[1], fields[2]));
+		if (source == accounts.end()) {
+			throw std::invalid_argument("account " + fields[2] + " of " + fields[1] + " does not exist");
+		}
+		auto target = accounts.find(key(fields[3], fields[4]));
+		if (target == accounts.end()) {
+			throw std::invalid_argument("account " + fields[4] + " of " + fields[3] + " does not exist");
+		}
+
+		// Only the identifiers are stored with a record
+		Record record{};
+		record.source_id_ = source->second;
+		record.target_id_ = target->second;
+		record.amount_ = Money::parse(fields[5]);
+		record.date_ = Protocol::daysFromDate(fields[6]);
+		if (database.getPartitions().archived(Partitions::month(record.date_))) {
+			throw std::invalid_argument("the records of " + Partitions::name(Partitions::month(record.date_)) +
+				" are archived");
+		}
+
+		database.addRecord(record);
+		statistics.records++;
+	}
+	else {
+		throw std::invalid_argument("unknown row type " + type);
+	}
+}
+
+const std::string& Importer::key(std::string_view email, std::string_view name)
+{
+	lookup.assign(email);
+	lookup.push_back('\0');
+	lookup.append(name);
+	return lookup;
+}
+
+void Importer::commit()
+{
+	if (transaction) {
+		transaction->commit();
+		transaction.reset();
+	}
+	pending = 0;
+}
+
+std::size_t Importer::rows() const
+{
+	return statistics.users + statistics.accounts + statistics.records;
+}
+
+const std::vector<std::string>& Importer::columns(std::string_view type)
+{
+	static const std::vector<std::string> user = { "type", "email", "password" };
+	static const std::vector<std::string> account = { "type", "email", "name", "balance", "state" };
+	static const std::vector<std::string> record = { "type", "source_email", "source_name", "target_email",
+		"target_name", "amount", "date" };
+	static const std::vector<std::string> unknown = {};
+
+	if (type == "user") {
+		return user;
+	}
+	if (type == "account") {
+		return account;
+	}
+	if (type == "record") {
+		return record;
+	}
+	return unknown;
+}
+
+void Importer::readJsonString(std::string_view line, std::size_t& i, std::string& out)
+{
+	if ((i >= line.size()) || (line[i] != '"')) {
+		throw std::invalid_argument("expected a JSON string");
+	}
+	i++;
+	out.clear();
+
+	auto hex = [&line](std::size_t at) {
+		unsigned int value = 0;
+		for (std::size_t k = at; k < at + 4; k++) {
+			char c = (k < line.size()) ? line[k] : 'x';
+			value <<= 4;
+			if ((c >= '0') && (c <= '9')) {
+				value |= c - '0';
+			}
+			else if ((c >= 'a') && (c <= 'f')) {
+				value |= c - 'a' + 10;
+			}
+			else if ((c >= 'A') && (c <= 'F')) {
+				value |= c - 'A' + 10;
+			}
+			else {
+				throw std::invalid_argument("malformed \\u escape");
+			}
+		}
+		return value;
+	};
+
+	while (i < line.size()) {
+		char c = line[i++];
+		if (c == '"') {
+			return;
+		}
+		if (c != '\\') {
+			out.push_back(c);
+			continue;
+		}
+		if (i >= line.size()) {
+			break;
+		}
+
+		char escape = line[i++];
+		switch (escape) {
+		case 'b':
+			out.push_back('\b');
+			break;
+		case 'f':
+			out.push_back('\f');
+			break;
+		case 'n':
+			out.push_back('\n');
+			break;
+		case 'r':
+			out.push_back('\r');
+			break;
+		case 't':
+			out.push_back('\t');
+			break;
+		case 'u': {
+			unsigned int code = hex(i);
+			i += 4;
+
+			// A character outside the basic plane comes as a surrogate pair
+			if ((code >= 0xD800) && (code < 0xDC00) && (i + 6 <= line.size()) && (line[i] == '\\') &&
+				(line[i + 1] == 'u')) {
+				unsigned int low = hex(i + 2);
+				if ((low >= 0xDC00) && (low < 0xE000)) {
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					i += 6;
+				}
+			}
+
+			// UTF-8
+			if (code < 0x80) {
+				out.push_back(static_cast<char>(code));
+			}
+			else if (code < 0x800) {
+				out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+				out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+			else if (code < 0x10000) {
+				out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+				out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+			else {
+				out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+				out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+			break;
+		}
+		default:
+			// \" \\ \/
+			out.push_back(escape);
+		}
+	}
+	throw std::invalid_argument("unterminated JSON string");
+}
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "database.h"
+#include "transaction.h"
+
+#ifndef IMPORTER_H_
+#define IMPORTER_H_
+
+/**
+ * Bulk loader of users, accounts and the history of records, for moving customers from another
+ * system. The files are streamed line by line through the prepared inserts, many rows per
+ * transaction, and the indexes of the history are built once after the load. Meant to be run
+ * while the server is not running (`--import <file>`).
+ *
+ * A file is either CSV (`.csv`) or NDJSON (any other extension, e.g. `.ndjson`). Each row starts
+ * with its type; amounts are decimal with at most two decimal places and dates are YYYY-MM-DD:
+ *
+ *	user,<email>,<password>
+ *	account,<email>,<name>,<balance>[,OK|BLOCKED]
+ *	record,<source email>,<source name>,<target email>,<target name>,<amount>,<date>
+ *
+ *	{"type":"user","email":"..","password":".."}
+ *	{"type":"account","email":"..","name":"..","balance":"12.50","state":"OK"}
+ *	{"type":"record","source_email":"..","source_name":"..","target_email":"..","target_name":"..",
+ *	 "amount":"12.50","date":"2020-01-31"}
+ *
+ * CSV fields may be quoted ("a ""b"", c"). A deposit comes from the account "-" of the user "-".
+ * An account must belong to a user known by then, a record to accounts known by then. Records
+ * are history: they don't change the balances, which are imported as they are; the transfers
+ * among them are added to the previous targets of their source accounts, and the end-of-day
+ * balances are derived from the history once the load finishes. Records of an archived month
+ * are rejected.
+ *
+ * A row that can't be imported (malformed, unknown accounts, a user or account that exists
+ * already) is reported with its line and skipped; a database error stops the import, the rows
+ * committed by then stay.
+ */
+class Importer
+{
+public:
+	/**
+	 * Rows imported so far.
+	 */
+	struct Statistics {
+		std::size_t users = 0;
+		std::size_t accounts = 0;
+		std::size_t records = 0;
+		std::size_t rejected = 0;
+	};
+
+	/**
+	 * Set up the database, read the users and accounts it has already and prepare it for the load.
+	 * @param[in]	current_path	Path to the executable
+	 * @param[in]	batch_rows		Number of rows committed at once
+	 */
+	Importer(const std::string& current_path, std::size_t batch_rows = DEFAULT_BATCH_ROWS);
+
+	/**
+	 * Import a file.
+	 * @param[in]	path	Path to the file
+	 * @param[out]	log		Stream the progress and the rejected rows are reported to
+	 * @throws db_exception if the database fails, std::runtime_error if the file can't be read
+	 */
+	void import(const std::string& path, std::ostream& log);
+
+	/**
+	 * Finish the load: add the previous targets, build the indexes of the history and derive the
+	 * end-of-day balances.
+	 * @param[out]	log		Stream the result is reported to
+	 */
+	void finish(std::ostream& log);
+
+	// Rows imported so far
+	Statistics statistics;
+
+	// Number of rows committed at once if not specified otherwise
+	static const std::size_t DEFAULT_BATCH_ROWS = 100'000;
+
+private:
+	// Database the rows are loaded into
+	Database database;
+
+	// Number of rows committed at once
+	std::size_t batch_rows;
+
+	// Transaction of the rows not yet committed (if any) and their number
+	std::unique_ptr<Transaction> transaction;
+	std::size_t pending = 0;
+
+	// Emails of the users known so far
+	std::unordered_set<std::string> users;
+
+	// Identifiers of the accounts known so far, by `key`
+	std::unordered_map<std::string, long long> accounts;
+
+	// When the import started
+	std::chrono::steady_clock::time_point start;
+
+	// Fields of the row being imported, reused from row to row
+	std::vector<std::string> fields;
+
+	// Members of the NDJSON object being read (names and values), reused from row to row
+	std::vector<std::pair<std::string, std::string>> members;
+
+	// Key of an account being looked up, reused from row to row
+	std::string lookup;
+
+	/**
+	 * Split a CSV line into `fields`.
+	 * @param[in]	line	The line
+	 * @throws std::invalid_argument if a quoted field isn't closed
+	 */
+	void splitCsv(std::string_view line);
+
+	/**
+	 * Read an NDJSON line (a flat object) into `fields`, in the order the CSV has them.
+	 * @param[in]	line	The line
+	 * @throws std::invalid_argument if the line isn't such an object
+	 */
+	void splitJson(std::string_view line);
+
+	/**
+	 * Import the row in `fields` within the current transaction.
+	 * @param[in]	database	Database of the transaction
+	 * @throws std::invalid_argument (or another std::exception but db_exception) if the row can't be
+	 *		   imported, nothing is written then
+	 */
+	void importRow(Database& database);
+
+	/**
+	 * Key of an account in `accounts`, written to `lookup`.
+	 * @param[in]	email	Email of the owner
+	 * @param[in]	name	Name of the account
+	 * @returns				The key
+	 */
+	const std::string& key(std::string_view email, std::string_view name);
+
+	/**
+	 * Commit the rows imported so far.
+	 */
+	void commit();
+
+	/**
+	 * Total number of rows imported so far.
+	 * @returns		The number of rows
+	 */
+	std::size_t rows() const;
+
+	/**
+	 * Names of the fields of the rows of a type, in the order the CSV has them (the type first).
+	 * @param[in]	type	Type of the row
+	 * @returns				The names, empty for an unknown type
+	 */
+	static const std::vector<std::string>& columns(std::string_view type);
+
+	/**
+	 * Read a JSON string starting at a quote, decoding the escapes.
+	 * @param[in]		line	The line
+	 * @param[in,out]	i		Position of the opening quote, moved past the closing one
+	 * @param[out]		out		The string
+	 */
+	static void readJsonString(std::string_view line, std::size_t& i, std::string& out);
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "mail_queue.h"
+#include "bank_exception.h"
+#include "mail_client.h"
+#include <iostream>
+
+MailQueue::MailQueue()
+{
+	sender = std::thread(&MailQueue::run, this);
+}
+
+MailQueue::~MailQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	posted.notify_one();
+	sender.join();
+}
+
+void MailQueue::post(std::string to, std::string message)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.emplace_back(std::move(to), std::move(message));
+	}
+	posted.notify_one();
+}
+
+void MailQueue::run()
+{
+	MailClient mail_client{};
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		posted.wait(lock, [this]() { return stopping || !queue.empty(); });
+		if (queue.empty()) {
+			return;
+		}
+
+		auto email = std::move(queue.front());
+		queue.pop_front();
+
+		// Emails queued meanwhile wait for this one
+		lock.unlock();
+		try {
+			mail_client.sendEmail(email.first, email.second);
+		}
+		catch (mail_exception& e) {
+			// Failing to send an email isn't a reason to drop the whole server
+			std::cerr << e.what() << std::endl;
+		}
+		lock.lock();
+	}
+}
@@ -0,0 +1,61 @@
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifndef MAIL_QUEUE_H_
+#define MAIL_QUEUE_H_
+
+/**
+ * Mail thread sending the emails of the server. Sending an email takes a connection to the mail
+ * server, so the threads serving requests (which may hold the locks of accounts) only queue their
+ * emails and go on; the mail thread sends them one after another, in the order they were queued.
+ */
+class MailQueue
+{
+public:
+	/**
+	 * Start the mail thread.
+	 */
+	MailQueue();
+
+	/**
+	 * Send the emails still queued and stop the mail thread.
+	 */
+	~MailQueue();
+
+	MailQueue(const MailQueue&) = delete;
+	MailQueue& operator=(const MailQueue&) = delete;
+
+	/**
+	 * Queue an email to be sent by the mail thread.
+	 * @param[in]	to		Email recipient
+	 * @param[in]	message	Email contents
+	 */
+	void post(std::string to, std::string message);
+
+private:
+	// Guards the queue and the stop flag
+	std::mutex mutex;
+
+	// Signalled when an email is queued or the mail thread is to stop
+	std::condition_variable posted;
+
+	// Emails waiting to be sent (recipient and contents), in the order they were queued
+	std::deque<std::pair<std::string, std::string>> queue;
+
+	// Whether the mail thread is to stop once the queue is empty
+	bool stopping = false;
+
+	// The mail thread
+	std::thread sender;
+
+	/**
+	 * Body of the mail thread: take the emails from the queue and send them.
+	 */
+	void run();
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#ifndef MONEY_H_
+#define MONEY_H_
+
+/**
+ * Amount of money kept as a whole number of hundredths, so that sums and comparisons are exact
+ * and it is stored (INTEGER) and sent (binary protocol) without any conversion.
+ *
+ * Arithmetic is checked: a result that doesn't fit throws std::overflow_error instead of
+ * wrapping around.
+ */
+class Money
+{
+public:
+	/**
+	 * Zero.
+	 */
+	Money() : cents_(0) {};
+
+	/**
+	 * @param[in]	cents	The amount in hundredths
+	 */
+	explicit Money(long long cents) : cents_(cents) {};
+
+	/**
+	 * Parse a decimal amount ("12", "-0.5", "100.500000"). Digits past the hundredths are
+	 * accepted only if they are zeros, so that nothing is rounded away.
+	 * @param[in]	text	The amount
+	 * @returns				The amount
+	 * @throws std::invalid_argument if the text is not an amount, std::overflow_error if it's too large
+	 */
+	static Money parse(std::string_view text);
+
+	/**
+	 * Format the amount into a buffer of at least FORMAT_CAPACITY characters.
+	 * @param[out]	first		Start of the buffer
+	 * @param[in]	decimals	Number of decimal places, at least 2 (the rest are zeros)
+	 * @returns					End of the written characters
+	 */
+	char* format(char* first, int decimals = DECIMALS) const;
+
+	/**
+	 * Format the amount.
+	 * @param[in]	decimals	Number of decimal places, at least 2 (the rest are zeros)
+	 * @returns					The amount as text
+	 */
+	std::string str(int decimals = DECIMALS) const;
+
+	/**
+	 * @returns		The amount in hundredths
+	 */
+	long long cents() const { return cents_; };
+
+	Money operator+(Money other) const;
+	Money operator-(Money other) const;
+	Money& operator+=(Money other) { return *this = *this + other; };
+	Money& operator-=(Money other) { return *this = *this - other; };
+
+	bool operator==(Money other) const { return cents_ == other.cents_; };
+	bool operator!=(Money other) const { return cents_ != other.cents_; };
+	bool operator<(Money other) const { return cents_ < other.cents_; };
+	bool operator<=(Money other) const { return cents_ <= other.cents_; };
+	bool operator>(Money other) const { return cents_ > other.cents_; };
+	bool operator>=(Money other) const { return cents_ >= other.cents_; };
+
+	// Hundredths in a unit
+	static const long long SCALE = 100;
+
+	// Decimal places kept
+	static const int DECIMALS = 2;
+
+	// Most decimal places format() writes
+	static const int MAX_DECIMALS = 16;
+
+	// Buffer size format() needs: sign, 19 digits, point and the decimals
+	static const std::size_t FORMAT_CAPACITY = 1 + 19 + 1 + MAX_DECIMALS;
+
+private:
+	// The amount in hundredths
+	long long cents_;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "partitions.h"
+#include <cstdio>
+#include <mutex>
+#include "protocol.h"
+
+void Partitions::add(int month, const std::string& archive)
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	months[month] = archive;
+}
+
+bool Partitions::contains(int month) const
+{
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	return months.find(month) != months.end();
+}
+
+bool Partitions::archived(int month) const
+{
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	auto found = months.find(month);
+	return (found != months.end()) && !found->second.empty();
+}
+
+std::vector<Partitions::Partition> Partitions::overlapping(int date_from, int date_to) const
+{
+	std::vector<Partition> partitions;
+	if (date_from > date_to) {
+		return partitions;
+	}
+
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	auto end = months.upper_bound(month(date_to));
+	for (auto it = months.lower_bound(month(date_from)); it != end; ++it) {
+		partitions.push_back(Partition{ it->first, it->second });
+	}
+	return partitions;
+}
+
+std::vector<int> Partitions::current() const
+{
+	std::vector<int> current;
+
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	for (auto&& partition : months) {
+		if (partition.second.empty()) {
+			current.push_back(partition.first);
+		}
+	}
+	return current;
+}
+
+std::vector<Partitions::Partition> Partitions::all() const
+{
+	std::vector<Partition> partitions;
+
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	for (auto&& partition : months) {
+		partitions.push_back(Partition{ partition.first, partition.second });
+	}
+	return partitions;
+}
+
+void Partitions::beginLoad()
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	bulk = true;
+	loaded.clear();
+}
+
+bool Partitions::load(int month)
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	return loaded.emplace(month, 0).second;
+}
+
+void Partitions::loadFrom(int month, long long rowid)
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	long long& first = loaded[month];
+	if (first == 0) {
+		first = rowid;
+	}
+}
+
+bool Partitions::loading() const
+{
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	return bulk;
+}
+
+std::map<int, long long> Partitions::endLoad()
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	bulk = false;
+	std::map<int, long long> written;
+	written.swap(loaded);
+	return written;
+}
+
+int Partitions::month(int day)
+{
+	int year = 0;
+	unsigned int month = 0;
+	unsigned int day_of_month = 0;
+	Protocol::civilFromDays(day, year, month, day_of_month);
+	return (year - 1970) * 12 + static_cast<int>(month) - 1;
+}
+
+int Partitions::firstDay(int month)
+{
+	// Floor division, so months before 1970 work too
+	int year = (month >= 0 ? month : month - 11) / 12;
+	return Protocol::daysFromCivil(1970 + year, static_cast<unsigned int>(month - year * 12 + 1), 1);
+}
+
+int Partitions::lastDay(int month)
+{
+	return firstDay(month + 1) - 1;
+}
+
+std::string Partitions::table(int month)
+{
+	std::string table = "record_" + name(month);
+	table[11] = '_';
+	return table;
+}
+
+std::string Partitions::name(int month)
+{
+	int year = (month >= 0 ? month : month - 11) / 12;
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02d", 1970 + year, month - year * 12 + 1);
+	return std::string(buffer);
+}
+
+bool Partitions::parse(const std::string& table, int& month)
+{
+	int year = 0;
+	int month_of_year = 0;
+	char end = 0;
+	if ((std::sscanf(table.c_str(), "record_%4d_%2d%c", &year, &month_of_year, &end) != 2) ||
+		(table.size() != 14) || (month_of_year < 1) || (month_of_year > 12)) {
+		return false;
+	}
+
+	month = (year - 1970) * 12 + month_of_year - 1;
+	return true;
+}
@@ -0,0 +1,161 @@
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#ifndef PARTITIONS_H_
+#define PARTITIONS_H_
+
+/**
+ * Months the history of records is split into. The records of each month are kept in a table of
+ * their own (`record_YYYY_MM`) with its own indexes, so writing a record only touches the indexes
+ * of the current month and a history query reads just the months its date range overlaps. A closed
+ * month can be moved out to a read-only archive file, see `Database::archive`.
+ *
+ * Copies of a database share the partitions; a partition created by a transaction is added once the
+ * transaction is committed. All the methods are thread safe.
+ */
+class Partitions
+{
+public:
+	/**
+	 * A month of records and where they are kept.
+	 */
+	struct Partition {
+		// Months since January 1970
+		int month;
+
+		// Path to the archive file, empty while the records are in the database
+		std::string archive;
+	};
+
+	/**
+	 * Add a partition, or move a partition to its archive.
+	 * @param[in]	month		The month
+	 * @param[in]	archive		Path to the archive file, empty if the records are in the database
+	 */
+	void add(int month, const std::string& archive = "");
+
+	/**
+	 * Check whether there is a partition of a month.
+	 * @param[in]	month	The month
+	 * @returns				Whether the partition exists (archived or not)
+	 */
+	bool contains(int month) const;
+
+	/**
+	 * Check whether the records of a month have been archived.
+	 * @param[in]	month	The month
+	 * @returns				Whether the partition is archived
+	 */
+	bool archived(int month) const;
+
+	/**
+	 * List the partitions holding the records of a date range.
+	 * @param[in]	date_from	First date of the range (inclusive, days since 1970-01-01)
+	 * @param[in]	date_to		Last date of the range (inclusive, days since 1970-01-01)
+	 * @returns					The partitions, ordered by month
+	 */
+	std::vector<Partition> overlapping(int date_from, int date_to) const;
+
+	/**
+	 * List the months whose records are in the database.
+	 * @returns		The months, in order
+	 */
+	std::vector<int> current() const;
+
+	/**
+	 * List all the partitions.
+	 * @returns		The partitions, ordered by month
+	 */
+	std::vector<Partition> all() const;
+
+	/**
+	 * Start keeping track of the partitions written by a bulk load.
+	 */
+	void beginLoad();
+
+	/**
+	 * Note that a bulk load writes to a partition.
+	 * @param[in]	month	The month
+	 * @returns				Whether this is the first record of the load in the partition
+	 */
+	bool load(int month);
+
+	/**
+	 * Note the rowid of the first record of a bulk load in a partition.
+	 * @param[in]	month	The month
+	 * @param[in]	rowid	The rowid
+	 */
+	void loadFrom(int month, long long rowid);
+
+	/**
+	 * Check whether a bulk load is in progress.
+	 * @returns		Whether it is
+	 */
+	bool loading() const;
+
+	/**
+	 * Stop keeping track of the bulk load.
+	 * @returns		Rowid of the first record of the load by month, for each month written
+	 */
+	std::map<int, long long> endLoad();
+
+	/**
+	 * Month of a date.
+	 * @param[in]	day		Number of days since 1970-01-01
+	 * @returns				Months since January 1970
+	 */
+	static int month(int day);
+
+	/**
+	 * First day of a month.
+	 * @param[in]	month	Months since January 1970
+	 * @returns				Number of days since 1970-01-01
+	 */
+	static int firstDay(int month);
+
+	/**
+	 * Last day of a month.
+	 * @param[in]	month	Months since January 1970
+	 * @returns				Number of days since 1970-01-01
+	 */
+	static int lastDay(int month);
+
+	/**
+	 * Name of the table of a partition (`record_YYYY_MM`).
+	 * @param[in]	month	Months since January 1970
+	 * @returns				The name
+	 */
+	static std::string table(int month);
+
+	/**
+	 * Readable name of a month (YYYY-MM).
+	 * @param[in]	month	Months since January 1970
+	 * @returns				The name
+	 */
+	static std::string name(int month);
+
+	/**
+	 * Month of a partition table.
+	 * @param[in]	table	Name of the table (`record_YYYY_MM`)
+	 * @param[out]	month	Months since January 1970
+	 * @returns				Whether the name is one of a partition table
+	 */
+	static bool parse(const std::string& table, int& month);
+
+private:
+	// Guards the partitions and the bulk load
+	mutable std::shared_mutex mutex;
+
+	// Path to the archive of each month, empty for the months in the database
+	std::map<int, std::string> months;
+
+	// Whether a bulk load is in progress
+	bool bulk = false;
+
+	// Rowid of the first record of the bulk load by month (0 until it is written)
+	std::map<int, long long> loaded;
+};
+
+#endif
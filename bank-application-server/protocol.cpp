@@ -0,0 +1,361 @@
+#include "protocol.h"
+#include "bank_exception.h"
+#include "bank_server.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+void Request::addField(const Field& field)
+{
+	if (field_count_ == MAX_FIELDS) {
+		throw protocol_exception("too many fields");
+	}
+	fields_[field_count_++] = field;
+}
+
+std::string_view Request::text(std::size_t i) const
+{
+	return field(i).text;
+}
+
+Money Request::amount(std::size_t i) const
+{
+	const Field& f = field(i);
+	if (f.type == FieldType::text) {
+		try {
+			return Money::parse(f.text);
+		}
+		catch (std::exception&) {
+			throw protocol_exception("malformed amount " + std::string(f.text));
+		}
+	}
+	return Money(f.value);
+}
+
+int Request::day(std::size_t i) const
+{
+	const Field& f = field(i);
+	if (f.type == FieldType::text) {
+		return Protocol::daysFromDate(f.text);
+	}
+	return static_cast<int>(f.value);
+}
+
+int Request::integer(std::size_t i) const
+{
+	const Field& f = field(i);
+	if (f.type == FieldType::text) {
+		int integer = 0;
+		auto result = std::from_chars(f.text.data(), f.text.data() + f.text.size(), integer);
+		if (result.ec != std::errc()) {
+			throw protocol_exception("malformed integer " + std::string(f.text));
+		}
+		return integer;
+	}
+	return static_cast<int>(f.value);
+}
+
+Request Request::nextOperation(std::string_view& operations) const
+{
+	if (binary_) {
+		return Protocol::decodeOperation(operations);
+	}
+	return BankServer::parseOperation(operations);
+}
+
+const Field& Request::field(std::size_t i) const
+{
+	if (i >= field_count_) {
+		throw protocol_exception("missing field " + std::to_string(i));
+	}
+	return fields_[i];
+}
+
+void TextResponseWriter::accept()
+{
+	message.append(BankServer::ACCEPTED);
+}
+
+void TextResponseWriter::reject(const std::string& reason)
+{
+	message.append(BankServer::REJECTED);
+	message.append(reason);
+}
+
+void TextResponseWriter::addText(std::string_view text)
+{
+	separator();
+	message.append(text);
+	separate = true;
+}
+
+void TextResponseWriter::addAmount(Money amount)
+{
+	separator();
+	message.appendAmount(amount);
+	separate = true;
+}
+
+void TextResponseWriter::addDate(int day)
+{
+	separator();
+	message.append(Protocol::dateFromDays(day));
+	separate = true;
+}
+
+void TextResponseWriter::addCount(int count)
+{
+	separator();
+	message.appendNumber(static_cast<long long>(count));
+	message.append(BankServer::SEPARATOR);
+	separate = false;
+
+	message.reserve(count * ITEM_SIZE);
+}
+
+void TextResponseWriter::separator()
+{
+	if (separate) {
+		message.append(BankServer::SEPARATOR);
+	}
+}
+
+void StatusResponseWriter::accept()
+{
+	accepted = true;
+}
+
+void StatusResponseWriter::reject(const std::string& reason)
+{
+	accepted = false;
+	this->reason = reason;
+}
+
+BinaryResponseWriter::BinaryResponseWriter(ResponseBuilder& frame, const Request& request) : frame(frame)
+{
+	Protocol::putNumber(frame.body(), request.opcode_, 1);
+	Protocol::putNumber(frame.body(), request.correlation_id_, 4);
+	Protocol::putNumber(frame.body(), Protocol::STATUS_ACCEPTED, 1);
+}
+
+void BinaryResponseWriter::accept()
+{
+	frame.body()[Protocol::HEADER_SIZE - 1] = Protocol::STATUS_ACCEPTED;
+}
+
+void BinaryResponseWriter::reject(const std::string& reason)
+{
+	frame.body()[Protocol::HEADER_SIZE - 1] = Protocol::STATUS_REJECTED;
+	addText(reason);
+}
+
+void BinaryResponseWriter::addText(std::string_view text)
+{
+	// A longer text would be truncated by its length and desynchronize the fields that follow
+	if (text.size() > Protocol::MAX_TEXT_SIZE) {
+		throw protocol_exception("text field too long");
+	}
+
+	Protocol::putNumber(frame.body(), static_cast<std::uint8_t>(FieldType::text), 1);
+	Protocol::putNumber(frame.body(), text.size(), 2);
+	frame.append(text);
+}
+
+void BinaryResponseWriter::addAmount(Money amount)
+{
+	Protocol::putNumber(frame.body(), static_cast<std::uint8_t>(FieldType::amount), 1);
+	Protocol::putNumber(frame.body(), static_cast<std::uint64_t>(amount.cents()), 8);
+}
+
+void BinaryResponseWriter::addDate(int day)
+{
+	Protocol::putNumber(frame.body(), static_cast<std::uint8_t>(FieldType::date), 1);
+	Protocol::putNumber(frame.body(), static_cast<std::uint32_t>(day), 4);
+}
+
+void BinaryResponseWriter::addCount(int count)
+{
+	Protocol::putNumber(frame.body(), static_cast<std::uint8_t>(FieldType::integer), 1);
+	Protocol::putNumber(frame.body(), count, 4);
+
+	frame.reserve(count * ITEM_SIZE);
+}
+
+void BinaryResponseWriter::finish()
+{
+	std::string length = "";
+	Protocol::putNumber(length, frame.body().size(), Protocol::LENGTH_SIZE);
+	frame.setPrefix(length);
+}
+
+Request Protocol::decodeRequest(std::string_view frame)
+{
+	if (frame.size() < HEADER_SIZE) {
+		throw protocol_exception("frame too short");
+	}
+
+	Request request{};
+	const char* data = frame.data();
+	request.opcode_ = static_cast<int>(getNumber(data, 1));
+	request.correlation_id_ = static_cast<std::uint32_t>(getNumber(data + 1, 4));
+
+	request.binary_ = true;
+
+	std::size_t i = HEADER_SIZE;
+	while (i < frame.size()) {
+		// The operations of a batch are left to be decoded one at a time
+		if ((request.opcode_ == BankServer::BATCH) && (request.size() == BankServer::BATCH_HEADER_FIELDS)) {
+			request.batch_ = frame.substr(i);
+			break;
+		}
+
+		request.addField(decodeField(frame, i));
+	}
+
+	return request;
+}
+
+Request Protocol::decodeOperation(std::string_view& operations)
+{
+	std::size_t i = 0;
+
+	// The opcode is an ordinary field
+	Request opcode{};
+	opcode.addField(decodeField(operations, i));
+
+	Request operation{};
+	operation.opcode_ = opcode.integer(0);
+	operation.binary_ = true;
+
+	std::size_t count = BankServer::operationFields(operation.opcode_);
+	for (std::size_t n = 0; n < count; n++) {
+		operation.addField(decodeField(operations, i));
+	}
+
+	operations.remove_prefix(i);
+	return operation;
+}
+
+Field Protocol::decodeField(std::string_view frame, std::size_t& i)
+{
+	if (i >= frame.size()) {
+		throw protocol_exception("truncated field");
+	}
+
+	const char* data = frame.data();
+	Field field{ static_cast<FieldType>(getNumber(data + i, 1)), "", 0 };
+	i += 1;
+
+	// Size of the value that follows the type
+	std::size_t size = 0;
+	switch (field.type) {
+	case FieldType::text:
+		size = 2;
+		break;
+	case FieldType::amount:
+		size = 8;
+		break;
+	case FieldType::date:
+	case FieldType::integer:
+		size = 4;
+		break;
+	default:
+		throw protocol_exception("unknown field type");
+	}
+
+	if (i + size > frame.size()) {
+		throw protocol_exception("truncated field");
+	}
+
+	if (field.type == FieldType::text) {
+		std::size_t length = static_cast<std::size_t>(getNumber(data + i, size));
+		i += size;
+		if (i + length > frame.size()) {
+			throw protocol_exception("truncated field");
+		}
+		field.text = frame.substr(i, length);
+		i += length;
+	}
+	else {
+		field.value = static_cast<std::int64_t>(getNumber(data + i, size));
+		i += size;
+	}
+
+	return field;
+}
+
+std::uint32_t Protocol::frameLength(const char* data)
+{
+	return static_cast<std::uint32_t>(getNumber(data, LENGTH_SIZE));
+}
+
+int Protocol::daysFromDate(std::string_view date)
+{
+	int y = 0;
+	unsigned int m = 0;
+	unsigned int d = 0;
+
+	// YYYY-MM-DD
+	const char* end = date.data() + date.size();
+	auto year = std::from_chars(date.data(), end, y);
+	auto month = std::from_chars(std::min(year.ptr + 1, end), end, m);
+	auto day = std::from_chars(std::min(month.ptr + 1, end), end, d);
+	if ((year.ec != std::errc()) || (month.ec != std::errc()) || (day.ec != std::errc()) || (m < 1) || (m > 12)) {
+		throw protocol_exception("malformed date " + std::string(date));
+	}
+
+	return daysFromCivil(y, m, d);
+}
+
+std::string Protocol::dateFromDays(int days)
+{
+	int y = 0;
+	unsigned int m = 0;
+	unsigned int d = 0;
+	civilFromDays(days, y, m, d);
+
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u", y, m, d);
+	return std::string(buffer);
+}
+
+int Protocol::daysFromCivil(int year, unsigned int month, unsigned int day)
+{
+	// The year starts in March so that the leap day is the last one
+	year -= (month <= 2);
+	const int era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned int yoe = static_cast<unsigned int>(year - era * 400);
+	const unsigned int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<int>(doe) - 719468;
+}
+
+void Protocol::civilFromDays(int days, int& year, unsigned int& month, unsigned int& day)
+{
+	// Inverse of `daysFromCivil`
+	const int z = days + 719468;
+	const int era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned int doe = static_cast<unsigned int>(z - era * 146097);
+	const unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned int mp = (5 * doy + 2) / 153;
+	day = doy - (153 * mp + 2) / 5 + 1;
+	month = mp < 10 ? mp + 3 : mp - 9;
+	year = static_cast<int>(yoe) + era * 400 + (month <= 2);
+}
+
+void Protocol::putNumber(std::string& out, std::uint64_t value, std::size_t size)
+{
+	for (std::size_t i = size; i > 0; i--) {
+		out += static_cast<char>((value >> (8 * (i - 1))) & 0xFF);
+	}
+}
+
+std::uint64_t Protocol::getNumber(const char* data, std::size_t size)
+{
+	std::uint64_t value = 0;
+	for (std::size_t i = 0; i < size; i++) {
+		value = (value << 8) | static_cast<unsigned char>(data[i]);
+	}
+	return value;
+}
@@ -0,0 +1,354 @@
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "money.h"
+#include "response_builder.h"
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+/**
+ * Type of a field in the binary protocol.
+ */
+enum class FieldType : std::uint8_t {
+	text = 1, amount = 2, date = 3, integer = 4
+};
+
+/**
+ * A single field of a request. Fields of the text protocol are always text and they are
+ * converted on access, fields of the binary protocol carry their typed value. Text is a view
+ * into the buffer the request was decoded from, which must outlive the request.
+ */
+struct Field {
+	FieldType type;
+	std::string_view text;
+	std::int64_t value;
+};
+
+/**
+ * Request decoded from either of the protocols. Decoding doesn't allocate: the fields are stored
+ * in place and refer to the received data.
+ */
+class Request {
+public:
+	/**
+	 * An empty request (it is expected that fields will be manually filled later).
+	 */
+	Request() : opcode_(0), correlation_id_(0), fields_(), field_count_(0), batch_(), binary_(false) {};
+
+	/**
+	 * Append a field.
+	 * @param[in]	field	The field
+	 */
+	void addField(const Field& field);
+
+	/**
+	 * Number of fields.
+	 * @returns		The number
+	 */
+	std::size_t size() const { return field_count_; };
+
+	/**
+	 * Text value of a field.
+	 * @param[in]	i	Index of the field
+	 * @returns			The text (valid as long as the received data)
+	 */
+	std::string_view text(std::size_t i) const;
+
+	/**
+	 * Amount of money stored in a field.
+	 * @param[in]	i	Index of the field
+	 * @returns			The amount
+	 */
+	Money amount(std::size_t i) const;
+
+	/**
+	 * Date stored in a field.
+	 * @param[in]	i	Index of the field
+	 * @returns			Number of days since 1970-01-01
+	 */
+	int day(std::size_t i) const;
+
+	/**
+	 * Integer stored in a field.
+	 * @param[in]	i	Index of the field
+	 * @returns			The integer
+	 */
+	int integer(std::size_t i) const;
+
+	/**
+	 * Decode the next operation of a batch, in the protocol of this request.
+	 * @param[in,out]	operations	Operations not decoded yet, the decoded one is removed
+	 * @returns						The operation
+	 */
+	Request nextOperation(std::string_view& operations) const;
+
+	// No request has more fields than this
+	static const std::size_t MAX_FIELDS = 16;
+
+	// Request data
+	int opcode_;
+	std::uint32_t correlation_id_;
+	std::array<Field, MAX_FIELDS> fields_;
+	std::size_t field_count_;
+
+	// Operations of a batch, decoded one at a time by `nextOperation`
+	std::string_view batch_;
+
+	// Whether the request came in the binary protocol
+	bool binary_;
+
+private:
+	/**
+	 * Get a field, checking the index.
+	 * @param[in]	i	Index of the field
+	 * @returns			The field
+	 */
+	const Field& field(std::size_t i) const;
+};
+
+/**
+ * Interface for creating a response independently of the protocol in use.
+ */
+class ResponseWriter {
+public:
+	virtual ~ResponseWriter() = default;
+
+	/**
+	 * Mark the request as successfully served, the response fields follow.
+	 */
+	virtual void accept() = 0;
+
+	/**
+	 * Mark the request as rejected.
+	 * @param[in]	reason	Human readable reason of the rejection
+	 */
+	virtual void reject(const std::string& reason) = 0;
+
+	/**
+	 * Append a text field.
+	 * @param[in]	text	The text
+	 * @throws protocol_exception if the text doesn't fit the field of the protocol
+	 */
+	virtual void addText(std::string_view text) = 0;
+
+	/**
+	 * Append an amount of money.
+	 * @param[in]	amount	The amount
+	 */
+	virtual void addAmount(Money amount) = 0;
+
+	/**
+	 * Append a date.
+	 * @param[in]	day		Number of days since 1970-01-01
+	 */
+	virtual void addDate(int day) = 0;
+
+	/**
+	 * Append the number of items of the list that follows.
+	 * @param[in]	count	Number of items
+	 */
+	virtual void addCount(int count) = 0;
+};
+
+/**
+ * Response of the text protocol (v1): fields are separated by ';' and the list count is always
+ * followed by a separator. The terminal character is not written.
+ */
+class TextResponseWriter : public ResponseWriter {
+public:
+	/**
+	 * @param[out]	message		Builder the response is appended to
+	 */
+	TextResponseWriter(ResponseBuilder& message) : message(message), separate(false) {};
+
+	void accept() override;
+	void reject(const std::string& reason) override;
+	void addText(std::string_view text) override;
+	void addAmount(Money amount) override;
+	void addDate(int day) override;
+	void addCount(int count) override;
+
+private:
+	// The response
+	ResponseBuilder& message;
+
+	// Whether a separator has to be written before the next field
+	bool separate;
+
+	// Expected size of a list item, used to reserve the space for the whole list
+	static const std::size_t ITEM_SIZE = 80;
+
+	/**
+	 * Write separator if the previous field requires it.
+	 */
+	void separator();
+};
+
+/**
+ * Response of the binary protocol (v2), see `Protocol` for the frame layout.
+ */
+class BinaryResponseWriter : public ResponseWriter {
+public:
+	/**
+	 * @param[out]	frame		Builder the frame is written to
+	 * @param[in]	request		Request being responded to (its opcode and correlation id are echoed)
+	 */
+	BinaryResponseWriter(ResponseBuilder& frame, const Request& request);
+
+	void accept() override;
+	void reject(const std::string& reason) override;
+	void addText(std::string_view text) override;
+	void addAmount(Money amount) override;
+	void addDate(int day) override;
+	void addCount(int count) override;
+
+	/**
+	 * Complete the frame by setting its length prefix.
+	 */
+	void finish();
+
+private:
+	// The frame being built (the length prefix is set by `finish`)
+	ResponseBuilder& frame;
+
+	// Expected size of a list item, used to reserve the space for the whole list
+	static const std::size_t ITEM_SIZE = 80;
+};
+
+/**
+ * Response of a single operation of a batch: only the outcome is kept, the fields are dropped.
+ */
+class StatusResponseWriter : public ResponseWriter {
+public:
+	StatusResponseWriter() : accepted(false), reason() {};
+
+	void accept() override;
+	void reject(const std::string& reason) override;
+	void addText(std::string_view) override {};
+	void addAmount(Money) override {};
+	void addDate(int) override {};
+	void addCount(int) override {};
+
+	// Outcome of the operation
+	bool accepted;
+	std::string reason;
+};
+
+/**
+ * The binary protocol (v2). A client selects it by sending `VERSION_2` followed by '\n' as the
+ * first bytes of a connection, the server acknowledges it by sending back `VERSION_2`. The
+ * connection is then persistent and carries frames in both directions:
+ *
+ *   u32 length of the rest of the frame
+ *   u8  opcode, u32 correlation id, u8 status (requests always 0)
+ *   fields, each starting with u8 FieldType:
+ *     text		u16 length + bytes
+ *     amount	i64 hundredths
+ *     date		u32 days since 1970-01-01
+ *     integer	u32
+ *
+ * All the numbers are in network byte order. A rejected response carries a single text field
+ * with the reason.
+ */
+class Protocol {
+public:
+	// Handshake byte selecting the binary protocol
+	static const unsigned char VERSION_2 = 2;
+
+	// Sizes of the frame parts
+	static const std::size_t LENGTH_SIZE = 4;
+	static const std::size_t HEADER_SIZE = 6;
+
+	// Frames longer than this are considered malformed
+	static const std::uint32_t MAX_FRAME_SIZE = 1 << 20;
+
+	// Longest text field, its length is written in two bytes
+	static const std::size_t MAX_TEXT_SIZE = 0xFFFF;
+
+	// Response status
+	static const std::uint8_t STATUS_ACCEPTED = 0;
+	static const std::uint8_t STATUS_REJECTED = 1;
+
+	/**
+	 * Decode a request frame.
+	 * @param[in]	frame	The frame without the length prefix (must outlive the request)
+	 * @returns				The request
+	 */
+	static Request decodeRequest(std::string_view frame);
+
+	/**
+	 * Decode the next operation of a batch: an integer opcode followed by the fields of the operation.
+	 * @param[in,out]	operations	Operations not decoded yet, the decoded one is removed
+	 * @returns						The operation
+	 */
+	static Request decodeOperation(std::string_view& operations);
+
+	/**
+	 * Read the length prefix of a frame.
+	 * @param[in]	data	At least LENGTH_SIZE bytes
+	 * @returns				Length of the rest of the frame
+	 */
+	static std::uint32_t frameLength(const char* data);
+
+	/**
+	 * Convert a date to the number of days since 1970-01-01.
+	 * @param[in]	date	String representation of the date (YYYY-MM-DD)
+	 * @returns				Number of days
+	 */
+	static int daysFromDate(std::string_view date);
+
+	/**
+	 * Convert a number of days since 1970-01-01 to a date.
+	 * @param[in]	days	Number of days
+	 * @returns				String representation of the date (YYYY-MM-DD)
+	 */
+	static std::string dateFromDays(int days);
+
+	/**
+	 * Convert a civil date to the number of days since 1970-01-01. A day past the end of the month
+	 * continues into the next month, like `mktime` normalizes it.
+	 * @param[in]	year	The year
+	 * @param[in]	month	The month (1 to 12)
+	 * @param[in]	day		The day of the month (from 1)
+	 * @returns				Number of days
+	 */
+	static int daysFromCivil(int year, unsigned int month, unsigned int day);
+
+	/**
+	 * Convert a number of days since 1970-01-01 to a civil date.
+	 * @param[in]	days	Number of days
+	 * @param[out]	year	The year
+	 * @param[out]	month	The month (1 to 12)
+	 * @param[out]	day		The day of the month (from 1)
+	 */
+	static void civilFromDays(int days, int& year, unsigned int& month, unsigned int& day);
+
+	/**
+	 * Append a number in network byte order.
+	 * @param[out]	out		Output buffer
+	 * @param[in]	value	The number
+	 * @param[in]	size	Number of bytes to write
+	 */
+	static void putNumber(std::string& out, std::uint64_t value, std::size_t size);
+
+	/**
+	 * Read a number in network byte order.
+	 * @param[in]	data	Input buffer
+	 * @param[in]	size	Number of bytes to read
+	 * @returns				The number
+	 */
+	static std::uint64_t getNumber(const char* data, std::size_t size);
+
+private:
+	/**
+	 * Decode a single field.
+	 * @param[in]		frame	Data the field is part of
+	 * @param[in,out]	i		Position of the field, moved past it
+	 * @returns					The field
+	 */
+	static Field decodeField(std::string_view frame, std::size_t& i);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "response_builder.h"
+#include <charconv>
+
+void ResponseBuilder::reserve(std::size_t size)
+{
+	if (body_.capacity() < body_.size() + size) {
+		body_.reserve(body_.size() + size);
+	}
+}
+
+void ResponseBuilder::append(std::string_view text)
+{
+	body_ += text;
+}
+
+void ResponseBuilder::append(char c)
+{
+	body_ += c;
+}
+
+void ResponseBuilder::appendNumber(long long value)
+{
+	std::size_t size = body_.size();
+	body_.resize(size + NUMBER_CAPACITY);
+
+	auto result = std::to_chars(&body_[size], &body_[size] + NUMBER_CAPACITY, value);
+	body_.resize(result.ptr - body_.data());
+}
+
+void ResponseBuilder::appendAmount(Money amount)
+{
+	std::size_t size = body_.size();
+	body_.resize(size + Money::FORMAT_CAPACITY);
+
+	// Six decimal places, like "%f"
+	char* end = amount.format(&body_[size], AMOUNT_DECIMALS);
+	body_.resize(end - body_.data());
+}
+
+void ResponseBuilder::setPrefix(std::string_view prefix)
+{
+	prefix_ = prefix;
+}
+
+std::array<asio::const_buffer, 2> ResponseBuilder::buffers() const
+{
+	return { asio::buffer(prefix_), asio::buffer(body_) };
+}
+
+std::string ResponseBuilder::str() const
+{
+	return prefix_ + body_;
+}
@@ -0,0 +1,107 @@
+#include <SDKDDKVer.h>
+
+#define ASIO_STANDALONE
+#include <asio.hpp>
+#include <array>
+#include <string>
+#include <string_view>
+#include "money.h"
+
+#ifndef RESPONSE_BUILDER_H_
+#define RESPONSE_BUILDER_H_
+
+/**
+ * Buffer a response is built in. The body is allocated once with enough capacity for a typical
+ * response and numbers are formatted directly into it. A short prefix (correlation id of a text
+ * response, length of a frame) is kept apart, so it can be set after the body is complete; both
+ * parts are then written to the socket as a buffer sequence without being concatenated.
+ */
+class ResponseBuilder
+{
+public:
+	/**
+	 * @param[in]	capacity	Initial capacity of the body
+	 */
+	ResponseBuilder(std::size_t capacity = DEFAULT_CAPACITY) : prefix_(), body_()
+	{
+		body_.reserve(capacity);
+	};
+
+	/**
+	 * Make sure the body can grow by given number of bytes without reallocating.
+	 * @param[in]	size	Number of bytes
+	 */
+	void reserve(std::size_t size);
+
+	/**
+	 * Append text to the body.
+	 * @param[in]	text	The text
+	 */
+	void append(std::string_view text);
+
+	/**
+	 * Append a single character to the body.
+	 * @param[in]	c		The character
+	 */
+	void append(char c);
+
+	/**
+	 * Format an integer directly into the body.
+	 * @param[in]	value	The integer
+	 */
+	void appendNumber(long long value);
+
+	/**
+	 * Format an amount of money directly into the body, with six decimal places like "%f".
+	 * @param[in]	amount	The amount
+	 */
+	void appendAmount(Money amount);
+
+	/**
+	 * Set the prefix written before the body.
+	 * @param[in]	prefix	The prefix
+	 */
+	void setPrefix(std::string_view prefix);
+
+	/**
+	 * The body being built.
+	 * @returns		The body
+	 */
+	std::string& body() { return body_; };
+
+	/**
+	 * Total size of the response.
+	 * @returns		Number of bytes
+	 */
+	std::size_t size() const { return prefix_.size() + body_.size(); };
+
+	/**
+	 * Buffers to be written, valid until the builder is modified, moved or destroyed.
+	 * @returns		The prefix and the body
+	 */
+	std::array<asio::const_buffer, 2> buffers() const;
+
+	/**
+	 * The response as a single string (copies it).
+	 * @returns		Prefix followed by the body
+	 */
+	std::string str() const;
+
+	// Capacity of the body if not specified otherwise
+	static const std::size_t DEFAULT_CAPACITY = 256;
+
+private:
+	// Written before the body
+	std::string prefix_;
+
+	// The response
+	std::string body_;
+
+	// Enough for any integer `appendNumber` formats in place
+	static const std::size_t NUMBER_CAPACITY = 32;
+
+	// Decimal places of an amount in the text protocol
+	static const int AMOUNT_DECIMALS = 6;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include <string_view>
+#include "sqlite/sqlite3.h"
+#include "money.h"
+
+#ifndef ROW_H_
+#define ROW_H_
+
+/**
+ * Current row of a statement being stepped through. Columns are read by their position in the
+ * SELECT, with the type they are stored with, so reading a row neither compares column names nor
+ * converts values through text. Text is a view valid until the statement steps further.
+ */
+class Row
+{
+public:
+	/**
+	 * @param[in]	statement	Statement positioned on a row
+	 */
+	explicit Row(sqlite3_stmt* statement) : statement(statement) {};
+
+	/**
+	 * Integer value of a column.
+	 * @param[in]	i	Position of the column
+	 * @returns			The value
+	 */
+	long long integer(int i) const { return sqlite3_column_int64(statement, i); };
+
+	/**
+	 * Date stored in a column.
+	 * @param[in]	i	Position of the column
+	 * @returns			Number of days since 1970-01-01
+	 */
+	int day(int i) const { return sqlite3_column_int(statement, i); };
+
+	/**
+	 * Amount of money stored in a column.
+	 * @param[in]	i	Position of the column
+	 * @returns			The amount
+	 */
+	Money amount(int i) const { return Money(sqlite3_column_int64(statement, i)); };
+
+	/**
+	 * Text value of a column.
+	 * @param[in]	i	Position of the column
+	 * @returns			The text (empty for NULL)
+	 */
+	std::string_view text(int i) const
+	{
+		// The size must be asked for after the text, which may be converted to it first
+		const char* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, i));
+		return std::string_view(text != nullptr ? text : "", sqlite3_column_bytes(statement, i));
+	};
+
+private:
+	// The statement
+	sqlite3_stmt* statement;
+};
+
+#endif
@@ -0,0 +1,670 @@
+#include "self_test.h"
+#include "bank_exception.h"
+#include "bank_server.h"
+#include "importer.h"
+#include "transaction.h"
+#include <atomic>
+#include <functional>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+bool SelfTest::run()
+{
+	const std::pair<std::string, std::function<void()>> groups[] = {
+		{ "balances", [this]() { checkBalances(); } },
+		{ "money", [this]() { checkMoney(); } },
+		{ "history pages", [this]() { checkHistoryPages(); } },
+		{ "archive", [this]() { checkArchive(); } },
+		{ "import", [this]() { checkImport(); } },
+		{ "batch, own commit", [this]() { checkBatch(""); } },
+		{ "batch, group commit", [this]() { checkBatch("group_commit_batch = 16\n"); } },
+		{ "group commit", [this]() { checkGroupCommit(); } },
+		{ "cache", [this]() { checkCache(); } },
+		{ "deltas", [this]() { checkDeltas(); } },
+	};
+
+	// A group that throws is a failure of its own, the other groups still run
+	for (auto&& group : groups) {
+		try {
+			group.second();
+		}
+		catch (std::exception& e) {
+			check(false, group.first + ": " + e.what());
+		}
+	}
+
+	out << "Self-test: " << checks << " checks, " << failures << " failed" << std::endl;
+	return failures == 0;
+}
+
+void SelfTest::check(bool passed, const std::string& what)
+{
+	checks++;
+	if (!passed) {
+		failures++;
+		out << "FAILED " << what << std::endl;
+	}
+}
+
+template <typename Exception, typename Operation>
+void SelfTest::checkThrows(Operation operation, const std::string& what)
+{
+	bool thrown = false;
+	try {
+		operation();
+	}
+	catch (Exception&) {
+		thrown = true;
+	}
+	check(thrown, what);
+}
+
+void SelfTest::checkBalances()
+{
+	fs::path root = createScratch();
+
+	// Kept as the balance changes, with days nothing changed in between
+	int day = Protocol::daysFromDate("2021-03-10");
+	{
+		Database database;
+		database.setup(serverPath(root));
+		database.addUser(User("a@x", "secret", {}));
+		database.addUser(User("b@x", "secret", {}));
+		database.addAccount(Account("a@x", "main", Money(1000), State::ok));
+		database.addAccount(Account("b@x", "main", Money(700), State::ok));
+		long long a = database.getAccountId("a@x", "main");
+		long long b = database.getAccountId("b@x", "main");
+
+		database.addToBalance(a, Money(500), State::ok, day);
+		database.addToBalance(a, Money(-200), State::ok, day + 5);
+		database.addToBalance(a, Money(-100), State::ok, day + 5);
+		database.addToBalance(a, Money(50), State::ok, day + 20);
+
+		const std::pair<int, long long> expected[] = {
+			{ day - 1, 1000 }, { day, 1500 }, { day + 3, 1500 }, { day + 5, 1200 },
+			{ day + 10, 1200 }, { day + 20, 1250 }, { day + 400, 1250 },
+		};
+		for (auto&& e : expected) {
+			Money balance;
+			check(database.getBalance(a, e.first, balance) && (balance.cents() == e.second),
+				"balance as of " + Protocol::dateFromDays(e.first));
+		}
+
+		Money balance;
+		check(!database.getBalance(b, day, balance), "no balance of an account that never changed");
+	}
+
+	// The server answers with the balance an account was created with if it never changed
+	{
+		BankServer server(1);
+		server.setup(serverPath(root));
+		Response changed = serve(server, "15a@x;main;" + Protocol::dateFromDays(day + 10) + "\n");
+		check(changed.accepted && (changed.amounts == std::vector<Money>{ Money(1200) }),
+			"balance served as of a day");
+		Response unchanged = serve(server, "15b@x;main;" + Protocol::dateFromDays(day) + "\n");
+		check(unchanged.accepted && (unchanged.amounts == std::vector<Money>{ Money(700) }),
+			"balance of an unchanged account");
+		check(!serve(server, "15a@x;none;2021-03-10\n").accepted, "reject the balance of an unknown account");
+	}
+	removeScratch(root);
+
+	// Derived from the history by the import, back from the balances imported
+	root = createScratch();
+	std::ofstream(root / "import.csv")
+		<< "user,a@x,secret\n"
+		<< "user,b@x,secret\n"
+		<< "account,a@x,main,100\n"
+		<< "account,b@x,main,0\n"
+		<< "account,b@x,spare,5\n"
+		<< "record,a@x,main,b@x,main,30,2020-01-10\n"
+		<< "record,-,-,a@x,main,50,2020-02-01\n"
+		<< "record,a@x,main,b@x,main,20,2020-03-05\n";
+	{
+		std::ostringstream log;
+		Importer importer(serverPath(root));
+		importer.import((root / "import.csv").string(), log);
+		importer.finish(log);
+	}
+	{
+		Database database;
+		database.setup(serverPath(root));
+		long long a = database.getAccountId("a@x", "main");
+		long long b = database.getAccountId("b@x", "main");
+		long long spare = database.getAccountId("b@x", "spare");
+
+		const std::pair<std::string, std::pair<long long, long long>> expected[] = {
+			{ "2020-01-09", { 10000, -5000 } }, { "2020-01-10", { 7000, -2000 } }, { "2020-01-20", { 7000, -2000 } },
+			{ "2020-02-01", { 12000, -2000 } }, { "2020-02-15", { 12000, -2000 } }, { "2020-03-05", { 10000, 0 } },
+			{ "2030-01-01", { 10000, 0 } },
+		};
+		for (auto&& e : expected) {
+			Money balance_a;
+			Money balance_b;
+			int date = Protocol::daysFromDate(e.first);
+			check(database.getBalance(a, date, balance_a) && (balance_a.cents() == e.second.first),
+				"imported balance of the source as of " + e.first);
+			check(database.getBalance(b, date, balance_b) && (balance_b.cents() == e.second.second),
+				"imported balance of the target as of " + e.first);
+		}
+
+		Money balance;
+		check(!database.getBalance(spare, Protocol::daysFromDate("2020-02-01"), balance),
+			"no imported balance of an account without history");
+	}
+	removeScratch(root);
+}
+
+void SelfTest::checkMoney()
+{
+	const long long max = std::numeric_limits<long long>::max();
+	const long long min = std::numeric_limits<long long>::min();
+
+	check(Money::parse("12.34").cents() == 1234, "parse 12.34");
+	check(Money::parse("-0.5").cents() == -50, "parse -0.5");
+	check(Money::parse("100.500000").cents() == 10050, "parse trailing zeros");
+	check(Money::parse("92233720368547758.07").cents() == max, "parse the largest amount");
+	check(Money::parse("-92233720368547758.08").cents() == min, "parse the smallest amount");
+
+	checkThrows<std::overflow_error>([]() { Money::parse("92233720368547758.08"); }, "parse past the largest amount");
+	checkThrows<std::overflow_error>([]() { Money::parse("-92233720368547758.09"); }, "parse past the smallest amount");
+	checkThrows<std::overflow_error>([]() { Money::parse("100000000000000000"); }, "parse too many digits");
+	checkThrows<std::invalid_argument>([]() { Money::parse("1.005"); }, "parse past the hundredths");
+	checkThrows<std::invalid_argument>([]() { Money::parse("1.2.3"); }, "parse two points");
+	checkThrows<std::invalid_argument>([]() { Money::parse("-"); }, "parse a sign alone");
+	checkThrows<std::invalid_argument>([]() { Money::parse(""); }, "parse nothing");
+
+	check(Money(-50).str() == "-0.50", "format -0.50");
+	check(Money(1234).str(6) == "12.340000", "format with six decimals");
+	check(Money(min).str() == "-92233720368547758.08", "format the smallest amount");
+	for (long long cents : { 0LL, 1LL, -1LL, 99LL, -12345LL, max, min }) {
+		check(Money::parse(Money(cents).str(6)).cents() == cents, "format and parse " + std::to_string(cents));
+	}
+
+	check((Money(max) + Money(-1)).cents() == max - 1, "add within range");
+	check((Money(min) - Money(-1)).cents() == min + 1, "subtract within range");
+	checkThrows<std::overflow_error>([=]() { Money(max) + Money(1); }, "add past the largest amount");
+	checkThrows<std::overflow_error>([=]() { Money(min) + Money(-1); }, "add past the smallest amount");
+	checkThrows<std::overflow_error>([=]() { Money(min) - Money(1); }, "subtract past the smallest amount");
+	checkThrows<std::overflow_error>([=]() { Money(max) - Money(-1); }, "subtract past the largest amount");
+	checkThrows<std::overflow_error>([=]() { Money(0) - Money(min); }, "negate the smallest amount");
+}
+
+void SelfTest::checkHistoryPages()
+{
+	fs::path root = createScratch();
+
+	// Four records a day, every tenth day from the end of January to the middle of March; the
+	// amount tells a record's position in the history
+	int first_day = Protocol::daysFromDate("2020-01-25");
+	{
+		Database database;
+		database.setup(serverPath(root));
+		database.addUser(User("a@x", "secret", {}));
+		database.addUser(User("b@x", "secret", {}));
+		database.addAccount(Account("a@x", "main", Money(), State::ok));
+		database.addAccount(Account("b@x", "main", Money(), State::ok));
+		long long a = database.getAccountId("a@x", "main");
+		long long b = database.getAccountId("b@x", "main");
+
+		Transaction transaction(database);
+		for (int i = 0; i < PAGE_RECORDS; i++) {
+			int date = first_day + (i / 4) * 10;
+			Record record = (i % 2 == 0) ? Record("a@x", "b@x", "main", "main", Money(100 + i), date, a, b)
+				: Record("b@x", "a@x", "main", "main", Money(100 + i), date, b, a);
+			transaction.database().addRecord(record);
+		}
+		transaction.commit();
+	}
+
+	{
+		BankServer server(1);
+		server.setup(serverPath(root));
+
+		// Follows the cursors from the first page to the last one
+		auto read = [&](const std::string& from, const std::string& to, int page_size, std::vector<long long>& amounts) {
+			std::string cursor = "";
+			for (int page = 0; page <= PAGE_RECORDS; page++) {
+				Response response = serve(server, "14a@x;main;" + from + ";" + to + ";" + std::to_string(page_size) + ";"
+					+ cursor + "\n");
+				if (!response.accepted || response.texts.empty() || response.counts.empty()) {
+					return false;
+				}
+				for (auto&& amount : response.amounts) {
+					amounts.push_back(amount.cents());
+				}
+				cursor = response.texts[0];
+				if (cursor.empty()) {
+					return true;
+				}
+				if (response.counts[0] != page_size) {
+					return false;
+				}
+			}
+			return false;
+		};
+
+		std::vector<long long> expected;
+		for (int i = 0; i < PAGE_RECORDS; i++) {
+			expected.push_back(100 + i);
+		}
+		std::vector<long long> amounts;
+		check(read("2020-01-01", "2020-12-31", PAGE_SIZE, amounts) && (amounts == expected),
+			"pages of the whole history");
+
+		amounts.clear();
+		check(read("2020-01-01", "2020-12-31", PAGE_RECORDS, amounts) && (amounts == expected),
+			"a single page of the whole history");
+
+		// The second to the fifth day: records 4 to 19
+		expected.assign(expected.begin() + 4, expected.begin() + 20);
+		amounts.clear();
+		check(read(Protocol::dateFromDays(first_day + 10), Protocol::dateFromDays(first_day + 40), 3, amounts)
+			&& (amounts == expected), "pages of a range of days");
+
+		Response whole = serve(server, "09a@x;main;2020-01-01;2020-12-31\n");
+		check(whole.accepted && (whole.counts == std::vector<int>{ PAGE_RECORDS }), "the whole history at once");
+
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;5;abc\n").accepted, "reject a cursor without separator");
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;5;x/1\n").accepted, "reject a cursor that isn't numeric");
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;5;12abc/3x\n").accepted,
+			"reject a cursor with characters after its numbers");
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;5;/3\n").accepted, "reject a cursor without date");
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;5;12/\n").accepted, "reject a cursor without rowid");
+		check(!serve(server, "14a@x;none;2020-01-01;2020-12-31;5;\n").accepted, "reject the pages of an unknown account");
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;0;\n").accepted, "reject an empty page");
+		check(!serve(server, "14a@x;main;2020-01-01;2020-12-31;" + std::to_string(BankServer::MAX_PAGE_SIZE + 1)
+			+ ";\n").accepted, "reject a page over the limit");
+	}
+
+	removeScratch(root);
+}
+
+void SelfTest::checkArchive()
+{
+	fs::path root = createScratch();
+
+	int january = Partitions::month(Protocol::daysFromDate("2020-01-01"));
+	int february = january + 1;
+	const char* dates[] = { "2020-01-05", "2020-01-15", "2020-01-25", "2020-02-10", "2020-02-20", "2020-03-01" };
+	std::size_t count = sizeof(dates) / sizeof(dates[0]);
+
+	int first_day = Protocol::daysFromDate("2020-01-01");
+	int last_day = Protocol::daysFromDate("2020-12-31");
+	auto countRecords = [&](Database& database) {
+		long long a = database.getAccountId("a@x", "main");
+		RecordList records;
+		database.gatherRecords(a, first_day, last_day, &records);
+		RecordPage page;
+		database.gatherRecordPage(a, first_day, last_day, first_day, 0, 100, &page);
+		return (records.size() == page.records.size()) ? records.size() : 0;
+	};
+
+	{
+		Database database;
+		database.setup(serverPath(root));
+		database.addAccount(Account("a@x", "main", Money(), State::ok));
+		database.addAccount(Account("b@x", "main", Money(), State::ok));
+		long long a = database.getAccountId("a@x", "main");
+		long long b = database.getAccountId("b@x", "main");
+		for (auto&& date : dates) {
+			database.addRecord(Record("a@x", "b@x", "main", "main", Money(100), Protocol::daysFromDate(date), a, b));
+		}
+
+		database.archive(january);
+		database.compact();
+
+		const Partitions& partitions = database.getPartitions();
+		check(partitions.archived(january) && !partitions.archived(february), "only the archived month is archived");
+		check(fs::exists(root / "db" / "archive" / (Partitions::table(january) + ".db")), "archive file written");
+		check(countRecords(database) == count, "archived records read along with the rest");
+
+		Record late("a@x", "b@x", "main", "main", Money(100), Protocol::daysFromDate("2020-01-31"), a, b);
+		checkThrows<db_exception>([&]() { database.addRecord(late); }, "reject a record of an archived month");
+		checkThrows<db_exception>([&]() { database.archive(january); }, "reject archiving a month twice");
+		checkThrows<db_exception>([&]() { database.archive(january + 6); }, "reject archiving a month without records");
+	}
+
+	{
+		Database database;
+		database.setup(serverPath(root));
+		check(database.getPartitions().archived(january), "archived month known once opened again");
+		check(countRecords(database) == count, "archived records read once opened again");
+	}
+
+	removeScratch(root);
+}
+
+void SelfTest::checkImport()
+{
+	fs::path root = createScratch();
+
+	// Rows 4, 7, 9 and 10 of the CSV and 4 of the NDJSON can't be imported
+	std::ofstream(root / "import.csv")
+		<< "type,email,password\n"
+		<< "user,a@x,secret\n"
+		<< "user,b@x,secret\n"
+		<< "user,a@x,other\n"
+		<< "account,a@x,main,100.50\n"
+		<< "account,b@x,\"a \"\"b\"\", c\",0,BLOCKED\n"
+		<< "account,c@x,main,0\n"
+		<< "record,a@x,main,b@x,\"a \"\"b\"\", c\",30,2020-01-10\n"
+		<< "record,a@x,main,b@x,none,5,2020-01-11\n"
+		<< "record,-,-,a@x,main,1.005,2020-01-12\n"
+		<< "record,-,-,a@x,main,50,2020-02-01\n";
+	std::ofstream(root / "import.ndjson")
+		<< "{\"type\":\"user\",\"email\":\"c@x\",\"password\":\"pw\"}\n"
+		<< "{\"type\":\"account\",\"email\":\"c@x\",\"name\":\"main\",\"balance\":\"12.50\",\"state\":\"OK\"}\n"
+		<< "{\"type\":\"record\",\"source_email\":\"c@x\",\"source_name\":\"main\",\"target_email\":\"a@x\","
+		<< "\"target_name\":\"main\",\"amount\":\"2.50\",\"date\":\"2020-03-01\"}\n"
+		<< "{\"type\":\"record\",\"source_email\":\"c@x\"\n";
+
+	std::ostringstream log;
+	{
+		Importer importer(serverPath(root), 2);
+		importer.import((root / "import.csv").string(), log);
+		importer.import((root / "import.ndjson").string(), log);
+		importer.finish(log);
+	}
+	std::string reported = log.str();
+	for (auto&& line : { "import.csv:4:", "import.csv:7:", "import.csv:9:", "import.csv:10:", "import.ndjson:4:" }) {
+		check(reported.find(line) != std::string::npos, std::string("row reported as rejected ") + line);
+	}
+	check(reported.find("3 users, 3 accounts, 3 records, 5 rejected") != std::string::npos, "rows imported counted");
+
+	const std::string quoted = "a \"b\", c";
+	{
+		Database database;
+		database.setup(serverPath(root));
+
+		User a = database.getUser("a@x");
+		check(a.correct_ && (a.password_ == "secret") && (a.accounts_.size() == 1)
+			&& (a.accounts_[0].balance_ == Money(10050)), "imported user with the first password and an account");
+		User b = database.getUser("b@x");
+		check(b.correct_ && (b.accounts_.size() == 1) && (b.accounts_[0].name_ == quoted)
+			&& (b.accounts_[0].state_ == State::blocked), "imported account with a quoted name and a state");
+
+		RecordList records;
+		database.gatherRecords(database.getAccountId("a@x", "main"), Protocol::daysFromDate("2020-01-01"),
+			Protocol::daysFromDate("2020-12-31"), &records);
+		check(records.size() == 3, "imported records in the history");
+
+		std::vector<user_pair> pairs;
+		database.gatherPrevious(database.getAccountId("a@x", "main"), &pairs);
+		check((pairs.size() == 1) && (pairs[0].name_target == quoted), "imported transfer added to the previous targets");
+	}
+
+	{
+		BankServer server(1);
+		server.setup(serverPath(root));
+		check(serve(server, "01c@x;pw\n").accepted, "imported user logs in");
+		Response b = serve(server, "10b@x\n");
+		check(b.accepted && (b.amounts == std::vector<Money>{ Money(0) }) && (b.texts.back() == "BLOCKED"),
+			"imported account served");
+	}
+
+	removeScratch(root);
+}
+
+void SelfTest::checkBatch(const std::string& config)
+{
+	std::string mode = config.empty() ? "own commit: " : "group commit: ";
+	fs::path root = createScratch(config);
+	std::string today = Protocol::dateFromDays(BankServer::currentDate());
+
+	// The balances the cache holds and the history and end-of-day balances the database holds
+	auto balances = [](BankServer& server) {
+		std::vector<Money> amounts;
+		for (auto&& email : { "a@x", "b@x" }) {
+			Response response = serve(server, std::string("10") + email + "\n");
+			amounts.insert(amounts.end(), response.amounts.begin(), response.amounts.end());
+		}
+		return amounts;
+	};
+	auto stored = [&](BankServer& server) {
+		std::vector<Money> amounts;
+		for (auto&& email : { "a@x", "b@x" }) {
+			Response response = serve(server, std::string("15") + email + ";main;" + today + "\n");
+			amounts.insert(amounts.end(), response.amounts.begin(), response.amounts.end());
+		}
+		return amounts;
+	};
+	auto records = [&](BankServer& server) {
+		Response response = serve(server, "09a@x;main;" + today + ";" + today + "\n");
+		return response.counts.empty() ? -1 : response.counts[0];
+	};
+
+	{
+		BankServer server(1);
+		server.setup(serverPath(root));
+		for (auto&& request : { "02a@x;secret\n", "02b@x;secret\n", "08a@x;main\n", "08b@x;main\n", "07a@x;main;100\n" }) {
+			check(serve(server, request).accepted, mode + "prepare " + request);
+		}
+
+		// The last operation names an account that doesn't exist
+		std::string operations = "3;07;a@x;main;5;03;a@x;b@x;main;main;10;03;a@x;ghost@x;main;main;1\n";
+
+		Response all = serve(server, "130;" + operations);
+		check(!all.accepted && (all.reason.rfind("Operation 2 rejected", 0) == 0), mode + "all-or-nothing batch rejected");
+		check(balances(server) == std::vector<Money>{ Money(10000), Money(0) }, mode + "cache rolled back");
+		check(stored(server) == std::vector<Money>{ Money(10000), Money(0) }, mode + "end-of-day balances rolled back");
+		check(records(server) == 1, mode + "history rolled back");
+
+		Response best = serve(server, "131;" + operations);
+		check(best.accepted && (best.counts == std::vector<int>{ 3 }) && (best.texts.size() == 3)
+			&& (best.texts[0] == BankServer::ACCEPTED) && (best.texts[1] == BankServer::ACCEPTED)
+			&& (best.texts[2].rfind(BankServer::REJECTED, 0) == 0), mode + "best-effort batch outcomes");
+		check(balances(server) == std::vector<Money>{ Money(9500), Money(1000) }, mode + "cache of best-effort batch");
+		check(stored(server) == std::vector<Money>{ Money(9500), Money(1000) },
+			mode + "end-of-day balances of best-effort batch");
+		check(records(server) == 3, mode + "history of best-effort batch");
+	}
+
+	// The cache loaded from the database holds what the cache written through did
+	{
+		BankServer server(1);
+		server.setup(serverPath(root));
+		check(balances(server) == std::vector<Money>{ Money(9500), Money(1000) }, mode + "cache loaded again");
+	}
+
+	removeScratch(root);
+}
+
+void SelfTest::checkGroupCommit()
+{
+	fs::path root = createScratch("group_commit_batch = 16\ngroup_commit_window = 500\n");
+	std::string today = Protocol::dateFromDays(BankServer::currentDate());
+
+	{
+		BankServer server(CONCURRENT_THREADS);
+		server.setup(serverPath(root));
+		for (int t = 0; t < CONCURRENT_THREADS; t++) {
+			std::string email = "user" + std::to_string(t) + "@x";
+			serve(server, "02" + email + ";secret\n");
+			serve(server, "08" + email + ";main\n");
+		}
+		std::size_t groups_before = server.committedGroups();
+
+		// Every thread deposits to an account of its own, so they only meet at the writer thread
+		std::atomic<int> rejected(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < CONCURRENT_THREADS; t++) {
+			threads.emplace_back([&server, &rejected, t]() {
+				std::string deposit = "07user" + std::to_string(t) + "@x;main;1\n";
+				for (int i = 0; i < REQUESTS_PER_THREAD; i++) {
+					if (!serve(server, deposit).accepted) {
+						rejected++;
+					}
+				}
+			});
+		}
+		for (auto&& thread : threads) {
+			thread.join();
+		}
+
+		std::size_t groups = server.committedGroups() - groups_before;
+		check(rejected == 0, "concurrent deposits accepted");
+		check((groups > 0) && (groups < static_cast<std::size_t>(CONCURRENT_THREADS * REQUESTS_PER_THREAD)),
+			"concurrent deposits committed in groups");
+
+		Money expected(REQUESTS_PER_THREAD * Money::SCALE);
+		for (int t = 0; t < CONCURRENT_THREADS; t++) {
+			std::string account = "user" + std::to_string(t) + "@x";
+			check(serve(server, "10" + account + "\n").amounts == std::vector<Money>{ expected },
+				"cache of concurrent deposits to " + account);
+			check(serve(server, "15" + account + ";main;" + today + "\n").amounts == std::vector<Money>{ expected },
+				"end-of-day balance of concurrent deposits to " + account);
+			check(serve(server, "09" + account + ";main;" + today + ";" + today + "\n").counts
+				== std::vector<int>{ REQUESTS_PER_THREAD }, "history of concurrent deposits to " + account);
+		}
+	}
+
+	removeScratch(root);
+}
+
+void SelfTest::checkCache()
+{
+	fs::path root = createScratch();
+
+	{
+		Database database;
+		database.setup(serverPath(root));
+		database.addUser(User("a@x", "secret", {}));
+		database.addAccount(Account("a@x", "spare", Money(700), State::ok));
+		database.addAccount(Account("a@x", "main", Money(), State::ok));
+		long long id = database.getAccountId("a@x", "main");
+
+		AccountCache cache;
+		cache.warm(database);
+
+		User user;
+		check(cache.findUser("a@x", user) && (user.password_ == "secret") && (user.accounts_.size() == 2)
+			&& (user.accounts_[0].name_ == "main") && (user.accounts_[1].balance_ == Money(700)),
+			"user loaded with the accounts ordered by name");
+		check(cache.findAccountId("a@x", "main") == id, "identifier of a loaded account");
+		check(cache.findAccountId("a@x", "none") == Database::DB_NO_ACCOUNT, "identifier of an unknown account");
+
+		Account account;
+		check(cache.findAccount("a@x", "main", AccountCache::Changes(), account) && (account.id_ == id),
+			"account found");
+		account.balance_ = Money(500);
+		AccountCache::Changes changes{ { id, account } };
+
+		Account seen;
+		cache.findAccount("a@x", "main", changes, seen);
+		check(seen.balance_ == Money(500), "changes seen by their operation");
+		cache.findAccount("a@x", "main", AccountCache::Changes(), seen);
+		check(seen.balance_ == Money(), "changes not seen by the others before they are applied");
+
+		check(cache.apply(changes).empty(), "no state changed by a balance change");
+		cache.findAccount("a@x", "main", AccountCache::Changes(), seen);
+		check(seen.balance_ == Money(500), "changes seen once applied");
+
+		account.state_ = State::blocked;
+		std::vector<Account> changed = cache.apply(AccountCache::Changes{ { id, account } });
+		check((changed.size() == 1) && (changed[0].id_ == id) && (changed[0].state_ == State::blocked),
+			"changed state told by the apply");
+		check(cache.apply(AccountCache::Changes{ { id, account } }).empty(), "same state applied again not told");
+
+		Account added("a@x", "other", Money(), State::ok);
+		added.id_ = id + 100;
+		cache.addAccount(added);
+		check((cache.findAccountId("a@x", "other") == added.id_) && cache.findUser("a@x", user)
+			&& (user.accounts_.size() == 3), "account added to the cache");
+	}
+
+	removeScratch(root);
+}
+
+void SelfTest::checkDeltas()
+{
+	fs::path root = createScratch();
+
+	auto balances = [](BankServer& server) {
+		std::vector<Money> amounts;
+		for (auto&& email : { "a@x", "b@x" }) {
+			Response response = serve(server, std::string("10") + email + "\n");
+			amounts.insert(amounts.end(), response.amounts.begin(), response.amounts.end());
+		}
+		return amounts;
+	};
+	const std::vector<Money> initial{ Money(10000), Money(10000) };
+
+	{
+		BankServer server(CONCURRENT_THREADS);
+		server.setup(serverPath(root));
+		for (auto&& request : { "02a@x;secret\n", "02b@x;secret\n", "08a@x;main\n", "08b@x;main\n", "07a@x;main;100\n",
+			"07b@x;main;100\n" }) {
+			serve(server, request);
+		}
+
+		Response self = serve(server, "03a@x;a@x;main;main;5\n");
+		check(self.accepted && (self.amounts == std::vector<Money>{ Money(10000) }), "transfer to the same account replied");
+		check(balances(server) == initial, "transfer to the same account kept the balance");
+
+		// Half the threads transfer one way, half the other, each transfer as often
+		std::vector<std::thread> threads;
+		for (int t = 0; t < CONCURRENT_THREADS; t++) {
+			threads.emplace_back([&server, t]() {
+				std::string transfer = (t % 2 == 0) ? "03a@x;b@x;main;main;1\n" : "03b@x;a@x;main;main;1\n";
+				for (int i = 0; i < REQUESTS_PER_THREAD; i++) {
+					serve(server, transfer);
+				}
+			});
+		}
+		for (auto&& thread : threads) {
+			thread.join();
+		}
+		check(balances(server) == initial, "transfers at once in both directions kept the balances");
+	}
+
+	{
+		BankServer server(1);
+		server.setup(serverPath(root));
+		check(balances(server) == initial, "balances stored as they were served");
+	}
+
+	removeScratch(root);
+}
+
+SelfTest::Response SelfTest::serve(BankServer& server, const std::string& text)
+{
+	Response response;
+	server.serve(BankServer::parseRequest(text), response);
+	return response;
+}
+
+fs::path SelfTest::createScratch(const std::string& config)
+{
+	// Taken only if no other run has created a directory of the same name
+	std::random_device random;
+	fs::path root;
+	do {
+		root = fs::temp_directory_path() / ("bank-self-test-" + std::to_string(random()));
+	} while (!fs::create_directory(root));
+
+	fs::create_directories(root / "db");
+	std::ofstream(root / "db" / "database.conf") << config;
+	return root;
+}
+
+void SelfTest::removeScratch(const fs::path& root)
+{
+	// Archives are read-only, which keeps them from being removed on some systems
+	std::error_code ignored;
+	for (auto&& entry : fs::recursive_directory_iterator(root, ignored)) {
+		fs::permissions(entry.path(), fs::perms::owner_write, fs::perm_options::add, ignored);
+	}
+	fs::remove_all(root, ignored);
+}
+
+std::string SelfTest::serverPath(const fs::path& root)
+{
+	return (root / "bin" / "server").string();
+}
@@ -0,0 +1,174 @@
+#include <cstddef>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "protocol.h"
+
+#ifndef SELF_TEST_H_
+#define SELF_TEST_H_
+
+class BankServer;
+
+/**
+ * Checks of the behaviour the requests rely on, run against scratch databases (each created in a
+ * directory of its own in the temporary directory and removed afterwards, so that runs at once
+ * don't disturb each other). The checks are grouped by the part of the server they cover.
+ *
+ * Unlike an assert, a check is made in any build; each failed one is printed, as is an exception
+ * ending a group of checks early.
+ */
+class SelfTest
+{
+public:
+	/**
+	 * @param[out]	out		Stream the failed checks and the summary are written to
+	 */
+	SelfTest(std::ostream& out) : out(out), checks(0), failures(0) {};
+
+	/**
+	 * Run all the checks and print the failed ones.
+	 * @returns		Whether all the checks passed
+	 */
+	bool run();
+
+private:
+	/**
+	 * Response of a request served by the checks, the typed fields in order of their type.
+	 */
+	class Response : public ResponseWriter {
+	public:
+		void accept() override { accepted = true; };
+		void reject(const std::string& reason) override { accepted = false; this->reason = reason; };
+		void addText(std::string_view text) override { texts.emplace_back(text); };
+		void addAmount(Money amount) override { amounts.push_back(amount); };
+		void addDate(int day) override { dates.push_back(day); };
+		void addCount(int count) override { counts.push_back(count); };
+
+		// Outcome of the request
+		bool accepted = false;
+		std::string reason;
+
+		// Fields of the response
+		std::vector<std::string> texts;
+		std::vector<Money> amounts;
+		std::vector<int> dates;
+		std::vector<int> counts;
+	};
+
+	// Stream the results are written to
+	std::ostream& out;
+
+	// Checks made and failed so far
+	std::size_t checks;
+	std::size_t failures;
+
+	/**
+	 * Count a check and print it if it failed.
+	 * @param[in]	passed		Whether the check passed
+	 * @param[in]	what		What was checked
+	 */
+	void check(bool passed, const std::string& what);
+
+	/**
+	 * Check that an operation throws an exception of a given type.
+	 * @param[in]	operation	The operation
+	 * @param[in]	what		What was checked
+	 */
+	template <typename Exception, typename Operation>
+	void checkThrows(Operation operation, const std::string& what);
+
+	/**
+	 * Balances as of a day: kept as the balance changes and derived from the history by the import,
+	 * across the days nothing changed, and served for an account whose balance never changed.
+	 */
+	void checkBalances();
+
+	/**
+	 * Parsing, formatting and the overflow checks of the arithmetic of money.
+	 */
+	void checkMoney();
+
+	// Number of history records written by the cursor checks, and records a page holds
+	static const int PAGE_RECORDS = 24;
+	static const int PAGE_SIZE = 5;
+
+	/**
+	 * Pages of a history spanning several months, followed by their cursors, give the same records
+	 * as the whole history, each once and in order; a malformed cursor is rejected.
+	 */
+	void checkHistoryPages();
+
+	/**
+	 * Records of an archived month are read along with the rest, after compacting the database
+	 * and after opening it again, and they can't be written anymore.
+	 */
+	void checkArchive();
+
+	/**
+	 * Users, accounts and records imported from CSV and NDJSON, in batches of a few rows: quoted
+	 * fields, the rows that can't be imported reported with their line and skipped, the previous
+	 * targets added and the imported accounts served.
+	 */
+	void checkImport();
+
+	/**
+	 * A rejected operation rolls back an all-or-nothing batch and only itself in a best-effort one,
+	 * in the cache as well as in the history and the end-of-day balances. The cache loaded from the
+	 * database again holds what the cache written through did.
+	 * @param[in]	config		Lines of the database config file
+	 */
+	void checkBatch(const std::string& config);
+
+	// Threads serving requests at once in the concurrent checks, and requests each of them makes
+	static const int CONCURRENT_THREADS = 8;
+	static const int REQUESTS_PER_THREAD = 25;
+
+	/**
+	 * Deposits served from many threads at once are committed in groups by the writer thread, none
+	 * of them lost and each visible in the cache, the history and the end-of-day balances.
+	 */
+	void checkGroupCommit();
+
+	/**
+	 * The cache of accounts: loaded from the database, an operation sees its own changes before
+	 * they are applied and the others only after, and applying them tells which states changed.
+	 */
+	void checkCache();
+
+	/**
+	 * Balances changed by deltas: a transfer to the same account leaves its balance as it was, and
+	 * transfers served at once in both directions keep the sum, in the cache and in the database.
+	 */
+	void checkDeltas();
+
+	/**
+	 * Serve a request of the text protocol.
+	 * @param[in]	server	The server
+	 * @param[in]	text	The request
+	 * @returns				The response
+	 */
+	static Response serve(BankServer& server, const std::string& text);
+
+	/**
+	 * Create an empty scratch directory of a unique name, the server finds its database in `db` under it.
+	 * @param[in]	config		Lines of the database config file
+	 * @returns					The directory
+	 */
+	static std::filesystem::path createScratch(const std::string& config = "");
+
+	/**
+	 * Remove the scratch directory, including the read-only archives.
+	 * @param[in]	root	The directory
+	 */
+	static void removeScratch(const std::filesystem::path& root);
+
+	/**
+	 * Path the server would be run from, for the database of a scratch directory.
+	 * @param[in]	root	The directory
+	 * @returns				The path
+	 */
+	static std::string serverPath(const std::filesystem::path& root);
+};
+
+#endif
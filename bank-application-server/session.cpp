@@ -0,0 +1,325 @@
+#include "session.h"
+#include "bank_server.h"
+#include "protocol.h"
+#include <iostream>
+#include <vector>
+
+const std::string Session::SESSION_ID = "00";
+
+Session::~Session()
+{
+	admission.releaseConnection();
+}
+
+void Session::start()
+{
+	readRequest();
+}
+
+void Session::readRequest()
+{
+	setDeadline();
+
+	auto self = shared_from_this();
+	asio::async_read_until(socket, buffer, BankServer::END,
+		[this, self](const asio::error_code& error, std::size_t length) {
+			// The buffer is full and still holds no complete request, the rest can't be read
+			if (error == asio::error::not_found) {
+				reading_done = true;
+				queueResponse(rejectText("Request too large"));
+				return;
+			}
+			if (error) {
+				reading_done = true;
+				closeIfDone();
+				return;
+			}
+			handleRequest(length);
+		});
+}
+
+void Session::handleRequest(std::size_t length)
+{
+	// The request is parsed right in the receive buffer, it is consumed once served
+	std::string_view incoming(static_cast<const char*>(buffer.data().data()), length);
+
+	// Switch to the binary protocol, the rest of the connection carries frames only
+	if ((incoming.size() == 2) && (static_cast<unsigned char>(incoming[0]) == Protocol::VERSION_2)) {
+		buffer.consume(length);
+		binary = true;
+		keep_alive = true;
+		ResponseBuilder response(1);
+		response.append(static_cast<char>(Protocol::VERSION_2));
+		queueResponse(std::move(response));
+		readFrameLength();
+		return;
+	}
+
+	// Switch to persistent session, the server only acknowledges it
+	if (incoming.compare(0, SESSION_ID.size(), SESSION_ID) == 0) {
+		keep_alive = true;
+		ResponseBuilder response;
+		response.append(BankServer::ACCEPTED);
+		response.append(BankServer::END);
+		queueResponse(std::move(response));
+	}
+	else if (incoming[0] == CORRELATION_MARK) {
+		dispatchRequest(std::string(incoming));
+	}
+	else if (admission.admitRequest()) {
+		queueResponse(serve(incoming));
+		admission.releaseRequest();
+	}
+	else {
+		queueResponse(rejectText(admission.busyReason()));
+	}
+	buffer.consume(length);
+
+	// Legacy connections carry a single request
+	if (keep_alive) {
+		readRequest();
+	}
+	else {
+		reading_done = true;
+	}
+}
+
+void Session::readFrameLength()
+{
+	fillBuffer(Protocol::LENGTH_SIZE, [this]() {
+		auto begin = asio::buffers_begin(buffer.data());
+		std::string prefix(begin, begin + Protocol::LENGTH_SIZE);
+		std::uint32_t length = Protocol::frameLength(prefix.data());
+
+		// The stream can't be resynchronized after a malformed frame
+		if ((length < Protocol::HEADER_SIZE) || (length > Protocol::MAX_FRAME_SIZE)) {
+			std::cerr << "Malformed frame of length " << length << std::endl;
+			reading_done = true;
+			closeIfDone();
+			return;
+		}
+
+		readFrame(length);
+	});
+}
+
+void Session::readFrame(std::uint32_t length)
+{
+	fillBuffer(Protocol::LENGTH_SIZE + length, [this, length]() {
+		auto begin = asio::buffers_begin(buffer.data()) + Protocol::LENGTH_SIZE;
+		std::string frame(begin, begin + length);
+		buffer.consume(Protocol::LENGTH_SIZE + length);
+
+		dispatchFrame(std::move(frame));
+		readFrameLength();
+	});
+}
+
+template <typename Handler>
+void Session::fillBuffer(std::size_t size, Handler handler)
+{
+	if (buffer.size() >= size) {
+		handler();
+		return;
+	}
+
+	setDeadline();
+
+	auto self = shared_from_this();
+	asio::async_read(socket, buffer, asio::transfer_at_least(size - buffer.size()),
+		[this, self, handler](const asio::error_code& error, std::size_t) {
+			if (error) {
+				reading_done = true;
+				closeIfDone();
+				return;
+			}
+			handler();
+		});
+}
+
+void Session::dispatchFrame(std::string frame)
+{
+	if (!admission.admitRequest()) {
+		queueResponse(rejectFrame(frame, admission.busyReason()));
+		return;
+	}
+
+	pending++;
+
+	auto self = shared_from_this();
+	asio::post(workers, [this, self, frame]() {
+		auto response = std::make_shared<ResponseBuilder>(serveFrame(frame));
+		admission.releaseRequest();
+
+		asio::post(socket.get_executor(), [this, self, response]() {
+			pending--;
+			queueResponse(std::move(*response));
+		});
+	});
+}
+
+ResponseBuilder Session::serveFrame(const std::string& frame)
+{
+	try {
+		Request decoded = Protocol::decodeRequest(frame);
+		ResponseBuilder builder;
+		BinaryResponseWriter response(builder, decoded);
+		server.serve(decoded, response);
+		response.finish();
+		return builder;
+	}
+	catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return rejectFrame(frame, "Internal server error");
+	}
+}
+
+ResponseBuilder Session::rejectFrame(const std::string& frame, const std::string& reason)
+{
+	// The header is read on its own so that even a malformed request gets a matching response
+	Request request{};
+	request.opcode_ = static_cast<int>(Protocol::getNumber(frame.data(), 1));
+	request.correlation_id_ = static_cast<std::uint32_t>(Protocol::getNumber(frame.data() + 1, 4));
+
+	ResponseBuilder builder;
+	BinaryResponseWriter response(builder, request);
+	response.reject(reason);
+	response.finish();
+	return builder;
+}
+
+void Session::dispatchRequest(std::string incoming)
+{
+	std::size_t separator = incoming.find(BankServer::SEPARATOR);
+	if (separator == std::string::npos) {
+		queueResponse(rejectText("Malformed correlation id"));
+		return;
+	}
+
+	std::string_view tag = std::string_view(incoming).substr(0, separator + 1);
+	if (!admission.admitRequest()) {
+		ResponseBuilder response = rejectText(admission.busyReason());
+		response.setPrefix(tag);
+		queueResponse(std::move(response));
+		return;
+	}
+
+	pending++;
+
+	auto self = shared_from_this();
+	asio::post(workers, [this, self, incoming, separator]() {
+		std::string_view request(incoming);
+		auto response = std::make_shared<ResponseBuilder>(serve(request.substr(separator + 1)));
+		response->setPrefix(request.substr(0, separator + 1));
+		admission.releaseRequest();
+
+		asio::post(socket.get_executor(), [this, self, response]() {
+			pending--;
+			queueResponse(std::move(*response));
+		});
+	});
+}
+
+ResponseBuilder Session::serve(std::string_view incoming)
+{
+	ResponseBuilder message;
+
+	// A malformed request must not take the whole server down
+	try {
+		server.createResponseMessage(incoming, message);
+	}
+	catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		message = rejectText("Internal server error");
+	}
+
+	return message;
+}
+
+ResponseBuilder Session::rejectText(const std::string& reason)
+{
+	ResponseBuilder response;
+	response.append(BankServer::REJECTED);
+	response.append(reason);
+	response.append(BankServer::END);
+	return response;
+}
+
+void Session::queueResponse(ResponseBuilder response)
+{
+	outbox.push_back(std::move(response));
+
+	// Otherwise the response is written once the current write completes
+	if (writing == 0) {
+		writeResponse();
+	}
+}
+
+void Session::writeResponse()
+{
+	// Everything queued so far goes out in a single gathered write, the responses stay in place
+	std::vector<asio::const_buffer> buffers;
+	buffers.reserve(2 * outbox.size());
+	for (auto&& response : outbox) {
+		auto parts = response.buffers();
+		buffers.insert(buffers.end(), parts.begin(), parts.end());
+	}
+	writing = outbox.size();
+	setDeadline();
+
+	auto self = shared_from_this();
+	asio::async_write(socket, buffers,
+		[this, self](const asio::error_code& error, std::size_t) {
+			if (error) {
+				close();
+				return;
+			}
+
+			outbox.erase(outbox.begin(), outbox.begin() + writing);
+			writing = 0;
+			if (!outbox.empty()) {
+				writeResponse();
+				return;
+			}
+			setDeadline();
+			closeIfDone();
+		});
+}
+
+void Session::closeIfDone()
+{
+	if (reading_done && (pending == 0) && outbox.empty()) {
+		close();
+	}
+}
+
+void Session::setDeadline()
+{
+	const AdmissionLimits& limits = admission.getLimits();
+	deadline.expires_after((writing > 0) ? limits.write_timeout : limits.idle_timeout);
+
+	auto self = shared_from_this();
+	deadline.async_wait([this, self](const asio::error_code& error) {
+		// The deadline was moved or the session closed
+		if (error == asio::error::operation_aborted || !socket.is_open()) {
+			return;
+		}
+
+		// Waiting for the workers is not idling
+		if ((writing == 0) && (pending > 0)) {
+			setDeadline();
+			return;
+		}
+
+		admission.timedOut();
+		close();
+	});
+}
+
+void Session::close()
+{
+	asio::error_code ignored;
+	deadline.cancel();
+	socket.shutdown(tcp::socket::shutdown_both, ignored);
+	socket.close(ignored);
+}
@@ -0,0 +1,215 @@
+#include <SDKDDKVer.h>
+
+#define ASIO_STANDALONE
+#include <asio.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "admission.h"
+#include "protocol.h"
+#include "response_builder.h"
+
+#ifndef SESSION_H_
+#define SESSION_H_
+
+using tcp = asio::ip::tcp;
+
+class BankServer;
+
+/**
+ * A single client connection. The session reads requests terminated by '\n', lets the server
+ * create the responses and writes them back asynchronously, so no client ever blocks the others.
+ * Sessions keep themselves alive through shared pointers captured by the pending handlers; all
+ * the socket operations and session state changes run on the strand of the socket.
+ *
+ * Legacy clients send exactly one request per connection, which is closed after the response
+ * is written. A client may instead open a persistent session by sending `SESSION_ID` as its first
+ * request; the connection is then kept open and any number of requests is served on it.
+ *
+ * A request may be prefixed with a correlation id (`#<id>;`). Such requests are served in
+ * parallel by the worker threads while the session keeps reading, so a client can pipeline
+ * several requests without waiting for the replies. Each response carries the id of its request
+ * and the responses are written in the order in which they are completed. Requests without
+ * a correlation id are served one after another.
+ *
+ * A client that sends `Protocol::VERSION_2` followed by '\n' as its first request switches the
+ * connection to the binary protocol. The session acknowledges it by sending back the version
+ * byte and then reads length-prefixed frames; every frame carries a correlation id, so all of
+ * them are served by the workers like the tagged text requests.
+ *
+ * A text request longer than `MAX_REQUEST_SIZE` is rejected and the connection is closed, the
+ * buffer never grows past it. Requests over the admission limit are rejected right away with
+ * the busy reason. A connection is closed once it has been idle (no request in progress) or
+ * its client hasn't read a response for longer than the timeouts of the admission limits.
+ */
+class Session : public std::enable_shared_from_this<Session>
+{
+public:
+	/**
+	 * Take ownership of an accepted socket.
+	 * @param[in]	socket		Socket for network communication with client (bound to a strand)
+	 * @param[in]	server		Server creating responses for requests
+	 * @param[in]	admission	Admission control, the connection is already admitted
+	 * @param[in]	workers		Executor serving requests with correlation id
+	 */
+	Session(tcp::socket socket, BankServer& server, Admission& admission, const asio::any_io_executor& workers)
+		: socket(std::move(socket)), server(server), admission(admission), workers(workers),
+		  deadline(this->socket.get_executor()), buffer(MAX_REQUEST_SIZE) {};
+
+	/**
+	 * Release the connection from admission control.
+	 */
+	~Session();
+
+	/**
+	 * Start reading the request.
+	 */
+	void start();
+
+	// Request opening a persistent session
+	static const std::string SESSION_ID;
+
+	// Character starting the correlation id of a request
+	static const char CORRELATION_MARK = '#';
+
+	// Most bytes buffered for a request: a frame with its length prefix, a text request up to its '\n'
+	static const std::size_t MAX_REQUEST_SIZE = Protocol::LENGTH_SIZE + Protocol::MAX_FRAME_SIZE;
+
+private:
+	// Connection to the client
+	tcp::socket socket;
+
+	// Server serving the requests
+	BankServer& server;
+
+	// Admission control of the requests
+	Admission& admission;
+
+	// Threads serving the requests with correlation id
+	asio::any_io_executor workers;
+
+	// Closes the connection once it has been idle or stalled for too long
+	asio::steady_timer deadline;
+
+	// Incoming data that were not processed yet, at most MAX_REQUEST_SIZE bytes
+	asio::streambuf buffer;
+
+	// Responses waiting to be written to the client, the first `writing` of them are being written
+	std::deque<ResponseBuilder> outbox;
+
+	// Number of responses in the write in progress
+	std::size_t writing = 0;
+
+	// True if the connection is kept open after the response is written
+	bool keep_alive = false;
+
+	// True once the client won't send any more requests
+	bool reading_done = false;
+
+	// Number of requests being served by the workers
+	int pending = 0;
+
+	// True once the client has switched to the binary protocol
+	bool binary = false;
+
+	/**
+	 * Asynchronously read a single request terminated by '\n'.
+	 */
+	void readRequest();
+
+	/**
+	 * Serve the request stored in buffer and queue the response.
+	 * @param[in]	length		Length of the request (including the terminal character)
+	 */
+	void handleRequest(std::size_t length);
+
+	/**
+	 * Asynchronously read the length prefix of a frame of the binary protocol.
+	 */
+	void readFrameLength();
+
+	/**
+	 * Asynchronously read the rest of a frame of the binary protocol and dispatch it.
+	 * @param[in]	length		Length of the frame (without the length prefix)
+	 */
+	void readFrame(std::uint32_t length);
+
+	/**
+	 * Read from the socket until the buffer holds at least the given number of bytes.
+	 * @param[in]	size		Number of bytes needed
+	 * @param[in]	handler		Called once the bytes are buffered
+	 */
+	template <typename Handler>
+	void fillBuffer(std::size_t size, Handler handler);
+
+	/**
+	 * Let the workers serve a frame of the binary protocol; the response is queued once it is ready.
+	 * @param[in]	frame		The frame (without the length prefix)
+	 */
+	void dispatchFrame(std::string frame);
+
+	/**
+	 * Create the response frame for a request frame, a failure is reported to the client as an error.
+	 * @param[in]	frame		The frame (without the length prefix)
+	 * @returns					The response frame
+	 */
+	ResponseBuilder serveFrame(const std::string& frame);
+
+	/**
+	 * Create a rejection of a request frame.
+	 * @param[in]	frame		The frame (without the length prefix)
+	 * @param[in]	reason		Reason of the rejection
+	 * @returns					The response frame
+	 */
+	ResponseBuilder rejectFrame(const std::string& frame, const std::string& reason);
+
+	/**
+	 * Let the workers serve a request with correlation id; the response is queued once it is ready.
+	 * @param[in]	incoming	The request (including the correlation id)
+	 */
+	void dispatchRequest(std::string incoming);
+
+	/**
+	 * Create the response for a request, a failure is reported to the client as an error.
+	 * @param[in]	incoming	The request
+	 * @returns					The response
+	 */
+	ResponseBuilder serve(std::string_view incoming);
+
+	/**
+	 * Create a rejection in the text protocol.
+	 * @param[in]	reason		Reason of the rejection
+	 * @returns					The response
+	 */
+	ResponseBuilder rejectText(const std::string& reason);
+
+	/**
+	 * Queue the response to be written and start writing if no write is in progress.
+	 * @param[in]	response	The response
+	 */
+	void queueResponse(ResponseBuilder response);
+
+	/**
+	 * Asynchronously write all the queued responses at once.
+	 */
+	void writeResponse();
+
+	/**
+	 * Restart the deadline of the connection: the write timeout while a response is being
+	 * written, the idle timeout otherwise.
+	 */
+	void setDeadline();
+
+	/**
+	 * Close the connection if there is nothing left to be read or written.
+	 */
+	void closeIfDone();
+
+	/**
+	 * Gracefully close the connection, errors are ignored.
+	 */
+	void close();
+};
+
+#endif
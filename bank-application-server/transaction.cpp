@@ -0,0 +1,26 @@
+#include "transaction.h"
+
+Transaction::Transaction(const Database& database) : scoped(database), active(false)
+{
+	scoped.begin();
+	active = true;
+}
+
+Transaction::~Transaction()
+{
+	if (active) {
+		scoped.rollback();
+	}
+}
+
+void Transaction::commit()
+{
+	scoped.commit();
+	active = false;
+}
+
+void Transaction::rollback()
+{
+	active = false;
+	scoped.rollback();
+}
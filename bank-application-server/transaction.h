@@ -0,0 +1,53 @@
+#include "database.h"
+
+#ifndef TRANSACTION_H_
+#define TRANSACTION_H_
+
+/**
+ * Scope of a database transaction. The transaction begins when the object is created and, unless
+ * it has been committed, it is rolled back when the object is destroyed, so an error midway never
+ * leaves a business operation half done. All the statements of an operation go through
+ * `database()` and together cost a single commit.
+ */
+class Transaction
+{
+public:
+	/**
+	 * Begin a transaction, taking the write lock of the database right away.
+	 * @param[in]	database	Database shared by the threads, the transaction works on a copy of it
+	 */
+	Transaction(const Database& database);
+
+	/**
+	 * Roll the transaction back if it is still in progress.
+	 */
+	~Transaction();
+
+	Transaction(const Transaction&) = delete;
+	Transaction& operator=(const Transaction&) = delete;
+
+	/**
+	 * Database the statements of the transaction are issued through.
+	 * @returns		The database
+	 */
+	Database& database() { return scoped; };
+
+	/**
+	 * Commit the transaction.
+	 */
+	void commit();
+
+	/**
+	 * Roll the transaction back.
+	 */
+	void rollback();
+
+private:
+	// Copy of the database bound to the connection of the transaction
+	Database scoped;
+
+	// Whether the transaction is still in progress
+	bool active;
+};
+
+#endif